@@ -28,6 +28,23 @@ void TarjanSolver::solve() {
 		}
 	}
 
+	// components come out in reverse topological order, so every edge
+	// goes from a component to an earlier one
+	m_scc_edges.resize(m_scc_vertices.size());
+	for (int u {0}; u < m_vertex_count; ++u) {
+		for (int v : m_graph[u]) {
+			int cu = m_component_of[u];
+			int cv = m_component_of[v];
+			if (cu != cv)
+				m_scc_edges[cu].push_back(cv);
+		}
+	}
+
+	for (auto& edges : m_scc_edges) {
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	}
+
 	m_solved = true;
 }
 
@@ -81,3 +98,8 @@ std::vector<int> const& TarjanSolver::component_of_vertices() const {
 	assert(m_solved);
 	return m_component_of;
 }
+
+std::vector<std::vector<int>> const& TarjanSolver::edges_of_components() const {
+	assert(m_solved);
+	return m_scc_edges;
+}
@@ -9,6 +9,9 @@ struct TarjanSolver {
 	void solve();
 	std::vector<std::vector<int>> const& vertices_of_components() const;
 	std::vector<int> const& component_of_vertices() const;
+	// the condensation of the graph: for each component, the other
+	// components it has edges to, without repetitions
+	std::vector<std::vector<int>> const& edges_of_components() const;
 
   private:
 	void visit(int u);
@@ -28,6 +31,7 @@ struct TarjanSolver {
 	// a list of vertices of each strongly connected component
 	// they also happen to be in topological order
 	std::vector<std::vector<int>> m_scc_vertices;
+	std::vector<std::vector<int>> m_scc_edges;
 	std::vector<int> m_vertex_stack;
 
 	bool m_solved {false};
@@ -1,22 +1,46 @@
 #pragma once
 
+#include <utility>
 #include <vector>
 
 struct UnionFind {
 	int new_node() {
 		int result = repr.size();
 		repr.push_back(result);
+		set_size.push_back(1);
 		return result;
 	}
 
+	// Iterative, with path halving: every node we step over is made to
+	// point to its grandparent, so later searches take half the steps.
 	int find(int i) {
-		if (repr[i] == i)
-			return i;
-		return repr[i] = find(repr[i]);
+		while (repr[i] != i) {
+			repr[i] = repr[repr[i]];
+			i = repr[i];
+		}
+		return i;
+	}
+
+	// Like find, but doesn't shorten paths on the way, so several threads
+	// can call it at once
+	int find_readonly(int i) const {
+		while (repr[i] != i)
+			i = repr[i];
+		return i;
 	}
 
-	void join_left_to_right(int i, int j) {
-		repr[find(i)] = find(j);
+	// Joins the sets of i and j, hanging the smaller one from the larger
+	// one, and returns the representative of the joined set.
+	int join(int i, int j) {
+		i = find(i);
+		j = find(j);
+		if (i == j)
+			return i;
+		if (set_size[i] > set_size[j])
+			std::swap(i, j);
+		repr[i] = j;
+		set_size[j] += set_size[i];
+		return j;
 	}
 
 	bool is_single(int i) {
@@ -25,4 +49,5 @@ struct UnionFind {
 
   private:
 	std::vector<int> repr;
+	std::vector<int> set_size;
 };
@@ -4,18 +4,18 @@
 #include "./log/log.hpp"
 #include "cst.hpp"
 #include "ast.hpp"
-#include "interpreter/bytecode.hpp"
+#include "interpreter/code_cache.hpp"
 
 namespace AST {
 
-InternedString const& Declaration::identifier_text() const {
+InternedString Declaration::identifier_text() const {
 	if (m_identifier.is_null()) {
 		if (!m_cst)
 			Log::fatal() << "No identifier string or fallback on declaration";
 
 		auto cst = static_cast<CST::Declaration*>(m_cst);
 
-		auto const& found_identifier = cst->identifier_virtual();
+		auto found_identifier = cst->identifier_virtual();
 
 		Log::warning() << "No identifier on declaration, using token data as fallback: '" << found_identifier << "'";
 
@@ -30,7 +30,8 @@ Token const* Identifier::token() const {
 }
 
 FunctionLiteral::~FunctionLiteral() {
-	delete bytecode;
+	if (m_compiled)
+		m_compiled->m_function = nullptr;
 }
 
 } // namespace AST
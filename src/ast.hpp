@@ -18,7 +18,7 @@ struct CST;
 }
 
 namespace Bytecode {
-struct Executable;
+struct CompiledFunction;
 };
 
 namespace AST {
@@ -81,7 +81,7 @@ struct Declaration : public Stmt {
 		return !m_surrounding_function && !m_surrounding_seq_expr;
 	}
 
-	InternedString const& identifier_text() const;
+	InternedString identifier_text() const;
 
 	Declaration()
 	    : Stmt {StmtTag::Declaration} {}
@@ -118,7 +118,7 @@ struct IntegerLiteral : public Expr {
 struct StringLiteral : public Expr {
 	InternedString m_text;
 
-	std::string const& text() {
+	string_view text() {
 		return m_text.str();
 	}
 
@@ -149,17 +149,26 @@ struct ArrayLiteral : public Expr {
 struct FunctionLiteral : public Expr {
 	struct CaptureData {
 		Declaration* outer_declaration{nullptr};
-		int outer_frame_offset{INT_MIN};
-		int inner_frame_offset{INT_MIN};
+		// position of the variable among the captures of a closure
+		int index{INT_MIN};
+	};
+
+	// Where a closure gets one of its captures from when it's made: a
+	// slot in the current frame, or a capture of the current closure
+	struct CaptureSource {
+		bool from_capture{false};
+		int offset{INT_MIN};
 	};
 
 	Expr* m_body;
 	std::vector<Declaration> m_args;
 	std::unordered_map<InternedString, CaptureData> m_captures;
+	// indexed like the captures of the closures
+	std::vector<CaptureSource> m_capture_sources;
 	FunctionLiteral* m_surrounding_function {nullptr};
 
-	bool tried_compilation {false};
-	Bytecode::Executable* bytecode {nullptr};
+	// entry in the code cache of the interpreter that runs the function
+	Bytecode::CompiledFunction* m_compiled {nullptr};
 
 	FunctionLiteral()
 	    : Expr {ExprTag::FunctionLiteral} {}
@@ -175,7 +184,11 @@ struct Identifier : public Expr {
 	FunctionLiteral* m_surrounding_function {nullptr};
 
 	Origin m_origin { Origin::Global };
+	// for captures, the index among the captures of the current closure
 	int m_frame_offset {INT_MIN};
+	// for globals, the slot in the interpreter's table of globals. Bound
+	// by the interpreter before the identifier is evaluated or compiled
+	int m_global_slot {-1};
 
 	Token const* token() const;
 	InternedString const& text() const {
@@ -18,7 +18,7 @@ void compute_offsets(AST::Identifier* ast, int frame_offset) {
 		ast->m_frame_offset = decl->m_frame_offset;
 	} else if (ast->m_origin == AST::Identifier::Origin::Capture) {
 		auto& capture_data = ast->m_surrounding_function->m_captures[ast->text()];
-		ast->m_frame_offset = capture_data.inner_frame_offset;
+		ast->m_frame_offset = capture_data.index;
 	} else {
 		return;
 	}
@@ -44,19 +44,23 @@ void compute_offsets(AST::FunctionLiteral* ast, int frame_offset) {
 	for (auto& arg_decl : ast->m_args)
 		arg_decl.m_frame_offset = frame_offset++;
 
-	// second thing: captures
+	// captures are not in the frame, they stay in the closure, which is
+	// right below the frame
+	int capture_index = 0;
+	ast->m_capture_sources.assign(ast->m_captures.size(), {});
 	for (auto& kv : ast->m_captures) {
-		kv.second.inner_frame_offset = frame_offset++;
+		kv.second.index = capture_index;
+		auto& source = ast->m_capture_sources[capture_index++];
 		auto decl = kv.second.outer_declaration;
 		if (decl->m_surrounding_function == ast->m_surrounding_function) {
 			// capture of a local variable
 			// just use the frame offset of the declaration
-			kv.second.outer_frame_offset = decl->m_frame_offset;
+			source.offset = decl->m_frame_offset;
 		} else {
 			// capture of a capture
 			// look at the captures of the surrounding function
-			kv.second.outer_frame_offset =
-			    ast->m_surrounding_function->m_captures[kv.first].inner_frame_offset;
+			source.from_capture = true;
+			source.offset = ast->m_surrounding_function->m_captures[kv.first].index;
 		}
 	}
 
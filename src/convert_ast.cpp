@@ -29,7 +29,7 @@ static Program* convert(CST::Program* cst, Allocator& alloc) {
 
 static IntegerLiteral* convert(CST::IntegerLiteral* cst, Allocator& alloc) {
 	auto ast = alloc.make<IntegerLiteral>();
-	ast->m_value = std::stoi(cst->text());
+	ast->m_value = std::stoi(cst->text().to_string());
 	if (cst->m_negative)
 		ast->m_value = -ast->m_value;
 	return ast;
@@ -37,7 +37,7 @@ static IntegerLiteral* convert(CST::IntegerLiteral* cst, Allocator& alloc) {
 
 static NumberLiteral* convert(CST::NumberLiteral* cst, Allocator& alloc) {
 	auto ast = alloc.make<NumberLiteral>();
-	ast->m_value = std::stof(cst->text());
+	ast->m_value = std::stof(cst->text().to_string());
 	if (cst->m_negative)
 		ast->m_value = -ast->m_value;
 	return ast;
@@ -45,7 +45,7 @@ static NumberLiteral* convert(CST::NumberLiteral* cst, Allocator& alloc) {
 
 static StringLiteral* convert(CST::StringLiteral* cst, Allocator& alloc) {
 	auto ast = alloc.make<StringLiteral>();
-	ast->m_text = cst->m_token->m_text;
+	ast->m_text = InternedString(cst->m_token->m_text);
 	return ast;
 }
 
@@ -123,7 +123,7 @@ static Expr* convert(CST::BinaryExpression* cst, Allocator& alloc) {
 	auto ast = alloc.make<CallExpression>();
 
 	auto identifier = alloc.make<Identifier>();
-	identifier->m_text = cst->m_op_token->m_text;
+	identifier->m_text = InternedString(cst->m_op_token->m_text);
 
 	ast->m_callee = identifier;
 
@@ -136,7 +136,7 @@ static Expr* convert(CST::BinaryExpression* cst, Allocator& alloc) {
 static Identifier* convert(CST::Identifier* cst, Allocator& alloc) {
 	auto ast = alloc.make<Identifier>();
 	ast->m_cst = cst;
-	ast->m_text = cst->m_token->m_text;
+	ast->m_text = cst->text();
 	return ast;
 }
 
@@ -174,7 +174,7 @@ static TernaryExpression* convert(CST::TernaryExpression* cst, Allocator& alloc)
 static AccessExpression* convert(CST::AccessExpression* cst, Allocator& alloc) {
 	auto ast = alloc.make<AccessExpression>();
 
-	ast->m_member = cst->m_member->m_text;
+	ast->m_member = InternedString(cst->m_member->m_text);
 	ast->m_target = convert_expr(cst->m_record, alloc);
 
 	return ast;
@@ -191,11 +191,11 @@ static MatchExpression* convert(CST::MatchExpression* cst, Allocator& alloc) {
 
 	std::unordered_map<InternedString, MatchExpression::CaseData> cases;
 	for (auto& case_data : cst->m_cases) {
-		auto case_name = case_data.m_name->m_text;
+		auto case_name = InternedString(case_data.m_name->m_text);
 
 		Declaration declaration;
 		// TODO: store match expression cst in declarations?
-		declaration.m_identifier = case_data.m_identifier->m_text;
+		declaration.m_identifier = InternedString(case_data.m_identifier->m_text);
 
 		if (case_data.m_type_hint)
 			declaration.m_type_hint = convert_expr(case_data.m_type_hint, alloc);
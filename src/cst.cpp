@@ -186,8 +186,8 @@ void print_impl(MatchExpression* cst, int d) {
 	for (auto const& case_data : cst->m_cases) {
 		std::cout << "\n";
 		print_indentation(d + indent_width + 1);
-		std::cout << "(\"" << case_data.m_name->m_text.str() << "\" \""
-		          << case_data.m_identifier->m_text.str() << "\"\n";
+		std::cout << "(\"" << case_data.m_name->m_text << "\" \""
+		          << case_data.m_identifier->m_text << "\"\n";
 		print(case_data.m_type_hint, d + indent_width + 1);
 		std::cout << "\n";
 		print(case_data.m_expression, d + indent_width + 1);
@@ -40,12 +40,21 @@ struct Block;
 struct Declaration;
 
 struct DeclarationData {
-	Token const* m_identifier_token;
+	Token const* m_identifier_token {nullptr};
 	Expr* m_type_hint {nullptr};  // can be nullptr
 	Expr* m_value {nullptr}; // can be nullptr
+	// the text of the identifier token, interned once when it's parsed
+	InternedString m_identifier;
+
+	DeclarationData() = default;
+	DeclarationData(Token const* identifier_token, Expr* type_hint, Expr* value)
+	    : m_identifier_token {identifier_token}
+	    , m_type_hint {type_hint}
+	    , m_value {value}
+	    , m_identifier {identifier_token->m_text} {}
 
 	InternedString const& identifier() const {
-		return m_identifier_token->m_text;
+		return m_identifier;
 	}
 };
 
@@ -67,8 +76,8 @@ struct IntegerLiteral : public Expr {
 	Token const* m_sign {nullptr};
 	Token const* m_token;
 
-	std::string const& text() {
-		return m_token->m_text.str();
+	string_view text() {
+		return m_token->m_text;
 	}
 
 	IntegerLiteral(bool negative, Token const* sign, Token const* token)
@@ -83,8 +92,8 @@ struct NumberLiteral : public Expr {
 	Token const* m_sign {nullptr};
 	Token const* m_token;
 
-	std::string const& text() {
-		return m_token->m_text.str();
+	string_view text() {
+		return m_token->m_text;
 	}
 
 	NumberLiteral(bool negative, Token const* sign, Token const* token)
@@ -97,8 +106,8 @@ struct NumberLiteral : public Expr {
 struct StringLiteral : public Expr {
 	Token const* m_token;
 
-	std::string const& text() {
-		return m_token->m_text.str();
+	string_view text() {
+		return m_token->m_text;
 	}
 
 	StringLiteral(Token const* token)
@@ -109,8 +118,8 @@ struct StringLiteral : public Expr {
 struct BooleanLiteral : public Expr {
 	Token const* m_token;
 
-	std::string const& text() {
-		return m_token->m_text.str();
+	string_view text() {
+		return m_token->m_text;
 	}
 
 	BooleanLiteral(Token const* token)
@@ -154,14 +163,17 @@ struct FunctionLiteral : public Expr {
 
 struct Identifier : public Expr {
 	Token const* m_token;
+	// interned once, since the later passes look it up over and over
+	InternedString m_text;
 
-	InternedString const& text() {
-		return m_token->m_text;
+	InternedString const& text() const {
+		return m_text;
 	}
 
 	Identifier(Token const* token)
 	    : Expr {CSTTag::Identifier}
-	    , m_token {token} {}
+	    , m_token {token}
+	    , m_text {token->m_text} {}
 };
 
 struct BinaryExpression : public Expr {
@@ -259,6 +271,10 @@ struct SequenceExpression : public Expr {
 // Statement language
 
 struct Declaration : public Stmt {
+	// Source text of a top level declaration, which tells whether it changed
+	// since the last run. Empty for local declarations.
+	string_view m_source;
+
 	// This function is very cold -- it's ok to use virtuals
 	virtual InternedString const& identifier_virtual() const = 0;
 
@@ -284,11 +300,12 @@ struct PlainDeclaration : public Declaration {
 
 struct FuncDeclaration : public Declaration {
 	Token const* m_identifier;
+	InternedString m_identifier_text;
 	FuncParameters m_args;
 	Expr* m_body;
 
 	InternedString const& identifier() const {
-		return m_identifier->m_text;
+		return m_identifier_text;
 	}
 
 	InternedString const& identifier_virtual() const override {
@@ -298,17 +315,19 @@ struct FuncDeclaration : public Declaration {
 	FuncDeclaration(Token const* identifier, FuncParameters args, Expr* body)
 	    : Declaration {CSTTag::FuncDeclaration}
 	    , m_identifier {identifier}
+	    , m_identifier_text {identifier->m_text}
 	    , m_args {std::move(args)}
 	    , m_body {body} {}
 };
 
 struct BlockFuncDeclaration : public Declaration {
 	Token const* m_identifier;
+	InternedString m_identifier_text;
 	FuncParameters m_args;
 	Block* m_body;
 
 	InternedString const& identifier() const {
-		return m_identifier->m_text;
+		return m_identifier_text;
 	}
 
 	InternedString const& identifier_virtual() const override {
@@ -318,6 +337,7 @@ struct BlockFuncDeclaration : public Declaration {
 	BlockFuncDeclaration(Token const* identifier, FuncParameters args, Block* body)
 	    : Declaration {CSTTag::BlockFuncDeclaration}
 	    , m_identifier {identifier}
+	    , m_identifier_text {identifier->m_text}
 	    , m_args {std::move(args)}
 	    , m_body {body} {}
 };
@@ -399,8 +419,8 @@ struct TypeTerm : public Expr {
 struct TypeVar : public Expr {
 	Token const* m_token;
 
-	std::string const& text() {
-		return m_token->m_text.str();
+	string_view text() {
+		return m_token->m_text;
 	}
 
 	TypeVar(Token const* token)
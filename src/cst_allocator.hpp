@@ -1,9 +1,11 @@
 #pragma once
 
+#include "./utils/bump_allocator.hpp"
 #include "./utils/polymorphic_block_allocator.hpp"
 #include "./utils/polymorphic_dumb_allocator.hpp"
 #include "cst.hpp"
 
+#include <new>
 #include <utility>
 
 namespace CST {
@@ -13,10 +15,12 @@ struct Allocator {
 
 	PolymorphicBlockAllocator<CST> m_small;
 	PolymorphicDumbAllocator<CST> m_big;
+	BumpAllocator m_tokens;
 
 	Allocator()
 	    : m_small(small_size, 4 * 4096)
-	    , m_big {4 * 4096} {}
+	    , m_big {4 * 4096}
+	    , m_tokens {4096} {}
 
 	template<typename T, typename ...Args>
 	T* make(Args&& ...args) {
@@ -27,6 +31,12 @@ struct Allocator {
 		}
 	}
 
+	// The parser only sees tokens through a small lookahead window, so any
+	// token a node refers to has to be copied out of it first.
+	Token const* keep(Token const& token) {
+		void* storage = m_tokens.allocate(sizeof(Token), alignof(Token));
+		return new (storage) Token(token);
+	}
 };
 
 } // namespace CST
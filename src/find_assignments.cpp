@@ -0,0 +1,116 @@
+#include "find_assignments.hpp"
+
+#include "ast.hpp"
+
+namespace TypeChecker {
+
+using AST::ExprTag;
+using AST::StmtTag;
+
+using Assigned = std::unordered_set<AST::Declaration*>;
+
+static void find_assignments(AST::Stmt* ast, Assigned& assigned);
+
+static void find_assignments(AST::Expr* ast, Assigned& assigned) {
+	switch (ast->type()) {
+	case ExprTag::ArrayLiteral:
+		for (auto element : static_cast<AST::ArrayLiteral*>(ast)->m_elements)
+			find_assignments(element, assigned);
+		return;
+	case ExprTag::FunctionLiteral:
+		find_assignments(static_cast<AST::FunctionLiteral*>(ast)->m_body, assigned);
+		return;
+	case ExprTag::CallExpression: {
+		auto call = static_cast<AST::CallExpression*>(ast);
+		find_assignments(call->m_callee, assigned);
+		for (auto arg : call->m_args)
+			find_assignments(arg, assigned);
+		return;
+	}
+	case ExprTag::AssignmentExpression: {
+		auto assignment = static_cast<AST::AssignmentExpression*>(ast);
+		if (assignment->m_target->type() == ExprTag::Identifier) {
+			auto target = static_cast<AST::Identifier*>(assignment->m_target);
+			if (target->m_declaration)
+				assigned.insert(target->m_declaration);
+		}
+		find_assignments(assignment->m_target, assigned);
+		find_assignments(assignment->m_value, assigned);
+		return;
+	}
+	case ExprTag::IndexExpression: {
+		auto index = static_cast<AST::IndexExpression*>(ast);
+		find_assignments(index->m_callee, assigned);
+		find_assignments(index->m_index, assigned);
+		return;
+	}
+	case ExprTag::AccessExpression:
+		find_assignments(static_cast<AST::AccessExpression*>(ast)->m_target, assigned);
+		return;
+	case ExprTag::MatchExpression:
+		for (auto& kv : static_cast<AST::MatchExpression*>(ast)->m_cases)
+			find_assignments(kv.second.m_expression, assigned);
+		return;
+	case ExprTag::TernaryExpression: {
+		auto ternary = static_cast<AST::TernaryExpression*>(ast);
+		find_assignments(ternary->m_condition, assigned);
+		find_assignments(ternary->m_then_expr, assigned);
+		find_assignments(ternary->m_else_expr, assigned);
+		return;
+	}
+	case ExprTag::ConstructorExpression:
+		for (auto arg : static_cast<AST::ConstructorExpression*>(ast)->m_args)
+			find_assignments(arg, assigned);
+		return;
+	case ExprTag::SequenceExpression:
+		find_assignments(static_cast<AST::SequenceExpression*>(ast)->m_body, assigned);
+		return;
+	default:
+		return;
+	}
+}
+
+static void find_assignments(AST::Stmt* ast, Assigned& assigned) {
+	switch (ast->tag()) {
+	case StmtTag::Block:
+		for (auto stmt : static_cast<AST::Block*>(ast)->m_body)
+			find_assignments(stmt, assigned);
+		return;
+	case StmtTag::ReturnStatement:
+		find_assignments(static_cast<AST::ReturnStatement*>(ast)->m_value, assigned);
+		return;
+	case StmtTag::IfElseStatement: {
+		auto if_else = static_cast<AST::IfElseStatement*>(ast);
+		find_assignments(if_else->m_condition, assigned);
+		find_assignments(if_else->m_body, assigned);
+		if (if_else->m_else_body)
+			find_assignments(if_else->m_else_body, assigned);
+		return;
+	}
+	case StmtTag::WhileStatement: {
+		auto while_stmt = static_cast<AST::WhileStatement*>(ast);
+		find_assignments(while_stmt->m_condition, assigned);
+		find_assignments(while_stmt->m_body, assigned);
+		return;
+	}
+	case StmtTag::ExpressionStatement:
+		find_assignments(static_cast<AST::ExpressionStatement*>(ast)->m_expression, assigned);
+		return;
+	case StmtTag::Declaration: {
+		auto decl = static_cast<AST::Declaration*>(ast);
+		if (decl->m_value)
+			find_assignments(decl->m_value, assigned);
+		return;
+	}
+	}
+}
+
+Assigned find_assigned_declarations(AST::Program* ast) {
+	Assigned assigned;
+	for (auto& decl : ast->m_declarations)
+		if (decl.m_value)
+			find_assignments(decl.m_value, assigned);
+	return assigned;
+}
+
+} // namespace TypeChecker
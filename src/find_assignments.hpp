@@ -0,0 +1,18 @@
+#pragma once
+
+#include <unordered_set>
+
+namespace AST {
+
+struct Declaration;
+struct Program;
+
+}
+
+namespace TypeChecker {
+
+// Every declaration that is the target of an assignment somewhere in the
+// program, be it global or local.
+std::unordered_set<AST::Declaration*> find_assigned_declarations(AST::Program* ast);
+
+}
@@ -0,0 +1,377 @@
+#include "fold_constants.hpp"
+
+#include "./log/log.hpp"
+#include "./typechecker/typechecker.hpp"
+#include "ast.hpp"
+#include "ast_allocator.hpp"
+#include "find_assignments.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <climits>
+
+namespace TypeChecker {
+
+using AST::ExprTag;
+using AST::StmtTag;
+
+static bool is_literal(AST::Expr* ast) {
+	switch (ast->type()) {
+	case ExprTag::NumberLiteral:
+	case ExprTag::IntegerLiteral:
+	case ExprTag::StringLiteral:
+	case ExprTag::BooleanLiteral:
+		return true;
+	default:
+		return false;
+	}
+}
+
+namespace {
+
+struct ConstantFolder {
+	AST::Allocator& m_allocator;
+
+	// global declarations that some expression assigns to
+	std::unordered_set<AST::Declaration*> m_assigned;
+
+	// literal values of the global declarations nothing assigns to
+	std::unordered_map<AST::Declaration*, AST::Expr*> m_constants;
+
+	ConstantFolder(AST::Allocator& allocator, AST::Program* ast)
+	    : m_allocator {allocator}
+	    , m_assigned {find_assigned_declarations(ast)} {}
+
+	AST::Expr* fold(AST::Expr* ast);
+	AST::Stmt* fold(AST::Stmt* ast);
+	AST::Expr* fold_call(AST::CallExpression* ast);
+
+	// These mirror what the native operators do at run time, and return
+	// nullptr when they can't be done ahead of time.
+	AST::Expr* fold_integers(string_view op, int lhs, int rhs);
+	AST::Expr* fold_numbers(string_view op, float lhs, float rhs);
+	AST::Expr* fold_strings(string_view op, std::string const& lhs, std::string const& rhs);
+	AST::Expr* fold_booleans(string_view op, bool lhs, bool rhs);
+
+	AST::Expr* make_integer(int value) {
+		auto result = m_allocator.make<AST::IntegerLiteral>();
+		result->m_value = value;
+		return result;
+	}
+
+	AST::Expr* make_number(float value) {
+		auto result = m_allocator.make<AST::NumberLiteral>();
+		result->m_value = value;
+		return result;
+	}
+
+	AST::Expr* make_string(std::string const& value) {
+		auto result = m_allocator.make<AST::StringLiteral>();
+		result->m_text = InternedString(value);
+		return result;
+	}
+
+	AST::Expr* make_boolean(bool value) {
+		auto result = m_allocator.make<AST::BooleanLiteral>();
+		result->m_value = value;
+		return result;
+	}
+
+	AST::Expr* copy_literal(AST::Expr* ast) {
+		switch (ast->type()) {
+		case ExprTag::NumberLiteral:
+			return make_number(static_cast<AST::NumberLiteral*>(ast)->m_value);
+		case ExprTag::IntegerLiteral:
+			return make_integer(static_cast<AST::IntegerLiteral*>(ast)->m_value);
+		case ExprTag::StringLiteral: {
+			auto result = m_allocator.make<AST::StringLiteral>();
+			result->m_text = static_cast<AST::StringLiteral*>(ast)->m_text;
+			return result;
+		}
+		case ExprTag::BooleanLiteral:
+			return make_boolean(static_cast<AST::BooleanLiteral*>(ast)->m_value);
+		default:
+			Log::fatal() << "(internal) copy_literal called on a non literal";
+		}
+	}
+};
+
+AST::Expr* ConstantFolder::fold(AST::Expr* ast) {
+	switch (ast->type()) {
+	case ExprTag::ArrayLiteral:
+		for (auto& element : static_cast<AST::ArrayLiteral*>(ast)->m_elements)
+			element = fold(element);
+		return ast;
+	case ExprTag::FunctionLiteral: {
+		auto function = static_cast<AST::FunctionLiteral*>(ast);
+		function->m_body = fold(function->m_body);
+		return ast;
+	}
+	case ExprTag::Identifier: {
+		auto identifier = static_cast<AST::Identifier*>(ast);
+		if (identifier->m_origin != AST::Identifier::Origin::Global)
+			return ast;
+		auto it = m_constants.find(identifier->m_declaration);
+		if (it == m_constants.end())
+			return ast;
+
+		auto result = copy_literal(it->second);
+		result->m_meta_type = ast->m_meta_type;
+		result->m_value_type = ast->m_value_type;
+		return result;
+	}
+	case ExprTag::CallExpression:
+		return fold_call(static_cast<AST::CallExpression*>(ast));
+	case ExprTag::AssignmentExpression: {
+		// the target names a place, not a value, so it stays as it is
+		auto assignment = static_cast<AST::AssignmentExpression*>(ast);
+		if (assignment->m_target->type() == ExprTag::IndexExpression) {
+			auto target = static_cast<AST::IndexExpression*>(assignment->m_target);
+			target->m_callee = fold(target->m_callee);
+			target->m_index = fold(target->m_index);
+		}
+		assignment->m_value = fold(assignment->m_value);
+		return ast;
+	}
+	case ExprTag::IndexExpression: {
+		auto index = static_cast<AST::IndexExpression*>(ast);
+		index->m_callee = fold(index->m_callee);
+		index->m_index = fold(index->m_index);
+		return ast;
+	}
+	case ExprTag::AccessExpression: {
+		auto access = static_cast<AST::AccessExpression*>(ast);
+		access->m_target = fold(access->m_target);
+		return ast;
+	}
+	case ExprTag::MatchExpression:
+		for (auto& kv : static_cast<AST::MatchExpression*>(ast)->m_cases)
+			kv.second.m_expression = fold(kv.second.m_expression);
+		return ast;
+	case ExprTag::TernaryExpression: {
+		auto ternary = static_cast<AST::TernaryExpression*>(ast);
+		ternary->m_condition = fold(ternary->m_condition);
+		ternary->m_then_expr = fold(ternary->m_then_expr);
+		ternary->m_else_expr = fold(ternary->m_else_expr);
+		if (ternary->m_condition->type() == ExprTag::BooleanLiteral)
+			return static_cast<AST::BooleanLiteral*>(ternary->m_condition)->m_value
+			    ? ternary->m_then_expr
+			    : ternary->m_else_expr;
+		return ast;
+	}
+	case ExprTag::ConstructorExpression:
+		for (auto& arg : static_cast<AST::ConstructorExpression*>(ast)->m_args)
+			arg = fold(arg);
+		return ast;
+	case ExprTag::SequenceExpression: {
+		auto seq = static_cast<AST::SequenceExpression*>(ast);
+		fold(seq->m_body);
+		return ast;
+	}
+	default:
+		return ast;
+	}
+}
+
+AST::Stmt* ConstantFolder::fold(AST::Stmt* ast) {
+	switch (ast->tag()) {
+	case StmtTag::Block:
+		for (auto& stmt : static_cast<AST::Block*>(ast)->m_body)
+			stmt = fold(stmt);
+		return ast;
+	case StmtTag::ReturnStatement: {
+		auto return_stmt = static_cast<AST::ReturnStatement*>(ast);
+		return_stmt->m_value = fold(return_stmt->m_value);
+		return ast;
+	}
+	case StmtTag::IfElseStatement: {
+		auto if_else = static_cast<AST::IfElseStatement*>(ast);
+		if_else->m_condition = fold(if_else->m_condition);
+		if_else->m_body = fold(if_else->m_body);
+		if (if_else->m_else_body)
+			if_else->m_else_body = fold(if_else->m_else_body);
+
+		if (if_else->m_condition->type() != ExprTag::BooleanLiteral)
+			return ast;
+
+		AST::Stmt* taken = static_cast<AST::BooleanLiteral*>(if_else->m_condition)->m_value
+		    ? if_else->m_body
+		    : if_else->m_else_body;
+		if (!taken)
+			return m_allocator.make<AST::Block>();
+		// a lone declaration would end up in the enclosing block, and
+		// change its layout
+		if (taken->tag() == StmtTag::Declaration)
+			return ast;
+		return taken;
+	}
+	case StmtTag::WhileStatement: {
+		auto while_stmt = static_cast<AST::WhileStatement*>(ast);
+		while_stmt->m_condition = fold(while_stmt->m_condition);
+		while_stmt->m_body = fold(while_stmt->m_body);
+
+		auto condition = while_stmt->m_condition;
+		if (condition->type() == ExprTag::BooleanLiteral &&
+		    !static_cast<AST::BooleanLiteral*>(condition)->m_value)
+			return m_allocator.make<AST::Block>();
+		return ast;
+	}
+	case StmtTag::ExpressionStatement: {
+		auto expr_stmt = static_cast<AST::ExpressionStatement*>(ast);
+		expr_stmt->m_expression = fold(expr_stmt->m_expression);
+		return ast;
+	}
+	case StmtTag::Declaration: {
+		auto decl = static_cast<AST::Declaration*>(ast);
+		if (decl->m_value)
+			decl->m_value = fold(decl->m_value);
+		return ast;
+	}
+	}
+	return ast;
+}
+
+AST::Expr* ConstantFolder::fold_call(AST::CallExpression* ast) {
+	ast->m_callee = fold(ast->m_callee);
+	for (auto& arg : ast->m_args)
+		arg = fold(arg);
+
+	// operators are the only builtins that are both pure and take two
+	// arguments, and they can't be shadowed
+	if (ast->m_callee->type() != ExprTag::Identifier || ast->m_args.size() != 2)
+		return ast;
+
+	auto callee = static_cast<AST::Identifier*>(ast->m_callee);
+	if (callee->m_origin != AST::Identifier::Origin::Global)
+		return ast;
+
+	AST::Expr* lhs = ast->m_args[0];
+	AST::Expr* rhs = ast->m_args[1];
+	if (lhs->type() != rhs->type())
+		return ast;
+
+	string_view op = callee->text().str();
+	AST::Expr* result = nullptr;
+
+	switch (lhs->type()) {
+	case ExprTag::IntegerLiteral:
+		result = fold_integers(
+		    op,
+		    static_cast<AST::IntegerLiteral*>(lhs)->m_value,
+		    static_cast<AST::IntegerLiteral*>(rhs)->m_value);
+		break;
+	case ExprTag::NumberLiteral:
+		result = fold_numbers(
+		    op,
+		    static_cast<AST::NumberLiteral*>(lhs)->m_value,
+		    static_cast<AST::NumberLiteral*>(rhs)->m_value);
+		break;
+	case ExprTag::StringLiteral:
+		result = fold_strings(
+		    op,
+		    static_cast<AST::StringLiteral*>(lhs)->text().to_string(),
+		    static_cast<AST::StringLiteral*>(rhs)->text().to_string());
+		break;
+	case ExprTag::BooleanLiteral:
+		result = fold_booleans(
+		    op,
+		    static_cast<AST::BooleanLiteral*>(lhs)->m_value,
+		    static_cast<AST::BooleanLiteral*>(rhs)->m_value);
+		break;
+	default:
+		break;
+	}
+
+	if (!result)
+		return ast;
+
+	result->m_meta_type = ast->m_meta_type;
+	result->m_value_type = ast->m_value_type;
+	return result;
+}
+
+AST::Expr* ConstantFolder::fold_integers(string_view op, int lhs, int rhs) {
+	// overflow wraps around, like the interpreter's arithmetic does on the
+	// machines we run on
+	auto a = static_cast<unsigned>(lhs);
+	auto b = static_cast<unsigned>(rhs);
+
+	if (op == "+") return make_integer(static_cast<int>(a + b));
+	if (op == "-") return make_integer(static_cast<int>(a - b));
+	if (op == "*") return make_integer(static_cast<int>(a * b));
+	if (op == "/") {
+		// these trap, and they should do it at run time
+		if (rhs == 0 || (lhs == INT_MIN && rhs == -1))
+			return nullptr;
+		return make_integer(lhs / rhs);
+	}
+	if (op == "<") return make_boolean(lhs < rhs);
+	if (op == ">") return make_boolean(rhs < lhs);
+	if (op == "<=") return make_boolean(!(rhs < lhs));
+	if (op == ">=") return make_boolean(!(lhs < rhs));
+	if (op == "==") return make_boolean(lhs == rhs);
+	if (op == "!=") return make_boolean(lhs != rhs);
+	return nullptr;
+}
+
+AST::Expr* ConstantFolder::fold_numbers(string_view op, float lhs, float rhs) {
+	if (op == "+") return make_number(lhs + rhs);
+	if (op == "-") return make_number(lhs - rhs);
+	if (op == "*") return make_number(lhs * rhs);
+	if (op == "/") return make_number(lhs / rhs);
+	// written in terms of < like the natives, which matters for NaN
+	if (op == "<") return make_boolean(lhs < rhs);
+	if (op == ">") return make_boolean(rhs < lhs);
+	if (op == "<=") return make_boolean(!(rhs < lhs));
+	if (op == ">=") return make_boolean(!(lhs < rhs));
+	if (op == "==") return make_boolean(lhs == rhs);
+	if (op == "!=") return make_boolean(!(lhs == rhs));
+	return nullptr;
+}
+
+AST::Expr* ConstantFolder::fold_strings(
+    string_view op, std::string const& lhs, std::string const& rhs) {
+	if (op == "+") return make_string(lhs + rhs);
+	if (op == "<") return make_boolean(lhs < rhs);
+	if (op == ">") return make_boolean(rhs < lhs);
+	if (op == "<=") return make_boolean(!(rhs < lhs));
+	if (op == ">=") return make_boolean(!(lhs < rhs));
+	if (op == "==") return make_boolean(lhs == rhs);
+	if (op == "!=") return make_boolean(lhs != rhs);
+	return nullptr;
+}
+
+AST::Expr* ConstantFolder::fold_booleans(string_view op, bool lhs, bool rhs) {
+	// the natives take both operands evaluated, so there is no short
+	// circuit to preserve
+	if (op == "&&") return make_boolean(lhs && rhs);
+	if (op == "||") return make_boolean(lhs || rhs);
+	if (op == "^^") return make_boolean(lhs != rhs);
+	if (op == "==") return make_boolean(lhs == rhs);
+	if (op == "!=") return make_boolean(lhs != rhs);
+	return nullptr;
+}
+
+} // namespace
+
+void fold_constants_program(AST::Program* ast, TypeChecker& tc) {
+	ConstantFolder folder {*tc.m_ast_allocator, ast};
+
+	// declarations come after the ones they use, so constants made out of
+	// other constants fold all the way
+	for (auto const& component : tc.declaration_order()) {
+		for (auto decl : component) {
+			if (!decl->m_value)
+				continue;
+
+			decl->m_value = folder.fold(decl->m_value);
+
+			if (is_literal(decl->m_value) && !folder.m_assigned.count(decl))
+				folder.m_constants[decl] = decl->m_value;
+		}
+	}
+}
+
+} // namespace TypeChecker
@@ -0,0 +1,26 @@
+#pragma once
+
+namespace AST {
+
+struct Program;
+
+}
+
+namespace TypeChecker {
+
+struct TypeChecker;
+
+/*
+ * Evaluates ahead of time what doesn't depend on the program running:
+ *  - builtin operators applied to literals, like `1 + 2 * 3`
+ *  - uses of global declarations whose value is a literal, and that nothing
+ *    assigns to
+ *  - ternaries, ifs and whiles whose condition ends up being a literal, which
+ *    are replaced by the branch that would run
+ *
+ * PRECONDITION: typecheck_program has already been called on the program,
+ * and compute_offsets_program has not.
+ */
+void fold_constants_program(AST::Program* ast, TypeChecker& tc);
+
+}
@@ -1,12 +1,15 @@
 #pragma once
 
-#include <string>
 #include "./utils/source_location.hpp"
+#include "./utils/string_view.hpp"
 
 namespace Frontend {
 
+// The source text does not belong to the context: whoever loaded it has to
+// keep it alive for as long as the tokens, the CST and the AST are in use.
+// It must be followed by a NUL byte, which the lexer uses as its sentinel.
 struct Context {
-	std::string source;
+	string_view source;
 
 	SourceLocation char_offset_to_location(int offset) const;
 };
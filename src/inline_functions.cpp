@@ -0,0 +1,449 @@
+#include "inline_functions.hpp"
+
+#include "./log/log.hpp"
+#include "./typechecker/typechecker.hpp"
+#include "ast.hpp"
+#include "ast_allocator.hpp"
+#include "find_assignments.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace TypeChecker {
+
+using AST::ExprTag;
+using AST::StmtTag;
+
+// Whether an expression only refers to globals, so that copies of the
+// expression that contains it can share it
+static bool is_closed(AST::Expr* ast) {
+	switch (ast->type()) {
+	case ExprTag::Identifier:
+		return static_cast<AST::Identifier*>(ast)->m_origin ==
+		       AST::Identifier::Origin::Global;
+	case ExprTag::AccessExpression:
+		return is_closed(static_cast<AST::AccessExpression*>(ast)->m_target);
+	case ExprTag::TypeTerm: {
+		auto term = static_cast<AST::TypeTerm*>(ast);
+		if (!is_closed(term->m_callee))
+			return false;
+		for (auto arg : term->m_args)
+			if (!is_closed(arg))
+				return false;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+namespace {
+
+struct Inliner {
+	AST::Allocator& m_allocator;
+	std::unordered_set<AST::Declaration*> m_assigned;
+	int m_max_size;
+
+	// functions whose calls get replaced by their bodies
+	std::unordered_map<AST::Declaration*, AST::FunctionLiteral*> m_inlinable;
+
+	Inliner(AST::Allocator& allocator, AST::Program* ast, int max_size)
+	    : m_allocator {allocator}
+	    , m_assigned {find_assigned_declarations(ast)}
+	    , m_max_size {max_size} {}
+
+	bool is_inlinable(AST::Declaration* decl);
+	// How many nodes a copy of the body of `function` would take, or -1 if
+	// there is something in it we don't know how to copy
+	int size_of_copy(AST::Expr* ast, AST::FunctionLiteral* function);
+	bool can_duplicate(AST::Expr* ast);
+
+	AST::Expr* copy(
+	    AST::Expr* ast,
+	    AST::FunctionLiteral* function,
+	    std::vector<AST::Expr*> const& args);
+	AST::Expr* copy_argument(AST::Expr* ast);
+
+	AST::Expr* inline_calls(AST::Expr* ast);
+	AST::Stmt* inline_calls(AST::Stmt* ast);
+
+	template <typename T>
+	T* make_like(T* ast) {
+		auto result = m_allocator.make<T>();
+		result->m_cst = ast->m_cst;
+		result->m_meta_type = ast->m_meta_type;
+		result->m_value_type = ast->m_value_type;
+		return result;
+	}
+};
+
+static int parameter_index(AST::Identifier* ast, AST::FunctionLiteral* function) {
+	for (int i = 0; i < int(function->m_args.size()); ++i)
+		if (ast->m_declaration == &function->m_args[i])
+			return i;
+	return -1;
+}
+
+bool Inliner::is_inlinable(AST::Declaration* decl) {
+	if (!decl->m_value || decl->m_value->type() != ExprTag::FunctionLiteral)
+		return false;
+
+	if (m_assigned.count(decl))
+		return false;
+
+	auto function = static_cast<AST::FunctionLiteral*>(decl->m_value);
+	if (!function->m_captures.empty())
+		return false;
+
+	for (auto& arg : function->m_args)
+		if (m_assigned.count(&arg))
+			return false;
+
+	int size = size_of_copy(function->m_body, function);
+	return size != -1 && size <= m_max_size;
+}
+
+int Inliner::size_of_copy(AST::Expr* ast, AST::FunctionLiteral* function) {
+	auto add_sizes = [&](std::initializer_list<AST::Expr*> children) {
+		int result = 1;
+		for (auto child : children) {
+			int size = size_of_copy(child, function);
+			if (size == -1)
+				return -1;
+			result += size;
+		}
+		return result;
+	};
+
+	auto add_list = [&](int result, std::vector<AST::Expr*> const& children) {
+		for (auto child : children) {
+			if (result == -1)
+				break;
+			int size = size_of_copy(child, function);
+			result = size == -1 ? -1 : result + size;
+		}
+		return result;
+	};
+
+	switch (ast->type()) {
+	case ExprTag::NumberLiteral:
+	case ExprTag::IntegerLiteral:
+	case ExprTag::StringLiteral:
+	case ExprTag::BooleanLiteral:
+	case ExprTag::NullLiteral:
+		return 1;
+	case ExprTag::Identifier: {
+		auto identifier = static_cast<AST::Identifier*>(ast);
+		if (identifier->m_origin == AST::Identifier::Origin::Global ||
+		    parameter_index(identifier, function) != -1)
+			return 1;
+		return -1;
+	}
+	case ExprTag::ArrayLiteral:
+		return add_list(1, static_cast<AST::ArrayLiteral*>(ast)->m_elements);
+	case ExprTag::CallExpression: {
+		auto call = static_cast<AST::CallExpression*>(ast);
+		return add_list(add_sizes({call->m_callee}), call->m_args);
+	}
+	case ExprTag::AssignmentExpression: {
+		auto assignment = static_cast<AST::AssignmentExpression*>(ast);
+		return add_sizes({assignment->m_target, assignment->m_value});
+	}
+	case ExprTag::IndexExpression: {
+		auto index = static_cast<AST::IndexExpression*>(ast);
+		return add_sizes({index->m_callee, index->m_index});
+	}
+	case ExprTag::AccessExpression:
+		return add_sizes({static_cast<AST::AccessExpression*>(ast)->m_target});
+	case ExprTag::TernaryExpression: {
+		auto ternary = static_cast<AST::TernaryExpression*>(ast);
+		return add_sizes(
+		    {ternary->m_condition, ternary->m_then_expr, ternary->m_else_expr});
+	}
+	case ExprTag::ConstructorExpression: {
+		auto constructor = static_cast<AST::ConstructorExpression*>(ast);
+		if (!is_closed(constructor->m_constructor))
+			return -1;
+		return add_list(2, constructor->m_args);
+	}
+	default:
+		return -1;
+	}
+}
+
+bool Inliner::can_duplicate(AST::Expr* ast) {
+	switch (ast->type()) {
+	case ExprTag::NumberLiteral:
+	case ExprTag::IntegerLiteral:
+	case ExprTag::StringLiteral:
+	case ExprTag::BooleanLiteral:
+	case ExprTag::NullLiteral:
+		return true;
+	case ExprTag::Identifier: {
+		auto decl = static_cast<AST::Identifier*>(ast)->m_declaration;
+		return decl && !m_assigned.count(decl);
+	}
+	default:
+		return false;
+	}
+}
+
+AST::Expr* Inliner::copy_argument(AST::Expr* ast) {
+	switch (ast->type()) {
+	case ExprTag::NumberLiteral: {
+		auto result = make_like(static_cast<AST::NumberLiteral*>(ast));
+		result->m_value = static_cast<AST::NumberLiteral*>(ast)->m_value;
+		return result;
+	}
+	case ExprTag::IntegerLiteral: {
+		auto result = make_like(static_cast<AST::IntegerLiteral*>(ast));
+		result->m_value = static_cast<AST::IntegerLiteral*>(ast)->m_value;
+		return result;
+	}
+	case ExprTag::StringLiteral: {
+		auto result = make_like(static_cast<AST::StringLiteral*>(ast));
+		result->m_text = static_cast<AST::StringLiteral*>(ast)->m_text;
+		return result;
+	}
+	case ExprTag::BooleanLiteral: {
+		auto result = make_like(static_cast<AST::BooleanLiteral*>(ast));
+		result->m_value = static_cast<AST::BooleanLiteral*>(ast)->m_value;
+		return result;
+	}
+	case ExprTag::NullLiteral:
+		return make_like(static_cast<AST::NullLiteral*>(ast));
+	case ExprTag::Identifier: {
+		auto identifier = static_cast<AST::Identifier*>(ast);
+		auto result = make_like(identifier);
+		result->m_text = identifier->m_text;
+		result->m_declaration = identifier->m_declaration;
+		result->m_surrounding_function = identifier->m_surrounding_function;
+		result->m_origin = identifier->m_origin;
+		return result;
+	}
+	default:
+		Log::fatal() << "(internal) copy_argument called on an argument that can't be duplicated";
+	}
+}
+
+AST::Expr* Inliner::copy(
+    AST::Expr* ast,
+    AST::FunctionLiteral* function,
+    std::vector<AST::Expr*> const& args) {
+
+	auto copy_list = [&](std::vector<AST::Expr*> const& children) {
+		std::vector<AST::Expr*> result;
+		result.reserve(children.size());
+		for (auto child : children)
+			result.push_back(copy(child, function, args));
+		return result;
+	};
+
+	switch (ast->type()) {
+	case ExprTag::Identifier: {
+		int index = parameter_index(static_cast<AST::Identifier*>(ast), function);
+		return copy_argument(index == -1 ? ast : args[index]);
+	}
+	case ExprTag::ArrayLiteral: {
+		auto array = static_cast<AST::ArrayLiteral*>(ast);
+		auto result = make_like(array);
+		result->m_elements = copy_list(array->m_elements);
+		return result;
+	}
+	case ExprTag::CallExpression: {
+		auto call = static_cast<AST::CallExpression*>(ast);
+		auto result = make_like(call);
+		result->m_callee = copy(call->m_callee, function, args);
+		result->m_args = copy_list(call->m_args);
+		return result;
+	}
+	case ExprTag::AssignmentExpression: {
+		auto assignment = static_cast<AST::AssignmentExpression*>(ast);
+		auto result = make_like(assignment);
+		result->m_target = copy(assignment->m_target, function, args);
+		result->m_value = copy(assignment->m_value, function, args);
+		return result;
+	}
+	case ExprTag::IndexExpression: {
+		auto index = static_cast<AST::IndexExpression*>(ast);
+		auto result = make_like(index);
+		result->m_callee = copy(index->m_callee, function, args);
+		result->m_index = copy(index->m_index, function, args);
+		return result;
+	}
+	case ExprTag::AccessExpression: {
+		auto access = static_cast<AST::AccessExpression*>(ast);
+		auto result = make_like(access);
+		result->m_target = copy(access->m_target, function, args);
+		result->m_member = access->m_member;
+		return result;
+	}
+	case ExprTag::TernaryExpression: {
+		auto ternary = static_cast<AST::TernaryExpression*>(ast);
+		auto result = make_like(ternary);
+		result->m_condition = copy(ternary->m_condition, function, args);
+		result->m_then_expr = copy(ternary->m_then_expr, function, args);
+		result->m_else_expr = copy(ternary->m_else_expr, function, args);
+		return result;
+	}
+	case ExprTag::ConstructorExpression: {
+		// the constructor only refers to globals, so it's shared
+		auto constructor = static_cast<AST::ConstructorExpression*>(ast);
+		auto result = make_like(constructor);
+		result->m_constructor = constructor->m_constructor;
+		result->m_args = copy_list(constructor->m_args);
+		result->m_evaluated_constructor = constructor->m_evaluated_constructor;
+		return result;
+	}
+	default:
+		return copy_argument(ast);
+	}
+}
+
+AST::Expr* Inliner::inline_calls(AST::Expr* ast) {
+	switch (ast->type()) {
+	case ExprTag::ArrayLiteral:
+		for (auto& element : static_cast<AST::ArrayLiteral*>(ast)->m_elements)
+			element = inline_calls(element);
+		return ast;
+	case ExprTag::FunctionLiteral: {
+		auto function = static_cast<AST::FunctionLiteral*>(ast);
+		function->m_body = inline_calls(function->m_body);
+		return ast;
+	}
+	case ExprTag::CallExpression: {
+		auto call = static_cast<AST::CallExpression*>(ast);
+		call->m_callee = inline_calls(call->m_callee);
+		for (auto& arg : call->m_args)
+			arg = inline_calls(arg);
+
+		if (call->m_callee->type() != ExprTag::Identifier)
+			return ast;
+
+		auto callee = static_cast<AST::Identifier*>(call->m_callee);
+		if (callee->m_origin != AST::Identifier::Origin::Global)
+			return ast;
+
+		auto it = m_inlinable.find(callee->m_declaration);
+		if (it == m_inlinable.end())
+			return ast;
+
+		auto function = it->second;
+		if (function->m_args.size() != call->m_args.size())
+			return ast;
+
+		for (auto arg : call->m_args)
+			if (!can_duplicate(arg))
+				return ast;
+
+		auto result = copy(function->m_body, function, call->m_args);
+		result->m_meta_type = call->m_meta_type;
+		result->m_value_type = call->m_value_type;
+		return result;
+	}
+	case ExprTag::AssignmentExpression: {
+		auto assignment = static_cast<AST::AssignmentExpression*>(ast);
+		assignment->m_target = inline_calls(assignment->m_target);
+		assignment->m_value = inline_calls(assignment->m_value);
+		return ast;
+	}
+	case ExprTag::IndexExpression: {
+		auto index = static_cast<AST::IndexExpression*>(ast);
+		index->m_callee = inline_calls(index->m_callee);
+		index->m_index = inline_calls(index->m_index);
+		return ast;
+	}
+	case ExprTag::AccessExpression: {
+		auto access = static_cast<AST::AccessExpression*>(ast);
+		access->m_target = inline_calls(access->m_target);
+		return ast;
+	}
+	case ExprTag::MatchExpression:
+		for (auto& kv : static_cast<AST::MatchExpression*>(ast)->m_cases)
+			kv.second.m_expression = inline_calls(kv.second.m_expression);
+		return ast;
+	case ExprTag::TernaryExpression: {
+		auto ternary = static_cast<AST::TernaryExpression*>(ast);
+		ternary->m_condition = inline_calls(ternary->m_condition);
+		ternary->m_then_expr = inline_calls(ternary->m_then_expr);
+		ternary->m_else_expr = inline_calls(ternary->m_else_expr);
+		return ast;
+	}
+	case ExprTag::ConstructorExpression:
+		for (auto& arg : static_cast<AST::ConstructorExpression*>(ast)->m_args)
+			arg = inline_calls(arg);
+		return ast;
+	case ExprTag::SequenceExpression:
+		inline_calls(static_cast<AST::SequenceExpression*>(ast)->m_body);
+		return ast;
+	default:
+		return ast;
+	}
+}
+
+AST::Stmt* Inliner::inline_calls(AST::Stmt* ast) {
+	switch (ast->tag()) {
+	case StmtTag::Block:
+		for (auto& stmt : static_cast<AST::Block*>(ast)->m_body)
+			stmt = inline_calls(stmt);
+		return ast;
+	case StmtTag::ReturnStatement: {
+		auto return_stmt = static_cast<AST::ReturnStatement*>(ast);
+		return_stmt->m_value = inline_calls(return_stmt->m_value);
+		return ast;
+	}
+	case StmtTag::IfElseStatement: {
+		auto if_else = static_cast<AST::IfElseStatement*>(ast);
+		if_else->m_condition = inline_calls(if_else->m_condition);
+		if_else->m_body = inline_calls(if_else->m_body);
+		if (if_else->m_else_body)
+			if_else->m_else_body = inline_calls(if_else->m_else_body);
+		return ast;
+	}
+	case StmtTag::WhileStatement: {
+		auto while_stmt = static_cast<AST::WhileStatement*>(ast);
+		while_stmt->m_condition = inline_calls(while_stmt->m_condition);
+		while_stmt->m_body = inline_calls(while_stmt->m_body);
+		return ast;
+	}
+	case StmtTag::ExpressionStatement: {
+		auto expr_stmt = static_cast<AST::ExpressionStatement*>(ast);
+		expr_stmt->m_expression = inline_calls(expr_stmt->m_expression);
+		return ast;
+	}
+	case StmtTag::Declaration: {
+		auto decl = static_cast<AST::Declaration*>(ast);
+		if (decl->m_value)
+			decl->m_value = inline_calls(decl->m_value);
+		return ast;
+	}
+	}
+	return ast;
+}
+
+} // namespace
+
+void inline_functions_program(AST::Program* ast, TypeChecker& tc, int max_size) {
+	Inliner inliner {*tc.m_ast_allocator, ast, max_size};
+
+	for (auto const& component : tc.declaration_order()) {
+		for (auto decl : component)
+			if (decl->m_value)
+				decl->m_value = inliner.inline_calls(decl->m_value);
+
+		// a function that refers to itself, directly or through others in
+		// its component, would never stop being inlined
+		if (component.size() != 1)
+			continue;
+
+		auto decl = component[0];
+		if (decl->m_references.count(decl))
+			continue;
+
+		if (inliner.is_inlinable(decl))
+			inliner.m_inlinable[decl] = static_cast<AST::FunctionLiteral*>(decl->m_value);
+	}
+}
+
+} // namespace TypeChecker
@@ -0,0 +1,32 @@
+#pragma once
+
+namespace AST {
+
+struct Program;
+
+}
+
+namespace TypeChecker {
+
+struct TypeChecker;
+
+/*
+ * Replaces calls to small global functions with a copy of their bodies,
+ * when doing so can't be told apart from making the call:
+ *  - the function is a global that is never assigned to
+ *  - it doesn't capture anything, and it isn't recursive
+ *  - its body is a single expression of at most `max_size` nodes, without
+ *    functions, matches or blocks of its own
+ *  - every argument is a literal or a variable that is never assigned to,
+ *    so it doesn't matter how many times, or when, it's evaluated
+ *  - the body doesn't assign to its parameters
+ *
+ * Functions are processed in declaration order, so calls inside a function
+ * that gets inlined have already been inlined themselves.
+ *
+ * PRECONDITION: typecheck_program has already been called on the program,
+ * and compute_offsets_program has not.
+ */
+void inline_functions_program(AST::Program* ast, TypeChecker& tc, int max_size);
+
+}
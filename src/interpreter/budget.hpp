@@ -0,0 +1,27 @@
+#pragma once
+
+#include <exception>
+
+namespace Interpreter {
+
+/*
+ * Thrown when a program runs out of the fuel, or the heap, that it was
+ * given. It unwinds all the way to whoever started running the program,
+ * which reports ExitStatus::BudgetExceeded.
+ *
+ * The interpreter is left in the middle of whatever it was doing, so after
+ * this it can only be reset (see Isolate::reset) or thrown away.
+ */
+struct BudgetExceeded : std::exception {
+	enum class Kind { Fuel, Heap };
+	Kind m_kind;
+
+	explicit BudgetExceeded(Kind kind)
+	    : m_kind {kind} {}
+
+	char const* what() const noexcept override {
+		return m_kind == Kind::Fuel ? "ran out of fuel" : "ran out of heap";
+	}
+};
+
+} // namespace Interpreter
@@ -11,15 +11,15 @@ Writer<T> make_writer(T x) {
 
 namespace Bytecode {
 
-static ErrorReport visit(BasicBlock&, AST::Expr*);
+static ErrorReport visit(BasicBlock&, AST::Expr*, Interpreter::Interpreter&);
 
 static ErrorReport success() { return {}; }
 static ErrorReport failure() { return {"Failed to generate bytecode"}; }
 
-Writer<Executable> compile(AST::Expr* expr) {
+Writer<Executable> compile(AST::Expr* expr, Interpreter::Interpreter& e) {
 	Executable result;
 	BasicBlock main_block;
-	ErrorReport status = visit(main_block, expr);
+	ErrorReport status = visit(main_block, expr, e);
 	if (status.ok()) {
 	} else {
 		return status;
@@ -38,20 +38,22 @@ void emit_instruction(BasicBlock& b, InstructionType instruction) {
 		b.bytecode.push_back(buffer[i]);
 }
 
-static ErrorReport compile_identifier(BasicBlock& b, AST::Identifier* expr) {
+static ErrorReport compile_identifier(
+    BasicBlock& b, AST::Identifier* expr, Interpreter::Interpreter& e) {
 	if (expr->m_origin != AST::Identifier::Origin::Global)
 		return failure();
 
-	emit_instruction(b, GetGlobal {expr->m_text});
+	emit_instruction(b, GetGlobalSlot {Interpreter::global_slot(expr)});
 	return success();
 }
 
-static ErrorReport compile_call_expression(BasicBlock& b, AST::CallExpression* expr) {
-	auto status1 = visit(b, expr->m_callee);
+static ErrorReport compile_call_expression(
+    BasicBlock& b, AST::CallExpression* expr, Interpreter::Interpreter& e) {
+	auto status1 = visit(b, expr->m_callee, e);
 	if (!status1.ok()) return status1;
 
 	for (auto arg : expr->m_args) {
-		auto status2 = visit(b, arg);
+		auto status2 = visit(b, arg, e);
 		if (!status2.ok()) return status2;
 	}
 
@@ -64,14 +66,14 @@ static ErrorReport compile_integer_literal(BasicBlock& b, AST::IntegerLiteral* e
 	return success();
 }
 
-ErrorReport visit(BasicBlock& b, AST::Expr* expr) {
+ErrorReport visit(BasicBlock& b, AST::Expr* expr, Interpreter::Interpreter& e) {
 	switch (expr->type()) {
 	case AST::ExprTag::Identifier:
-		return compile_identifier(b, static_cast<AST::Identifier*>(expr));
+		return compile_identifier(b, static_cast<AST::Identifier*>(expr), e);
 	case AST::ExprTag::IntegerLiteral:
 		return compile_integer_literal(b, static_cast<AST::IntegerLiteral*>(expr));
 	case AST::ExprTag::CallExpression:
-		return compile_call_expression(b, static_cast<AST::CallExpression*>(expr));
+		return compile_call_expression(b, static_cast<AST::CallExpression*>(expr), e);
 	}
 	return failure();
 }
@@ -84,9 +86,9 @@ static int decode(char const* stream, Interpreter::Interpreter& e) {
 		e.push_integer(op->m_value);
 		return sizeof(*op);
 	}
-	case Instruction::Tag::GetGlobal: {
-		auto op = static_cast<GetGlobal const*>(punned);
-		e.m_stack.push(e.global_access(op->m_name)->m_value);
+	case Instruction::Tag::GetGlobalSlot: {
+		auto op = static_cast<GetGlobalSlot const*>(punned);
+		e.m_stack.push(e.global_access(op->m_slot)->m_value);
 		return sizeof(*op);
 	}
 	case Instruction::Tag::Call: {
@@ -95,12 +97,7 @@ static int decode(char const* stream, Interpreter::Interpreter& e) {
 
 		auto callee = e.m_stack.access(argument_count);
 
-		e.m_stack.start_frame(argument_count);
-
-		eval_call_callable(callee, argument_count, e);
-
-		e.m_stack.frame_at(-1) = e.m_stack.pop();
-		e.m_stack.end_frame();
+		eval_call(callee, argument_count, e);
 
 		return sizeof(*op);
 	}
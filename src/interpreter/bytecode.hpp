@@ -8,7 +8,7 @@
 namespace Bytecode {
 
 struct Instruction {
-	enum class Tag { GetGlobal, NewInteger, Call };
+	enum class Tag { GetGlobalSlot, NewInteger, Call };
 
 	Instruction(Tag tag)
 	    : m_tag {tag} {}
@@ -18,12 +18,12 @@ private:
 	Tag m_tag;
 };
 
-struct GetGlobal : Instruction {
-	GetGlobal(InternedString name)
-	    : Instruction {Tag::GetGlobal}
-	    , m_name {name} {}
+struct GetGlobalSlot : Instruction {
+	GetGlobalSlot(int slot)
+	    : Instruction {Tag::GetGlobalSlot}
+	    , m_slot {slot} {}
 
-	InternedString m_name;
+	int m_slot;
 };
 
 struct Call : Instruction {
@@ -50,7 +50,8 @@ struct Executable {
 	std::vector<BasicBlock> blocks;
 };
 
-Writer<Executable> compile(AST::Expr*);
+// Globals are compiled to the slots they have in the given interpreter
+Writer<Executable> compile(AST::Expr*, Interpreter::Interpreter&);
 
 void execute(Executable const&, Interpreter::Interpreter&);
 
@@ -0,0 +1,92 @@
+#include "code_cache.hpp"
+
+#include "../ast.hpp"
+#include "bytecode.hpp"
+
+#include <chrono>
+
+namespace Bytecode {
+
+CompiledFunction::CompiledFunction() = default;
+CompiledFunction::CompiledFunction(CompiledFunction&&) = default;
+CompiledFunction& CompiledFunction::operator=(CompiledFunction&&) = default;
+CompiledFunction::~CompiledFunction() = default;
+
+CodeCache::CodeCache() = default;
+
+CodeCache::~CodeCache() {
+	for (auto& kv : m_functions)
+		if (kv.second.m_function && kv.first->m_compiled == &kv.second)
+			kv.first->m_compiled = nullptr;
+}
+
+CompiledFunction& CodeCache::entry_for(AST::FunctionLiteral* function) {
+	CompiledFunction* entry = function->m_compiled;
+	if (!entry || entry->m_cache != this) {
+		entry = &m_functions[function];
+		if (entry->m_function != function)
+			*entry = CompiledFunction {};
+		entry->m_cache = this;
+		entry->m_function = function;
+		function->m_compiled = entry;
+	}
+	return *entry;
+}
+
+Executable const* CodeCache::compile(CompiledFunction& entry, Interpreter::Interpreter& e) {
+	entry.m_tried_compilation = true;
+
+	auto start = std::chrono::steady_clock::now();
+	Writer<Executable> bytecode = Bytecode::compile(entry.m_function->m_body, e);
+	auto end = std::chrono::steady_clock::now();
+	m_stats.m_compile_seconds += std::chrono::duration<double>(end - start).count();
+
+	if (!bytecode.ok()) {
+		m_stats.m_failed_compilations += 1;
+		return nullptr;
+	}
+
+	m_stats.m_compilations += 1;
+	entry.m_executable = std::make_unique<Executable>(std::move(bytecode.m_result));
+	return entry.m_executable.get();
+}
+
+Executable const* CodeCache::code_for_call(
+    AST::FunctionLiteral* function, Interpreter::Interpreter& e) {
+
+	if (m_shared) {
+		CompiledFunction const* entry = function->m_compiled;
+		if (entry && entry->m_cache == m_shared && entry->m_executable) {
+			m_stats.m_hits += 1;
+			return entry->m_executable.get();
+		}
+		m_stats.m_misses += 1;
+		return nullptr;
+	}
+
+	CompiledFunction& entry = entry_for(function);
+
+	if (entry.m_executable) {
+		m_stats.m_hits += 1;
+		return entry.m_executable.get();
+	}
+
+	m_stats.m_misses += 1;
+
+	if (entry.m_tried_compilation)
+		return nullptr;
+
+	entry.m_call_count += 1;
+	if (entry.m_call_count <= m_hot_call_count)
+		return nullptr;
+
+	return compile(entry, e);
+}
+
+void CodeCache::compile_ahead(AST::FunctionLiteral* function, Interpreter::Interpreter& e) {
+	CompiledFunction& entry = entry_for(function);
+	if (!entry.m_tried_compilation)
+		compile(entry, e);
+}
+
+} // namespace Bytecode
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+
+namespace AST {
+struct FunctionLiteral;
+}
+
+namespace Interpreter {
+struct Interpreter;
+}
+
+namespace Bytecode {
+
+struct CodeCache;
+struct Executable;
+
+// What the code cache knows about a function
+struct CompiledFunction {
+	CodeCache* m_cache {nullptr};
+	// nullptr once the function is destroyed
+	AST::FunctionLiteral* m_function {nullptr};
+	int m_call_count {0};
+	bool m_tried_compilation {false};
+	std::unique_ptr<Executable> m_executable;
+
+	CompiledFunction();
+	CompiledFunction(CompiledFunction&&);
+	CompiledFunction& operator=(CompiledFunction&&);
+	~CompiledFunction();
+};
+
+struct CodeCacheStats {
+	// calls that found compiled code, and calls that had to be interpreted
+	int m_hits {0};
+	int m_misses {0};
+	int m_compilations {0};
+	int m_failed_compilations {0};
+	double m_compile_seconds {0};
+};
+
+/*
+ * Owns the bytecode of the functions an interpreter runs.
+ *
+ * Functions are interpreted until they have been called m_hot_call_count
+ * times, and compiled on the call after that. If compiling fails, the
+ * function keeps being interpreted, and we don't try again.
+ *
+ * Each FunctionLiteral points at its entry, so calls find their code
+ * without a lookup. A function that is destroyed first clears its entry,
+ * so a function made later at the same address doesn't inherit its code.
+ * A cache that is destroyed first unlinks the functions that are left.
+ */
+struct CodeCache {
+	int m_hot_call_count {8};
+	CodeCacheStats m_stats;
+	std::unordered_map<AST::FunctionLiteral*, CompiledFunction> m_functions;
+
+	// A cache that was filled ahead of time, and is shared by many
+	// interpreters. When set, calls run the code it has, or are
+	// interpreted, and this cache never compiles anything, or touches the
+	// functions, so interpreters on different threads can share them.
+	CodeCache const* m_shared {nullptr};
+
+	CodeCache();
+	CodeCache(CodeCache const&) = delete;
+	CodeCache& operator=(CodeCache const&) = delete;
+	~CodeCache();
+
+	// The code to run for a call to the given function, or nullptr if the
+	// call has to be interpreted
+	Executable const* code_for_call(AST::FunctionLiteral*, Interpreter::Interpreter&);
+
+	// Compiles the function right away, however many times it was called
+	void compile_ahead(AST::FunctionLiteral*, Interpreter::Interpreter&);
+
+  private:
+	CompiledFunction& entry_for(AST::FunctionLiteral*);
+	Executable const* compile(CompiledFunction&, Interpreter::Interpreter&);
+};
+
+} // namespace Bytecode
@@ -47,7 +47,7 @@ void eval(AST::IntegerLiteral* ast, Interpreter& e) {
 }
 
 void eval(AST::StringLiteral* ast, Interpreter& e) {
-	e.push_string(ast->text());
+	e.push_string(ast->text().to_string());
 };
 
 void eval(AST::BooleanLiteral* ast, Interpreter& e) {
@@ -68,6 +68,24 @@ void eval(AST::ArrayLiteral* ast, Interpreter& e) {
 	}
 }
 
+// While a function runs, its closure sits right below its frame
+static Function* current_closure(Interpreter& e) {
+	return e.m_stack.frame_at(-1).as<Function>();
+}
+
+static Variable* variable_of(AST::Identifier* ast, Interpreter& e) {
+	if (ast->m_origin == AST::Identifier::Origin::Global)
+		return e.global_access(global_slot(ast));
+
+	if (ast->m_frame_offset == INT_MIN)
+		Log::fatal() << "missing layout for identifier '" << ast->text() << "'";
+
+	if (ast->m_origin == AST::Identifier::Origin::Capture)
+		return current_closure(e)->captures()[ast->m_frame_offset];
+
+	return e.m_stack.frame_at(ast->m_frame_offset).as<Variable>();
+}
+
 void eval(AST::Identifier* ast, Interpreter& e) {
 
 #ifdef DEBUG
@@ -80,14 +98,7 @@ void eval(AST::Identifier* ast, Interpreter& e) {
 	}
 #endif
 
-	if (ast->m_origin == AST::Identifier::Origin::Local ||
-	    ast->m_origin == AST::Identifier::Origin::Capture) {
-		if (ast->m_frame_offset == INT_MIN)
-			Log::fatal() << "missing layout for identifier '" << ast->text() << "'";
-		e.m_stack.push(e.m_stack.frame_at(ast->m_frame_offset).as<Variable>()->m_value);
-	} else {
-		e.m_stack.push(e.global_access(ast->text())->m_value);
-	}
+	e.m_stack.push(variable_of(ast, e)->m_value);
 };
 
 auto is_callable_type(ValueTag t) -> bool {
@@ -108,14 +119,7 @@ void eval(AST::CallExpression* ast, Interpreter& e) {
 	for (auto expr : arglist)
 		eval(expr, e);
 
-	e.m_stack.start_frame(arg_count);
-
-	eval_call_callable(callee, arg_count, e);
-
-	// pop the result of the function, and clobber the callee
-	e.m_stack.frame_at(-1) = e.m_stack.pop();
-
-	e.m_stack.end_frame();
+	eval_call(callee, arg_count, e);
 }
 
 void eval(AST::AssignmentExpression* ast, Interpreter& e) {
@@ -123,20 +127,12 @@ void eval(AST::AssignmentExpression* ast, Interpreter& e) {
 
 		auto target_ast = static_cast<AST::Identifier*>(ast->m_target);
 
-		Value target {nullptr};
-		if (target_ast->m_origin == AST::Identifier::Origin::Local ||
-				target_ast->m_origin == AST::Identifier::Origin::Capture) {
-			if (target_ast->m_frame_offset == INT_MIN)
-				Log::fatal() << "missing layout for identifier '" << target_ast->text() << "'";
-			target = e.m_stack.frame_at(target_ast->m_frame_offset);
-		} else {
-			target = Value{e.global_access(target_ast->text())};
-		}
+		auto target = variable_of(target_ast, e);
 
 		eval(ast->m_value, e);
 		auto value = e.m_stack.pop();
 
-		target.as<Variable>()->m_value = value;
+		target->m_value = value;
 
 		e.m_stack.push(e.null());
 	} else if (ast->m_target->type() == ExprTag::IndexExpression) {
@@ -188,16 +184,17 @@ void eval(AST::TernaryExpression* ast, Interpreter& e) {
 
 void eval(AST::FunctionLiteral* ast, Interpreter& e) {
 
-	CapturesType captures;
-	captures.assign(ast->m_captures.size(), nullptr);
-	for (auto const& capture : ast->m_captures) {
-		assert(capture.second.outer_frame_offset != INT_MIN);
-		auto value = e.m_stack.frame_at(capture.second.outer_frame_offset);
-		auto offset = capture.second.inner_frame_offset - ast->m_args.size();
-		captures[offset] = value.as<Variable>();
-	}
+	int capture_count = ast->m_capture_sources.size();
+	e.push_function(ast, capture_count);
 
-	e.push_function(ast, std::move(captures));
+	auto captures = e.m_stack.access(0).as<Function>()->captures();
+	for (int i = 0; i < capture_count; ++i) {
+		auto const& source = ast->m_capture_sources[i];
+		assert(source.offset != INT_MIN);
+		captures[i] = source.from_capture
+		    ? current_closure(e)->captures()[source.offset]
+		    : e.m_stack.frame_at(source.offset).as<Variable>();
+	}
 };
 
 void eval(AST::AccessExpression* ast, Interpreter& e) {
@@ -321,6 +318,7 @@ static void exec(AST::WhileStatement* ast, Interpreter& e) {
 		if (!condition)
 			break;
 
+		e.burn_fuel();
 		exec(ast->m_body, e);
 
 		if (e.m_returning)
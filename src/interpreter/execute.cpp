@@ -11,73 +11,166 @@
 #include "../parser.hpp"
 #include "../symbol_resolution.hpp"
 #include "../symbol_table.hpp"
-#include "../typechecker/ct_eval.hpp"
-#include "../typechecker/metacheck.hpp"
-#include "../typechecker/typecheck.hpp"
-#include "../typechecker/typechecker.hpp"
+#include "budget.hpp"
 #include "eval.hpp"
 #include "garbage_collector.hpp"
+#include "global_slots.hpp"
+#include "image.hpp"
 #include "interpreter.hpp"
+#include "isolate.hpp"
 #include "native.hpp"
 #include "utils.hpp"
 
 namespace Interpreter {
 
+// What we need to bring in skipped top level functions after the fact
+struct LazyProgram {
+	Frontend::Context m_file_context;
+	CST::Allocator& m_cst_allocator;
+	AST::Allocator& m_ast_allocator;
+	SkippedDeclarations& m_skipped;
+};
+
 ExitStatus execute(
-	std::string const& source,
+	string_view source,
 	ExecuteSettings settings,
 	Runner* runner
 ) {
-	CST::Allocator cst_allocator;
-	AST::Allocator ast_allocator;
+	CompiledProgram program;
 
-	LexerResult lexer_result = tokenize({source});
+	auto status = load_program(source, settings, program);
+	if (status != ExitStatus::Ok)
+		return status;
 
-	auto parse_result = parse_program(std::move(lexer_result), cst_allocator);
-
-	if (not parse_result.ok()) {
-		parse_result.error().print();
-		return ExitStatus::ParseError;
-	}
+	auto ast = program.m_ast;
+	auto& tc = program.m_tc;
+	auto& context = program.m_context;
 
-	if (settings.dump_cst)
-		print(parse_result.cst(), 1);
+	if (settings.check_only)
+		return ExitStatus::Ok;
 
-	auto ast = AST::convert_program(parse_result.cst(), ast_allocator);
+	LazyProgram lazy_program {
+	    {program.m_source},
+	    program.m_cst_allocator,
+	    program.m_ast_allocator,
+	    program.m_skipped};
 
-	// creates and stores a bunch of builtin declarations
-	TypeChecker::TypeChecker tc{ast_allocator};
-	Frontend::SymbolTable context;
+	GC gc;
+	gc.m_heap_limit = settings.max_heap_bytes;
+	Interpreter env = {&gc, &tc.declaration_order()};
+	env.m_code_cache.m_hot_call_count = settings.compile_after_calls;
+	if (settings.max_steps != 0)
+		env.m_fuel = settings.max_steps;
+	if (settings.lazy_declarations)
+		env.m_lazy_program = &lazy_program;
+	bind_global_slots(tc.declaration_order(), env.m_global_scope);
+
+	if (settings.compile_to) {
+		if (settings.snapshot_heap) {
+			try {
+				declare_native_functions(env);
+				run(ast, env);
+			} catch (BudgetExceeded const&) {
+				return ExitStatus::BudgetExceeded;
+			}
+		}
 
-	{
-		for (auto& bucket : tc.m_builtin_declarations.m_buckets)
-			for (auto& decl : bucket)
-				context.declare(&decl);
-		auto err = Frontend::resolve_symbols_program(ast, parse_result.file_context(), context);
+		auto err = write_image(
+		    settings.compile_to,
+		    tc.declaration_order(),
+		    settings.snapshot_heap ? &env : nullptr);
 		if (!err.ok()) {
 			err.print();
-			return ExitStatus::StaticError;
+			return ExitStatus::ImageError;
 		}
+		return ExitStatus::Ok;
 	}
 
-	tc.compute_declaration_order(ast);
+	try {
+		declare_native_functions(env);
+		run(ast, env);
+		return runner(env, context);
+	} catch (BudgetExceeded const&) {
+		return ExitStatus::BudgetExceeded;
+	}
+}
+
+ExitStatus execute_image(string_view image, Runner* runner) {
+	AST::Allocator ast_allocator;
+	GC gc;
+	Interpreter env = {&gc, nullptr};
 
-	if (settings.typecheck) {
-		TypeChecker::metacheck_program(ast);
-		TypeChecker::reify_types(ast, tc);
-		TypeChecker::typecheck_program(ast, tc);
+	auto loaded = read_image(image, ast_allocator, env);
+	if (!loaded.ok()) {
+		loaded.error().print();
+		return ExitStatus::ImageError;
 	}
 
-	TypeChecker::compute_offsets_program(ast, 0);
+	env.m_declaration_order = &loaded.m_result.m_declaration_order;
+	bind_global_slots(loaded.m_result.m_declaration_order, env.m_global_scope);
 
-	GC gc;
-	Interpreter env = {&gc, &tc.declaration_order()};
-	declare_native_functions(env);
-	run(ast, env);
+	Frontend::SymbolTable context;
+	for (auto const& component : loaded.m_result.m_declaration_order)
+		for (auto decl : component)
+			context.declare(decl);
+
+	if (!loaded.m_result.m_restored_heap) {
+		declare_native_functions(env);
+		run(nullptr, env);
+	}
 
 	return runner(env, context);
 }
 
+// Parses, resolves and evaluates the skipped top level functions that the
+// expression in `expr_context` mentions, so that it can refer to them. They
+// are not type checked, just like the expression itself.
+static bool load_skipped_declarations(
+	Frontend::Context const& expr_context,
+	Interpreter& env,
+	Frontend::SymbolTable& context
+) {
+	LazyProgram& lazy = *env.m_lazy_program;
+
+	std::vector<string_view> names;
+	Lexer lexer {expr_context};
+	for (Token token = lexer.next(); token.m_type != TokenTag::END; token = lexer.next())
+		if (token.m_type == TokenTag::IDENTIFIER)
+			names.push_back(token.m_text);
+
+	auto parse_result = parse_skipped_declarations(
+	    lazy.m_file_context, lazy.m_cst_allocator, lazy.m_skipped, names);
+	if (!parse_result.ok()) {
+		parse_result.error().print();
+		return false;
+	}
+
+	auto ast = AST::convert_program(parse_result.cst(), lazy.m_ast_allocator);
+	if (ast->m_declarations.empty())
+		return true;
+
+	auto err = Frontend::resolve_symbols_program(ast, lazy.m_file_context, context);
+	if (!err.ok()) {
+		err.print();
+		return false;
+	}
+
+	TypeChecker::compute_offsets_program(ast, 0);
+
+	// They are all functions, so there's no order to respect
+	std::vector<std::vector<AST::Declaration*>> order(1);
+	for (auto& decl : ast->m_declarations)
+		order[0].push_back(&decl);
+
+	bind_global_slots(order, env.m_global_scope);
+
+	auto program_order = env.m_declaration_order;
+	env.m_declaration_order = &order;
+	run(ast, env);
+	env.m_declaration_order = program_order;
+
+	return true;
+}
 
 // FIXME: This might not handle seq-expressions, or inline definitions of
 // functions. Investigate.
@@ -89,15 +182,17 @@ Value eval_expression(
 	CST::Allocator cst_allocator;
 	AST::Allocator ast_allocator;
 
-	LexerResult lexer_result = tokenize({expr});
-
-	auto parse_result = parse_expression(std::move(lexer_result), cst_allocator);
+	auto parse_result = parse_expression({expr}, cst_allocator);
 
 	if (!parse_result.ok()) {
 		parse_result.error().print();
 		Log::fatal() << "parser error";
 	}
 
+	if (env.m_lazy_program &&
+	    !load_skipped_declarations(parse_result.file_context(), env, context))
+		return env.null();
+
 	auto ast = AST::convert_expr(parse_result.cst(), ast_allocator);
 
 	{
@@ -109,6 +204,7 @@ Value eval_expression(
 	}
 
 	TypeChecker::compute_offsets(ast, 0);
+	bind_global_slots(ast, env.m_global_scope);
 
 	eval(ast, env);
 	auto value = env.m_stack.pop();
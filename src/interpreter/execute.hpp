@@ -2,8 +2,12 @@
 
 #include "exit_status_tag.hpp"
 #include "value.hpp"
+#include "../utils/string_view.hpp"
+
 #include <string>
 
+#include <cstddef>
+
 namespace Frontend {
 struct SymbolTable;
 }
@@ -17,15 +21,63 @@ using Runner = auto(Interpreter&, Frontend::SymbolTable&) -> ExitStatus;
 struct ExecuteSettings {
 	bool dump_cst {false};
 	bool typecheck {true};
+
+	// Only process the top level functions that can be reached from
+	// `entry_point` or from a top level value. Errors in the others go
+	// unreported.
+	bool lazy_declarations {false};
+	char const* entry_point {"__invoke"};
+
+	// How many threads infer the types of independent declarations at the
+	// same time
+	int typecheck_threads {1};
+
+	// Replace calls to small global functions with their bodies. Bodies
+	// bigger than the limit, in AST nodes, are left alone.
+	bool inline_functions {true};
+	int inline_size_limit {16};
+
+	// Evaluate operators on literals and propagate constant globals before
+	// running anything
+	bool fold_constants {true};
+
+	// Functions run in the tree walker until they've been called this many
+	// times, and are compiled to bytecode then
+	int compile_after_calls {8};
+
+	// Stop the program with ExitStatus::BudgetExceeded once it has made
+	// this many calls and loop iterations, or once its heap grows past this
+	// many bytes. Zero means there is no limit.
+	long long max_steps {0};
+	size_t max_heap_bytes {0};
+
+	// Stop after the static checks, without running anything
+	bool check_only {false};
+
+	// File where we remember which declarations passed the type checker,
+	// so later runs only infer what changed. Nothing is cached when null.
+	char const* check_cache {nullptr};
+
+	// Instead of running the program, write an image of it to this file,
+	// which execute_image can run without going through the front end
+	char const* compile_to {nullptr};
+	// With compile_to, also run the global declarations, and put the heap
+	// they leave behind in the image, so loading it doesn't run them again
+	bool snapshot_heap {false};
 };
 
-// returns an exit status
+// returns an exit status. The source must be followed by a NUL byte, and
+// stay alive until the runner returns.
 ExitStatus execute(
-	std::string const& source,
+	string_view source,
 	ExecuteSettings settings,
 	Runner* runner
 );
 
+// runs a program image written with ExecuteSettings::compile_to. The
+// symbol table handed to the runner only knows the program's globals.
+ExitStatus execute_image(string_view image, Runner* runner);
+
 // evaluates an expression and returns the resulting value
 Value eval_expression(
 	const std::string& expr,
@@ -6,11 +6,14 @@
 	X(ParseError)                                                              \
 	X(StaticError)                                                             \
 	X(TopLevelTypeError)                                                       \
+	X(ImageError)                                                              \
                                                                                \
 	X(NullError)                                                               \
 	X(TypeError)                                                               \
                                                                                \
 	X(ValueError)                                                              \
+                                                                               \
+	X(BudgetExceeded)                                                          \
 	X(Empty)
 
 #define X(name) #name,
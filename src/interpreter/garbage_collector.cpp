@@ -5,6 +5,40 @@
 
 namespace Interpreter {
 
+static size_t cell_bytes(GcCell* cell) {
+	switch (cell->type()) {
+	case ValueTag::String:
+		return sizeof(String) + static_cast<String*>(cell)->m_value.capacity();
+	case ValueTag::Array:
+		return sizeof(Array)
+		       + static_cast<Array*>(cell)->m_value.capacity() * sizeof(Value);
+	case ValueTag::Record:
+		return sizeof(Record)
+		       + static_cast<Record*>(cell)->m_value.size() * sizeof(RecordType::value_type);
+	case ValueTag::Function:
+		return sizeof(Function)
+		       + static_cast<Function*>(cell)->m_capture_count * sizeof(Variable*);
+	case ValueTag::Variant:
+		return sizeof(Variant);
+	case ValueTag::Variable:
+		return sizeof(Variable);
+	case ValueTag::VariantConstructor:
+		return sizeof(VariantConstructor);
+	case ValueTag::RecordConstructor:
+		return sizeof(RecordConstructor)
+		       + static_cast<RecordConstructor*>(cell)->m_keys.size() * sizeof(InternedString);
+	default:
+		return sizeof(GcCell);
+	}
+}
+
+static size_t heap_bytes(std::vector<GcCell*> const& blocks) {
+	size_t result = 0;
+	for (auto block : blocks)
+		result += cell_bytes(block);
+	return result;
+}
+
 GC::GC() {
 }
 
@@ -28,24 +62,45 @@ void GC::mark_roots() {
 }
 
 void GC::sweep() {
-	for (auto*& block : m_blocks) {
-		if (not block->m_visited) {
-			delete block;
-			block = nullptr;
+	auto unpinned = m_blocks.begin() + m_watermark;
+
+	for (auto it = unpinned; it != m_blocks.end(); ++it) {
+		if (not (*it)->m_visited) {
+			delete *it;
+			*it = nullptr;
 		}
 	}
 
 	auto is_null = [&](GcCell* p) { return p == nullptr; };
 
 	m_blocks.erase(
-	    std::remove_if(m_blocks.begin(), m_blocks.end(), is_null), m_blocks.end());
+	    std::remove_if(unpinned, m_blocks.end(), is_null), m_blocks.end());
+
+	m_heap_bytes = heap_bytes(m_blocks);
 }
 
 void GC::sweep_all() {
+	m_watermark = 0;
 	unmark_all();
 	sweep();
 }
 
+void GC::set_watermark() {
+	m_watermark = m_blocks.size();
+}
+
+void GC::rewind() {
+	for (auto it = m_blocks.begin() + m_watermark; it != m_blocks.end(); ++it)
+		delete *it;
+	m_blocks.resize(m_watermark);
+
+	m_heap_bytes = heap_bytes(m_blocks);
+}
+
+void GC::charge(size_t bytes) {
+	m_heap_bytes += bytes;
+}
+
 void GC::add_root(GcCell* new_root) {
 	m_roots.push_back(new_root);
 }
@@ -53,6 +108,7 @@ void GC::add_root(GcCell* new_root) {
 Variant* GC::new_variant_raw(InternedString constructor, Value v) {
 	auto result = new Variant(constructor, v);
 	m_blocks.push_back(result);
+	charge(sizeof(Variant));
 	return result;
 }
 
@@ -60,6 +116,7 @@ Record* GC::new_record_raw(RecordType declarations) {
 	auto result = new Record;
 	result->m_value = std::move(declarations);
 	m_blocks.push_back(result);
+	charge(sizeof(Record) + result->m_value.size() * sizeof(RecordType::value_type));
 	return result;
 }
 
@@ -67,36 +124,42 @@ Array* GC::new_list_raw(ArrayType elements) {
 	auto result = new Array;
 	result->m_value = std::move(elements);
 	m_blocks.push_back(result);
+	charge(sizeof(Array) + result->m_value.capacity() * sizeof(Value));
 	return result;
 }
 
 String* GC::new_string_raw(std::string s) {
 	auto result = new String(std::move(s));
 	m_blocks.push_back(result);
+	charge(sizeof(String) + result->m_value.capacity());
 	return result;
 }
 
-Function* GC::new_function_raw(FunctionType def, CapturesType captures) {
-	auto result = new Function(std::move(def), std::move(captures));
+Function* GC::new_function_raw(FunctionType def, int capture_count) {
+	auto result = Function::make(def, capture_count);
 	m_blocks.push_back(result);
+	charge(sizeof(Function) + capture_count * sizeof(Variable*));
 	return result;
 }
 
 Variable* GC::new_variable_raw(Value v) {
 	auto result = new Variable(std::move(v));
 	m_blocks.push_back(result);
+	charge(sizeof(Variable));
 	return result;
 }
 
 VariantConstructor* GC::new_variant_constructor_raw(InternedString constructor) {
 	auto result = new VariantConstructor(constructor);
 	m_blocks.push_back(result);
+	charge(sizeof(VariantConstructor));
 	return result;
 }
 
 RecordConstructor* GC::new_record_constructor_raw(std::vector<InternedString> keys) {
 	auto result = new RecordConstructor(std::move(keys));
 	m_blocks.push_back(result);
+	charge(sizeof(RecordConstructor) + result->m_keys.size() * sizeof(InternedString));
 	return result;
 }
 
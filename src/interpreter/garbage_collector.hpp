@@ -2,6 +2,8 @@
 
 #include <vector>
 
+#include <cstddef>
+
 #include "value.hpp"
 
 namespace Interpreter {
@@ -10,6 +12,18 @@ struct GC {
   public:
 	std::vector<GcCell*> m_blocks;
 	std::vector<GcCell*> m_roots;
+	// The cells allocated before the watermark are pinned: they are never
+	// swept, and rewinding frees every cell allocated after them
+	int m_watermark {0};
+
+	// An estimate of how many bytes the cells take, including what they
+	// own, like the elements of arrays. It's exact after every sweep, and
+	// only grows in between, garbage included. The limit, unless it's zero,
+	// is on the bytes that are still live: the interpreter checks it where
+	// it can collect, and only throws BudgetExceeded if it's still over
+	// after collecting.
+	size_t m_heap_bytes {0};
+	size_t m_heap_limit {0};
 
 	GC();
 	~GC();
@@ -22,11 +36,21 @@ struct GC {
 
 	void add_root(GcCell* new_root);
 
+	void set_watermark();
+	void rewind();
+
+	// Counts bytes that a cell took on after it was made
+	void charge(size_t bytes);
+
+	bool over_heap_limit() const {
+		return m_heap_limit != 0 && m_heap_bytes > m_heap_limit;
+	}
+
 	auto new_variant_raw(InternedString constructor, Value v) -> Variant*;
 	auto new_record_raw(RecordType) -> Record*;
 	auto new_list_raw(ArrayType) -> Array*;
 	auto new_string_raw(std::string) -> String*;
-	auto new_function_raw(FunctionType, CapturesType) -> Function*;
+	auto new_function_raw(FunctionType, int capture_count) -> Function*;
 	auto new_variable_raw(Value) -> Variable*;
 	auto new_variant_constructor_raw(InternedString) -> VariantConstructor*;
 	auto new_record_constructor_raw(std::vector<InternedString>) -> RecordConstructor*;
@@ -53,8 +53,9 @@ static void gc_visit(Function* f) {
 		return;
 
 	f->m_visited = true;
-	for (auto& capture : f->m_captures)
-		gc_visit(capture);
+	for (int i = 0; i < f->m_capture_count; ++i)
+		if (f->captures()[i])
+			gc_visit(f->captures()[i]);
 }
 
 static void gc_visit(Variable* r) {
@@ -0,0 +1,156 @@
+#include "global_slots.hpp"
+
+#include "../ast.hpp"
+#include "interpreter.hpp"
+
+namespace Interpreter {
+
+using AST::ExprTag;
+using AST::StmtTag;
+
+namespace {
+
+// Binds global identifiers to their slots in a scope, making slots for the
+// names that don't have one yet, and keeps the functions it finds if asked
+struct Linker {
+	GlobalScope& m_scope;
+	std::vector<AST::FunctionLiteral*>* m_functions;
+
+	void link(AST::Expr* ast);
+	void link(AST::Stmt* ast);
+};
+
+void Linker::link(AST::Expr* ast) {
+	switch (ast->type()) {
+	case ExprTag::Identifier: {
+		auto identifier = static_cast<AST::Identifier*>(ast);
+		if (identifier->m_origin == AST::Identifier::Origin::Global)
+			identifier->m_global_slot = m_scope.slot(identifier->text());
+		return;
+	}
+	case ExprTag::ArrayLiteral:
+		for (auto element : static_cast<AST::ArrayLiteral*>(ast)->m_elements)
+			link(element);
+		return;
+	case ExprTag::FunctionLiteral: {
+		auto function = static_cast<AST::FunctionLiteral*>(ast);
+		link(function->m_body);
+		if (m_functions)
+			m_functions->push_back(function);
+		return;
+	}
+	case ExprTag::CallExpression: {
+		auto call = static_cast<AST::CallExpression*>(ast);
+		link(call->m_callee);
+		for (auto arg : call->m_args)
+			link(arg);
+		return;
+	}
+	case ExprTag::AssignmentExpression: {
+		auto assignment = static_cast<AST::AssignmentExpression*>(ast);
+		link(assignment->m_target);
+		link(assignment->m_value);
+		return;
+	}
+	case ExprTag::IndexExpression: {
+		auto index = static_cast<AST::IndexExpression*>(ast);
+		link(index->m_callee);
+		link(index->m_index);
+		return;
+	}
+	case ExprTag::AccessExpression:
+		link(static_cast<AST::AccessExpression*>(ast)->m_target);
+		return;
+	case ExprTag::MatchExpression: {
+		auto match = static_cast<AST::MatchExpression*>(ast);
+		link(&match->m_target);
+		for (auto& kv : match->m_cases)
+			link(kv.second.m_expression);
+		return;
+	}
+	case ExprTag::TernaryExpression: {
+		auto ternary = static_cast<AST::TernaryExpression*>(ast);
+		link(ternary->m_condition);
+		link(ternary->m_then_expr);
+		link(ternary->m_else_expr);
+		return;
+	}
+	case ExprTag::ConstructorExpression: {
+		auto constructor = static_cast<AST::ConstructorExpression*>(ast);
+		link(constructor->m_constructor);
+		for (auto arg : constructor->m_args)
+			link(arg);
+		return;
+	}
+	case ExprTag::SequenceExpression:
+		link(static_cast<AST::SequenceExpression*>(ast)->m_body);
+		return;
+	case ExprTag::TypeTerm:
+		link(static_cast<AST::TypeTerm*>(ast)->m_callee);
+		return;
+	case ExprTag::BuiltinTypeFunction:
+		link(static_cast<AST::BuiltinTypeFunction*>(ast)->m_syntax);
+		return;
+	default:
+		return;
+	}
+}
+
+void Linker::link(AST::Stmt* ast) {
+	switch (ast->tag()) {
+	case StmtTag::Block:
+		for (auto stmt : static_cast<AST::Block*>(ast)->m_body)
+			link(stmt);
+		return;
+	case StmtTag::ReturnStatement:
+		link(static_cast<AST::ReturnStatement*>(ast)->m_value);
+		return;
+	case StmtTag::IfElseStatement: {
+		auto if_else = static_cast<AST::IfElseStatement*>(ast);
+		link(if_else->m_condition);
+		link(if_else->m_body);
+		if (if_else->m_else_body)
+			link(if_else->m_else_body);
+		return;
+	}
+	case StmtTag::WhileStatement: {
+		auto while_stmt = static_cast<AST::WhileStatement*>(ast);
+		link(while_stmt->m_condition);
+		link(while_stmt->m_body);
+		return;
+	}
+	case StmtTag::ExpressionStatement:
+		link(static_cast<AST::ExpressionStatement*>(ast)->m_expression);
+		return;
+	case StmtTag::Declaration: {
+		auto decl = static_cast<AST::Declaration*>(ast);
+		if (decl->m_value)
+			link(decl->m_value);
+		return;
+	}
+	}
+}
+
+} // namespace
+
+void bind_global_slots(
+    std::vector<std::vector<AST::Declaration*>> const& declaration_order,
+    GlobalScope& scope,
+    std::vector<AST::FunctionLiteral*>* functions) {
+	for (auto const& component : declaration_order)
+		for (auto decl : component)
+			scope.slot(decl->identifier_text());
+
+	Linker linker {scope, functions};
+	for (auto const& component : declaration_order)
+		for (auto decl : component)
+			if (decl->m_value)
+				linker.link(decl->m_value);
+}
+
+void bind_global_slots(AST::Expr* ast, GlobalScope& scope) {
+	Linker linker {scope, nullptr};
+	linker.link(ast);
+}
+
+} // namespace Interpreter
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+namespace AST {
+struct Declaration;
+struct Expr;
+struct FunctionLiteral;
+}
+
+namespace Interpreter {
+
+struct GlobalScope;
+
+// Gives every global identifier in the declarations, or in the expression,
+// its slot in the scope, making slots for the names that don't have one.
+// The program's globals get theirs in declaration order, after the natives.
+// Evaluating and compiling only read the slots, so whatever they run has
+// to be bound first.
+//
+// If `functions` is given, the function literals in the declarations are
+// added to it, so they can be compiled ahead.
+void bind_global_slots(
+    std::vector<std::vector<AST::Declaration*>> const& declaration_order,
+    GlobalScope&,
+    std::vector<AST::FunctionLiteral*>* functions = nullptr);
+void bind_global_slots(AST::Expr*, GlobalScope&);
+
+} // namespace Interpreter
@@ -0,0 +1,979 @@
+#include "image.hpp"
+
+#include "../ast.hpp"
+#include "../ast_allocator.hpp"
+#include "garbage_collector.hpp"
+#include "interpreter.hpp"
+#include "native.hpp"
+#include "value.hpp"
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+namespace Interpreter {
+
+using AST::ExprTag;
+using AST::StmtTag;
+
+static char const image_magic[8] = {'J', 'A', 'S', 'P', 'E', 'R', 'I', 'M'};
+
+// Bump this whenever the layout of an image changes
+static uint32_t const image_version = 3;
+
+// stands in for a missing child, in place of a tag
+static uint8_t const null_node = 0xff;
+
+// how deep nodes may be nested. Reading recurses on the nesting, so a
+// crafted image could overflow the stack without a bound.
+static int const max_node_depth = 4096;
+
+bool is_image(string_view contents) {
+	return static_cast<size_t>(contents.size()) >= sizeof(image_magic) &&
+	       memcmp(contents.data(), image_magic, sizeof(image_magic)) == 0;
+}
+
+namespace {
+
+struct ImageWriter {
+	std::string m_body;
+	std::vector<InternedString> m_strings;
+	std::unordered_map<InternedString, uint32_t> m_string_index;
+
+	// function literals are numbered in the order they are written, so
+	// the heap snapshot can say which one a function value runs
+	std::unordered_map<AST::FunctionLiteral*, uint32_t> m_function_index;
+
+	// heap cells are numbered in the order we first reach them
+	std::unordered_map<GcCell*, uint32_t> m_cell_index;
+	std::vector<GcCell*> m_cells;
+
+	ErrorReport m_error;
+
+	template <typename T>
+	void write(T value) {
+		m_body.append(reinterpret_cast<char const*>(&value), sizeof(T));
+	}
+
+	void write_count(size_t count) {
+		write<uint32_t>(count);
+	}
+
+	void write_string(InternedString str) {
+		auto inserted = m_string_index.insert({str, m_strings.size()});
+		if (inserted.second)
+			m_strings.push_back(str);
+		write<uint32_t>(inserted.first->second);
+	}
+
+	void write_identifier(AST::Identifier const* ast) {
+		write_string(ast->text());
+		write<uint8_t>(static_cast<uint8_t>(ast->m_origin));
+		write<int32_t>(ast->m_frame_offset);
+	}
+
+	void write_declaration(AST::Declaration const& ast) {
+		write_string(ast.identifier_text());
+		write<int32_t>(ast.m_frame_offset);
+		write_expr(ast.m_value);
+	}
+
+	void write_exprs(std::vector<AST::Expr*> const& exprs) {
+		write_count(exprs.size());
+		for (auto expr : exprs)
+			write_expr(expr);
+	}
+
+	void write_strings(std::vector<InternedString> const& strings) {
+		write_count(strings.size());
+		for (auto const& str : strings)
+			write_string(str);
+	}
+
+	void write_expr(AST::Expr* ast);
+	void write_stmt(AST::Stmt* ast);
+
+	void reach_cell(GcCell* cell) {
+		auto inserted = m_cell_index.insert({cell, m_cells.size()});
+		if (inserted.second)
+			m_cells.push_back(cell);
+	}
+
+	void reach_value(Value value) {
+		if (is_heap_type(value.type()))
+			reach_cell(value.get());
+	}
+
+	void write_value(Value value);
+	void write_cell(GcCell* cell);
+	void write_heap(Interpreter& env);
+};
+
+void ImageWriter::write_expr(AST::Expr* ast) {
+	if (!ast) {
+		write<uint8_t>(null_node);
+		return;
+	}
+
+	write<uint8_t>(static_cast<uint8_t>(ast->type()));
+
+	switch (ast->type()) {
+	case ExprTag::NumberLiteral:
+		write<float>(static_cast<AST::NumberLiteral*>(ast)->m_value);
+		return;
+	case ExprTag::IntegerLiteral:
+		write<int32_t>(static_cast<AST::IntegerLiteral*>(ast)->m_value);
+		return;
+	case ExprTag::StringLiteral:
+		write_string(static_cast<AST::StringLiteral*>(ast)->m_text);
+		return;
+	case ExprTag::BooleanLiteral:
+		write<uint8_t>(static_cast<AST::BooleanLiteral*>(ast)->m_value);
+		return;
+	case ExprTag::NullLiteral:
+		return;
+	case ExprTag::ArrayLiteral:
+		write_exprs(static_cast<AST::ArrayLiteral*>(ast)->m_elements);
+		return;
+	case ExprTag::FunctionLiteral: {
+		auto function = static_cast<AST::FunctionLiteral*>(ast);
+		m_function_index.insert({function, m_function_index.size()});
+		write_count(function->m_args.size());
+		for (auto const& arg : function->m_args)
+			write_declaration(arg);
+		write_count(function->m_captures.size());
+		for (auto const& capture : function->m_captures) {
+			write_string(capture.first);
+			write<int32_t>(capture.second.index);
+		}
+		for (auto const& source : function->m_capture_sources) {
+			write<uint8_t>(source.from_capture);
+			write<int32_t>(source.offset);
+		}
+		write_expr(function->m_body);
+		return;
+	}
+	case ExprTag::Identifier:
+		write_identifier(static_cast<AST::Identifier*>(ast));
+		return;
+	case ExprTag::CallExpression: {
+		auto call = static_cast<AST::CallExpression*>(ast);
+		write_expr(call->m_callee);
+		write_exprs(call->m_args);
+		return;
+	}
+	case ExprTag::AssignmentExpression: {
+		auto assignment = static_cast<AST::AssignmentExpression*>(ast);
+		write_expr(assignment->m_target);
+		write_expr(assignment->m_value);
+		return;
+	}
+	case ExprTag::IndexExpression: {
+		auto index = static_cast<AST::IndexExpression*>(ast);
+		write_expr(index->m_callee);
+		write_expr(index->m_index);
+		return;
+	}
+	case ExprTag::AccessExpression: {
+		auto access = static_cast<AST::AccessExpression*>(ast);
+		write_expr(access->m_target);
+		write_string(access->m_member);
+		return;
+	}
+	case ExprTag::MatchExpression: {
+		auto match = static_cast<AST::MatchExpression*>(ast);
+		write_identifier(&match->m_target);
+		write_count(match->m_cases.size());
+		for (auto const& kv : match->m_cases) {
+			write_string(kv.first);
+			write_declaration(kv.second.m_declaration);
+			write_expr(kv.second.m_expression);
+		}
+		return;
+	}
+	case ExprTag::TernaryExpression: {
+		auto ternary = static_cast<AST::TernaryExpression*>(ast);
+		write_expr(ternary->m_condition);
+		write_expr(ternary->m_then_expr);
+		write_expr(ternary->m_else_expr);
+		return;
+	}
+	case ExprTag::ConstructorExpression: {
+		auto constructor = static_cast<AST::ConstructorExpression*>(ast);
+		write_expr(constructor->m_constructor);
+		write_exprs(constructor->m_args);
+		return;
+	}
+	case ExprTag::SequenceExpression:
+		write_stmt(static_cast<AST::SequenceExpression*>(ast)->m_body);
+		return;
+	case ExprTag::UnionExpression:
+		write_strings(static_cast<AST::UnionExpression*>(ast)->m_constructors);
+		return;
+	case ExprTag::StructExpression:
+		write_strings(static_cast<AST::StructExpression*>(ast)->m_fields);
+		return;
+	case ExprTag::TypeTerm:
+		write_expr(static_cast<AST::TypeTerm*>(ast)->m_callee);
+		return;
+	case ExprTag::BuiltinTypeFunction:
+		write_expr(static_cast<AST::BuiltinTypeFunction*>(ast)->m_syntax);
+		return;
+	}
+}
+
+void ImageWriter::write_stmt(AST::Stmt* ast) {
+	if (!ast) {
+		write<uint8_t>(null_node);
+		return;
+	}
+
+	write<uint8_t>(static_cast<uint8_t>(ast->tag()));
+
+	switch (ast->tag()) {
+	case StmtTag::Block: {
+		auto block = static_cast<AST::Block*>(ast);
+		write_count(block->m_body.size());
+		for (auto stmt : block->m_body)
+			write_stmt(stmt);
+		return;
+	}
+	case StmtTag::ReturnStatement:
+		write_expr(static_cast<AST::ReturnStatement*>(ast)->m_value);
+		return;
+	case StmtTag::IfElseStatement: {
+		auto if_else = static_cast<AST::IfElseStatement*>(ast);
+		write_expr(if_else->m_condition);
+		write_stmt(if_else->m_body);
+		write_stmt(if_else->m_else_body);
+		return;
+	}
+	case StmtTag::WhileStatement: {
+		auto while_stmt = static_cast<AST::WhileStatement*>(ast);
+		write_expr(while_stmt->m_condition);
+		write_stmt(while_stmt->m_body);
+		return;
+	}
+	case StmtTag::ExpressionStatement:
+		write_expr(static_cast<AST::ExpressionStatement*>(ast)->m_expression);
+		return;
+	case StmtTag::Declaration:
+		write_declaration(*static_cast<AST::Declaration*>(ast));
+		return;
+	}
+}
+
+void ImageWriter::write_value(Value value) {
+	write<uint8_t>(static_cast<uint8_t>(value.type()));
+
+	switch (value.type()) {
+	case ValueTag::Null:
+		return;
+	case ValueTag::Integer:
+		write<int32_t>(value.get_integer());
+		return;
+	case ValueTag::Float:
+		write<float>(value.get_float());
+		return;
+	case ValueTag::Boolean:
+		write<uint8_t>(value.get_boolean());
+		return;
+	case ValueTag::NativeFunction: {
+		char const* name = native_function_name(value.get_native_func());
+		if (!name && m_error.ok())
+			m_error = {"Can't snapshot a native function that has no name"};
+		write_string(name ? name : "");
+		return;
+	}
+	default:
+		write<uint32_t>(m_cell_index.at(value.get()));
+		return;
+	}
+}
+
+void ImageWriter::write_cell(GcCell* cell) {
+	switch (cell->type()) {
+	case ValueTag::String: {
+		auto const& str = static_cast<String*>(cell)->m_value;
+		write_count(str.size());
+		m_body.append(str);
+		return;
+	}
+	case ValueTag::Array: {
+		auto const& elements = static_cast<Array*>(cell)->m_value;
+		write_count(elements.size());
+		for (auto element : elements)
+			write_value(element);
+		return;
+	}
+	case ValueTag::Record: {
+		auto const& fields = static_cast<Record*>(cell)->m_value;
+		write_count(fields.size());
+		for (auto const& field : fields) {
+			write_string(field.first);
+			write_value(field.second);
+		}
+		return;
+	}
+	case ValueTag::Variant: {
+		auto variant = static_cast<Variant*>(cell);
+		write_string(variant->m_constructor);
+		write_value(variant->m_inner_value);
+		return;
+	}
+	case ValueTag::Function: {
+		auto function = static_cast<Function*>(cell);
+		auto it = m_function_index.find(function->m_def);
+		if (it == m_function_index.end() && m_error.ok())
+			m_error = {"Can't snapshot a function that is not part of the program"};
+		write<uint32_t>(it == m_function_index.end() ? 0 : it->second);
+		for (int i = 0; i < function->m_capture_count; ++i)
+			write<uint32_t>(m_cell_index.at(function->captures()[i]));
+		return;
+	}
+	case ValueTag::Variable:
+		write_value(static_cast<Variable*>(cell)->m_value);
+		return;
+	case ValueTag::VariantConstructor:
+		write_string(static_cast<VariantConstructor*>(cell)->m_constructor);
+		return;
+	case ValueTag::RecordConstructor:
+		write_strings(static_cast<RecordConstructor*>(cell)->m_keys);
+		return;
+	default:
+		assert(0);
+	}
+}
+
+void ImageWriter::write_heap(Interpreter& env) {
+	// number every cell we can reach from a global. Cells go in m_cells
+	// as we find them, so the loop also visits the ones it adds
+	for (auto variable : env.m_global_scope.m_variables)
+		if (variable)
+			reach_cell(variable);
+
+	for (int i = 0; i < m_cells.size(); ++i) {
+		GcCell* cell = m_cells[i];
+		switch (cell->type()) {
+		case ValueTag::Array:
+			for (auto element : static_cast<Array*>(cell)->m_value)
+				reach_value(element);
+			break;
+		case ValueTag::Record:
+			for (auto const& field : static_cast<Record*>(cell)->m_value)
+				reach_value(field.second);
+			break;
+		case ValueTag::Variant:
+			reach_value(static_cast<Variant*>(cell)->m_inner_value);
+			break;
+		case ValueTag::Function: {
+			auto function = static_cast<Function*>(cell);
+			for (int i = 0; i < function->m_capture_count; ++i)
+				reach_cell(function->captures()[i]);
+			break;
+		}
+		case ValueTag::Variable:
+			reach_value(static_cast<Variable*>(cell)->m_value);
+			break;
+		default:
+			break;
+		}
+	}
+
+	// all the tags go first, so the reader can make every cell before it
+	// fills any of them in. Functions need their capture count to be made
+	write_count(m_cells.size());
+	for (auto cell : m_cells) {
+		write<uint8_t>(static_cast<uint8_t>(cell->type()));
+		if (cell->type() == ValueTag::Function)
+			write_count(static_cast<Function*>(cell)->m_capture_count);
+	}
+	for (auto cell : m_cells)
+		write_cell(cell);
+
+	auto const& globals = env.m_global_scope;
+	int declared_count = 0;
+	for (auto variable : globals.m_variables)
+		if (variable)
+			declared_count += 1;
+
+	write_count(declared_count);
+	for (auto const& slot : globals.m_slots) {
+		auto variable = globals.m_variables[slot.second];
+		if (!variable)
+			continue;
+		write_string(slot.first);
+		write<uint32_t>(m_cell_index.at(variable));
+	}
+}
+
+/*
+ * Reading never trusts the image: every read is bounds checked, and the
+ * first problem makes the whole read fail. Nodes read after that point are
+ * garbage, but they are never handed out.
+ */
+struct ImageReader {
+	char const* m_cursor;
+	char const* m_end;
+	bool m_failed {false};
+	bool m_too_deep {false};
+	// how many nodes the one being read is nested in
+	int m_depth {0};
+	std::vector<InternedString> m_strings;
+	std::vector<AST::FunctionLiteral*> m_functions;
+	std::vector<GcCell*> m_cells;
+	AST::Allocator& m_allocator;
+
+	ImageReader(string_view contents, AST::Allocator& allocator)
+	    : m_cursor {contents.begin()}
+	    , m_end {contents.end()}
+	    , m_allocator {allocator} {}
+
+	void fail() {
+		m_failed = true;
+		m_cursor = m_end;
+	}
+
+	// Held while reading a node, to count how deep we are
+	struct Nested {
+		ImageReader& m_reader;
+
+		explicit Nested(ImageReader& reader)
+		    : m_reader {reader} {
+			if (++m_reader.m_depth > max_node_depth) {
+				m_reader.m_too_deep = true;
+				m_reader.fail();
+			}
+		}
+
+		~Nested() {
+			--m_reader.m_depth;
+		}
+	};
+
+	template <typename T>
+	T read() {
+		T value {};
+		if (static_cast<size_t>(m_end - m_cursor) < sizeof(T)) {
+			fail();
+			return value;
+		}
+		memcpy(&value, m_cursor, sizeof(T));
+		m_cursor += sizeof(T);
+		return value;
+	}
+
+	// every counted element takes at least a byte, which keeps a corrupt
+	// count from making us allocate huge vectors
+	int read_count() {
+		uint32_t count = read<uint32_t>();
+		if (count > m_end - m_cursor) {
+			fail();
+			return 0;
+		}
+		return count;
+	}
+
+	InternedString read_string() {
+		uint32_t index = read<uint32_t>();
+		if (index >= m_strings.size()) {
+			fail();
+			return {};
+		}
+		return m_strings[index];
+	}
+
+	void read_string_table() {
+		int count = read_count();
+		m_strings.reserve(count);
+		for (int i = 0; i < count; ++i) {
+			int length = read_count();
+			if (m_failed)
+				return;
+			m_strings.push_back(InternedString(m_cursor, length));
+			m_cursor += length;
+		}
+	}
+
+	void read_identifier(AST::Identifier* ast) {
+		ast->m_text = read_string();
+		uint8_t origin = read<uint8_t>();
+		if (origin > static_cast<uint8_t>(AST::Identifier::Origin::Local))
+			fail();
+		ast->m_origin = static_cast<AST::Identifier::Origin>(origin);
+		ast->m_frame_offset = read<int32_t>();
+	}
+
+	void read_declaration(AST::Declaration* ast) {
+		ast->m_identifier = read_string();
+		ast->m_frame_offset = read<int32_t>();
+		ast->m_value = read_expr();
+	}
+
+	std::vector<AST::Expr*> read_exprs() {
+		std::vector<AST::Expr*> result(read_count());
+		for (auto& expr : result)
+			expr = read_required_expr();
+		return result;
+	}
+
+	std::vector<InternedString> read_strings() {
+		std::vector<InternedString> result(read_count());
+		for (auto& str : result)
+			str = read_string();
+		return result;
+	}
+
+	AST::Expr* read_required_expr() {
+		AST::Expr* result = read_expr();
+		if (!result)
+			fail();
+		return result;
+	}
+
+	AST::Stmt* read_required_stmt() {
+		AST::Stmt* result = read_stmt();
+		if (!result)
+			fail();
+		return result;
+	}
+
+	AST::Expr* read_expr();
+	AST::Stmt* read_stmt();
+
+	// a heap cell with the given tag, by its number in the snapshot
+	GcCell* read_cell(ValueTag tag) {
+		uint32_t index = read<uint32_t>();
+		if (index >= m_cells.size() || m_cells[index]->type() != tag) {
+			fail();
+			return nullptr;
+		}
+		return m_cells[index];
+	}
+
+	Value read_value();
+	void fill_cell(GcCell* cell);
+	void read_heap(Interpreter& env);
+
+	template <typename T>
+	T* make() {
+		return m_allocator.make<T>();
+	}
+};
+
+AST::Expr* ImageReader::read_expr() {
+	uint8_t tag = read<uint8_t>();
+	if (m_failed || tag == null_node)
+		return nullptr;
+
+	Nested nested {*this};
+	if (m_failed)
+		return nullptr;
+
+	switch (static_cast<ExprTag>(tag)) {
+	case ExprTag::NumberLiteral: {
+		auto ast = make<AST::NumberLiteral>();
+		ast->m_value = read<float>();
+		return ast;
+	}
+	case ExprTag::IntegerLiteral: {
+		auto ast = make<AST::IntegerLiteral>();
+		ast->m_value = read<int32_t>();
+		return ast;
+	}
+	case ExprTag::StringLiteral: {
+		auto ast = make<AST::StringLiteral>();
+		ast->m_text = read_string();
+		return ast;
+	}
+	case ExprTag::BooleanLiteral: {
+		auto ast = make<AST::BooleanLiteral>();
+		ast->m_value = read<uint8_t>();
+		return ast;
+	}
+	case ExprTag::NullLiteral:
+		return make<AST::NullLiteral>();
+	case ExprTag::ArrayLiteral: {
+		auto ast = make<AST::ArrayLiteral>();
+		ast->m_elements = read_exprs();
+		return ast;
+	}
+	case ExprTag::FunctionLiteral: {
+		auto ast = make<AST::FunctionLiteral>();
+		m_functions.push_back(ast);
+		ast->m_args.resize(read_count());
+		for (auto& arg : ast->m_args) {
+			read_declaration(&arg);
+			arg.m_surrounding_function = ast;
+		}
+		int capture_count = read_count();
+		for (int i = 0; i < capture_count; ++i) {
+			InternedString name = read_string();
+			auto& capture = ast->m_captures[name];
+			capture.index = read<int32_t>();
+		}
+		ast->m_capture_sources.resize(capture_count);
+		for (auto& source : ast->m_capture_sources) {
+			source.from_capture = read<uint8_t>();
+			source.offset = read<int32_t>();
+		}
+		ast->m_body = read_required_expr();
+		return ast;
+	}
+	case ExprTag::Identifier: {
+		auto ast = make<AST::Identifier>();
+		read_identifier(ast);
+		return ast;
+	}
+	case ExprTag::CallExpression: {
+		auto ast = make<AST::CallExpression>();
+		ast->m_callee = read_required_expr();
+		ast->m_args = read_exprs();
+		return ast;
+	}
+	case ExprTag::AssignmentExpression: {
+		auto ast = make<AST::AssignmentExpression>();
+		ast->m_target = read_required_expr();
+		ast->m_value = read_required_expr();
+		return ast;
+	}
+	case ExprTag::IndexExpression: {
+		auto ast = make<AST::IndexExpression>();
+		ast->m_callee = read_required_expr();
+		ast->m_index = read_required_expr();
+		return ast;
+	}
+	case ExprTag::AccessExpression: {
+		auto ast = make<AST::AccessExpression>();
+		ast->m_target = read_required_expr();
+		ast->m_member = read_string();
+		return ast;
+	}
+	case ExprTag::MatchExpression: {
+		auto ast = make<AST::MatchExpression>();
+		read_identifier(&ast->m_target);
+		int case_count = read_count();
+		for (int i = 0; i < case_count; ++i) {
+			InternedString constructor = read_string();
+			auto& case_data = ast->m_cases[constructor];
+			read_declaration(&case_data.m_declaration);
+			case_data.m_expression = read_required_expr();
+		}
+		return ast;
+	}
+	case ExprTag::TernaryExpression: {
+		auto ast = make<AST::TernaryExpression>();
+		ast->m_condition = read_required_expr();
+		ast->m_then_expr = read_required_expr();
+		ast->m_else_expr = read_required_expr();
+		return ast;
+	}
+	case ExprTag::ConstructorExpression: {
+		auto ast = make<AST::ConstructorExpression>();
+		ast->m_constructor = read_required_expr();
+		ast->m_args = read_exprs();
+		return ast;
+	}
+	case ExprTag::SequenceExpression: {
+		auto ast = make<AST::SequenceExpression>();
+		AST::Stmt* body = read_required_stmt();
+		if (body && body->tag() != StmtTag::Block)
+			fail();
+		ast->m_body = static_cast<AST::Block*>(body);
+		return ast;
+	}
+	case ExprTag::UnionExpression: {
+		auto ast = make<AST::UnionExpression>();
+		ast->m_constructors = read_strings();
+		return ast;
+	}
+	case ExprTag::StructExpression: {
+		auto ast = make<AST::StructExpression>();
+		ast->m_fields = read_strings();
+		return ast;
+	}
+	case ExprTag::TypeTerm: {
+		auto ast = make<AST::TypeTerm>();
+		ast->m_callee = read_required_expr();
+		return ast;
+	}
+	case ExprTag::BuiltinTypeFunction: {
+		auto ast = make<AST::BuiltinTypeFunction>();
+		ast->m_syntax = read_required_expr();
+		return ast;
+	}
+	}
+
+	fail();
+	return nullptr;
+}
+
+AST::Stmt* ImageReader::read_stmt() {
+	uint8_t tag = read<uint8_t>();
+	if (m_failed || tag == null_node)
+		return nullptr;
+
+	Nested nested {*this};
+	if (m_failed)
+		return nullptr;
+
+	switch (static_cast<StmtTag>(tag)) {
+	case StmtTag::Block: {
+		auto ast = make<AST::Block>();
+		ast->m_body.resize(read_count());
+		for (auto& stmt : ast->m_body)
+			stmt = read_required_stmt();
+		return ast;
+	}
+	case StmtTag::ReturnStatement: {
+		auto ast = make<AST::ReturnStatement>();
+		ast->m_value = read_required_expr();
+		return ast;
+	}
+	case StmtTag::IfElseStatement: {
+		auto ast = make<AST::IfElseStatement>();
+		ast->m_condition = read_required_expr();
+		ast->m_body = read_required_stmt();
+		ast->m_else_body = read_stmt();
+		return ast;
+	}
+	case StmtTag::WhileStatement: {
+		auto ast = make<AST::WhileStatement>();
+		ast->m_condition = read_required_expr();
+		ast->m_body = read_required_stmt();
+		return ast;
+	}
+	case StmtTag::ExpressionStatement:
+		return m_allocator.make<AST::ExpressionStatement>(read_required_expr());
+	case StmtTag::Declaration: {
+		auto ast = make<AST::Declaration>();
+		read_declaration(ast);
+		return ast;
+	}
+	}
+
+	fail();
+	return nullptr;
+}
+
+Value ImageReader::read_value() {
+	auto tag = static_cast<ValueTag>(read<uint8_t>());
+	if (m_failed)
+		return Value {};
+
+	switch (tag) {
+	case ValueTag::Null:
+		return Value {};
+	case ValueTag::Integer:
+		return Value {static_cast<int>(read<int32_t>())};
+	case ValueTag::Float:
+		return Value {read<float>()};
+	case ValueTag::Boolean:
+		return Value {read<uint8_t>() != 0};
+	case ValueTag::NativeFunction: {
+		NativeFunction* func = native_function_named(read_string().str());
+		if (!func) {
+			fail();
+			return Value {};
+		}
+		return Value {func};
+	}
+	case ValueTag::String:
+	case ValueTag::Array:
+	case ValueTag::Record:
+	case ValueTag::Variant:
+	case ValueTag::Function:
+	case ValueTag::Variable:
+	case ValueTag::VariantConstructor:
+	case ValueTag::RecordConstructor: {
+		GcCell* cell = read_cell(tag);
+		return cell ? Value {cell} : Value {};
+	}
+	}
+
+	fail();
+	return Value {};
+}
+
+void ImageReader::fill_cell(GcCell* cell) {
+	switch (cell->type()) {
+	case ValueTag::String: {
+		int length = read_count();
+		static_cast<String*>(cell)->m_value.assign(m_cursor, length);
+		m_cursor += length;
+		return;
+	}
+	case ValueTag::Array: {
+		auto& elements = static_cast<Array*>(cell)->m_value;
+		elements.resize(read_count());
+		for (auto& element : elements)
+			element = read_value();
+		return;
+	}
+	case ValueTag::Record: {
+		auto& fields = static_cast<Record*>(cell)->m_value;
+		int count = read_count();
+		for (int i = 0; i < count; ++i) {
+			InternedString name = read_string();
+			fields[name] = read_value();
+		}
+		return;
+	}
+	case ValueTag::Variant: {
+		auto variant = static_cast<Variant*>(cell);
+		variant->m_constructor = read_string();
+		variant->m_inner_value = read_value();
+		return;
+	}
+	case ValueTag::Function: {
+		auto function = static_cast<Function*>(cell);
+		uint32_t index = read<uint32_t>();
+		if (index >= m_functions.size()) {
+			fail();
+			return;
+		}
+		function->m_def = m_functions[index];
+		for (int i = 0; i < function->m_capture_count; ++i)
+			function->captures()[i] = static_cast<Variable*>(read_cell(ValueTag::Variable));
+		return;
+	}
+	case ValueTag::Variable:
+		static_cast<Variable*>(cell)->m_value = read_value();
+		return;
+	case ValueTag::VariantConstructor:
+		static_cast<VariantConstructor*>(cell)->m_constructor = read_string();
+		return;
+	case ValueTag::RecordConstructor:
+		static_cast<RecordConstructor*>(cell)->m_keys = read_strings();
+		return;
+	default:
+		fail();
+		return;
+	}
+}
+
+void ImageReader::read_heap(Interpreter& env) {
+	GC& gc = *env.m_gc;
+
+	// make every cell first, so cells can refer to any other one, even
+	// if it comes later
+	m_cells.resize(read_count());
+	for (auto& cell : m_cells) {
+		auto tag = static_cast<ValueTag>(read<uint8_t>());
+		switch (tag) {
+		case ValueTag::String: cell = gc.new_string_raw({}); break;
+		case ValueTag::Array: cell = gc.new_list_raw({}); break;
+		case ValueTag::Record: cell = gc.new_record_raw({}); break;
+		case ValueTag::Variant: cell = gc.new_variant_raw({}, Value {}); break;
+		case ValueTag::Function: cell = gc.new_function_raw(nullptr, read_count()); break;
+		case ValueTag::Variable: cell = gc.new_variable_raw(Value {}); break;
+		case ValueTag::VariantConstructor: cell = gc.new_variant_constructor_raw({}); break;
+		case ValueTag::RecordConstructor: cell = gc.new_record_constructor_raw({}); break;
+		default:
+			fail();
+			return;
+		}
+	}
+
+	for (auto cell : m_cells) {
+		fill_cell(cell);
+		if (m_failed)
+			return;
+	}
+
+	int global_count = read_count();
+	for (int i = 0; i < global_count; ++i) {
+		InternedString name = read_string();
+		auto variable = static_cast<Variable*>(read_cell(ValueTag::Variable));
+		if (m_failed || env.global_access(name)) {
+			fail();
+			return;
+		}
+		env.global_declare_direct(name, variable);
+	}
+}
+
+} // namespace
+
+ErrorReport write_image(
+    char const* path,
+    DeclarationOrder const& declaration_order,
+    Interpreter* initialized) {
+	ImageWriter writer;
+
+	writer.write_count(declaration_order.size());
+	for (auto const& component : declaration_order) {
+		writer.write_count(component.size());
+		for (auto decl : component) {
+			writer.write_string(decl->identifier_text());
+			writer.write_expr(decl->m_value);
+		}
+	}
+
+	writer.write<uint8_t>(initialized != nullptr);
+	if (initialized)
+		writer.write_heap(*initialized);
+	if (!writer.m_error.ok())
+		return writer.m_error;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+	file.write(image_magic, sizeof(image_magic));
+	file.write(reinterpret_cast<char const*>(&image_version), sizeof(image_version));
+
+	uint32_t string_count = writer.m_strings.size();
+	file.write(reinterpret_cast<char const*>(&string_count), sizeof(string_count));
+	for (auto const& str : writer.m_strings) {
+		uint32_t length = str.size();
+		file.write(reinterpret_cast<char const*>(&length), sizeof(length));
+		file.write(str.c_str(), length);
+	}
+
+	file.write(writer.m_body.data(), writer.m_body.size());
+
+	if (!file)
+		return {"Failed to write a program image to '" + std::string(path) + "'"};
+	return {};
+}
+
+Writer<LoadedImage> read_image(
+    string_view contents, AST::Allocator& allocator, Interpreter& env) {
+	if (!is_image(contents))
+		return ErrorReport {"Not a program image"};
+
+	ImageReader reader {contents, allocator};
+	reader.m_cursor += sizeof(image_magic);
+
+	if (reader.read<uint32_t>() != image_version)
+		return ErrorReport {"The program image was written by a different version"};
+
+	reader.read_string_table();
+
+	LoadedImage result;
+	result.m_declaration_order.resize(reader.read_count());
+	for (auto& component : result.m_declaration_order) {
+		component.resize(reader.read_count());
+		for (auto& decl : component) {
+			decl = allocator.make<AST::Declaration>();
+			decl->m_identifier = reader.read_string();
+			decl->m_value = reader.read_required_expr();
+		}
+	}
+
+	result.m_restored_heap = reader.read<uint8_t>() != 0;
+	if (result.m_restored_heap)
+		reader.read_heap(env);
+
+	if (reader.m_too_deep)
+		return ErrorReport {"The program image is nested too deeply"};
+	if (reader.m_failed || reader.m_cursor != reader.m_end)
+		return ErrorReport {"The program image is corrupt"};
+
+	return Writer<LoadedImage> {{}, std::move(result)};
+}
+
+} // namespace Interpreter
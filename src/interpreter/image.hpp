@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../utils/error_report.hpp"
+#include "../utils/string_view.hpp"
+#include "../utils/writer.hpp"
+
+#include <vector>
+
+namespace AST {
+struct Allocator;
+struct Declaration;
+}
+
+namespace Interpreter {
+
+struct Interpreter;
+
+using DeclarationOrder = std::vector<std::vector<AST::Declaration*>>;
+
+/*
+ * A program image holds what the evaluator needs to run a program that went
+ * through the whole front end: its global declarations in evaluation order,
+ * with every expression already resolved and laid out in frames.
+ *
+ * An image starts with a magic string and a format version, followed by a
+ * table of every string it uses, and then the declarations. Numbers are
+ * stored in the native byte order, so images are only meant to be loaded
+ * on the kind of machine that wrote them.
+ *
+ * It can also end with a snapshot of the heap, taken after the global
+ * declarations ran: every cell reachable from a global, numbered, with
+ * references between cells stored as numbers. Loading the image restores
+ * the globals from it instead of running the declarations again, so their
+ * side effects don't happen again either.
+ */
+
+bool is_image(string_view contents);
+
+// When `initialized` is given, its globals go in the heap snapshot
+ErrorReport write_image(
+    char const* path,
+    DeclarationOrder const& declaration_order,
+    Interpreter* initialized = nullptr);
+
+struct LoadedImage {
+	DeclarationOrder m_declaration_order;
+	// whether the globals came from a heap snapshot, and are ready to use
+	bool m_restored_heap {false};
+};
+
+// Rebuilds the declarations of an image. The nodes are made with the given
+// allocator, and don't refer back to the contents of the image. If there is
+// a heap snapshot, it's restored into the globals of `env`.
+Writer<LoadedImage> read_image(
+    string_view contents, AST::Allocator& allocator, Interpreter& env);
+
+} // namespace Interpreter
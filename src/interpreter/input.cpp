@@ -0,0 +1,147 @@
+#include "input.hpp"
+
+#include "output.hpp"
+
+#include <string>
+
+#include <cstdlib>
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+
+namespace Interpreter {
+
+static bool is_space(char c) {
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+InputBuffer::InputBuffer(int fd, size_t chunk_size)
+    : m_fd {fd}
+    , m_chunk_size {chunk_size} {}
+
+InputBuffer& InputBuffer::standard_input() {
+	static InputBuffer buffer {0};
+	return buffer;
+}
+
+bool InputBuffer::fill(OutputBuffer* tied) {
+	if (m_eof)
+		return false;
+
+	if (tied)
+		tied->flush();
+
+	if (m_begin != 0) {
+		std::memmove(m_data.data(), m_data.data() + m_begin, m_end - m_begin);
+		m_end -= m_begin;
+		m_begin = 0;
+	}
+
+	if (m_data.empty())
+		m_data.resize(m_chunk_size);
+	else if (m_end == m_data.size())
+		m_data.resize(m_data.size() * 2);
+
+	while (true) {
+		auto got = ::read(m_fd, m_data.data() + m_end, m_data.size() - m_end);
+		if (got < 0 && errno == EINTR)
+			continue;
+		// errors end the input, same as reaching the end of the file
+		if (got <= 0) {
+			m_eof = true;
+			return false;
+		}
+		m_end += got;
+		return true;
+	}
+}
+
+bool InputBuffer::read_line(string_view& line, OutputBuffer* tied) {
+	size_t scanned = 0;
+	while (true) {
+		char const* start = m_data.data() + m_begin;
+		auto newline = static_cast<char const*>(
+		    std::memchr(start + scanned, '\n', m_end - m_begin - scanned));
+
+		if (newline) {
+			line = {start, size_t(newline - start)};
+			m_begin += line.size() + 1;
+			return true;
+		}
+
+		scanned = m_end - m_begin;
+		if (!fill(tied))
+			break;
+	}
+
+	// the last line doesn't need to end in a newline
+	if (m_begin == m_end)
+		return false;
+
+	line = {m_data.data() + m_begin, m_end - m_begin};
+	m_begin = m_end;
+	return true;
+}
+
+bool InputBuffer::read_token(string_view& token, OutputBuffer* tied) {
+	while (true) {
+		while (m_begin != m_end && is_space(m_data[m_begin]))
+			m_begin += 1;
+		if (m_begin != m_end)
+			break;
+		if (!fill(tied))
+			return false;
+	}
+
+	size_t length = 0;
+	while (true) {
+		while (m_begin + length != m_end && !is_space(m_data[m_begin + length]))
+			length += 1;
+		if (m_begin + length != m_end || !fill(tied))
+			break;
+	}
+
+	token = {m_data.data() + m_begin, length};
+	m_begin += length;
+	return true;
+}
+
+int InputBuffer::read_integer(OutputBuffer* tied) {
+	string_view token;
+	if (!read_token(token, tied))
+		return 0;
+
+	int i = 0;
+	bool negative = false;
+	if (i != token.size() && (token[i] == '-' || token[i] == '+')) {
+		negative = token[i] == '-';
+		i += 1;
+	}
+
+	// accumulates as unsigned, so INT_MIN doesn't overflow on the way
+	unsigned int magnitude = 0;
+	for (; i != token.size() && '0' <= token[i] && token[i] <= '9'; ++i)
+		magnitude = magnitude * 10 + unsigned(token[i] - '0');
+
+	return negative ? int(0u - magnitude) : int(magnitude);
+}
+
+float InputBuffer::read_number(OutputBuffer* tied) {
+	string_view token;
+	if (!read_token(token, tied))
+		return 0;
+
+	// strtof wants a NUL-terminated string, and numbers are short, so we
+	// copy them to the stack
+	char digits[64];
+	if (token.size() < int(sizeof(digits))) {
+		std::memcpy(digits, token.data(), token.size());
+		digits[token.size()] = '\0';
+		return std::strtof(digits, nullptr);
+	}
+
+	return std::strtof(token.to_string().c_str(), nullptr);
+}
+
+} // namespace Interpreter
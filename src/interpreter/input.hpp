@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../utils/string_view.hpp"
+
+#include <mutex>
+#include <vector>
+
+#include <cstddef>
+
+namespace Interpreter {
+
+struct OutputBuffer;
+
+/*
+ * Where an interpreter's input comes from. It reads the file in big
+ * chunks with read(2), and hands out lines and tokens as views into its
+ * buffer, which stay valid until the next read. Numbers are parsed right
+ * out of the buffer.
+ *
+ * A line or a token that doesn't fit makes the buffer grow, so nothing is
+ * ever cut in two. Tokens are separated by whitespace, like iostreams do.
+ *
+ * Since it reads ahead, there should only be one buffer for each file, and
+ * everyone that reads the file should go through it. Readers on different
+ * threads hold the mutex while they read, and while they use the views
+ * they got. Nothing else in the buffer changes without it.
+ *
+ * Like cin is tied to cout, each read can name an output buffer, which is
+ * flushed before every read(2) that could block. It's an argument rather
+ * than a member, because readers on different threads have different
+ * outputs.
+ */
+struct InputBuffer {
+	int m_fd;
+	// how much is read at a time. The buffer is only allocated once
+	// something is read.
+	size_t m_chunk_size;
+	std::vector<char> m_data;
+	// the bytes that were read but not handed out yet
+	size_t m_begin {0};
+	size_t m_end {0};
+	bool m_eof {false};
+	std::mutex m_mutex;
+
+	explicit InputBuffer(int fd = 0, size_t chunk_size = 1 << 16);
+	InputBuffer(InputBuffer const&) = delete;
+	InputBuffer& operator=(InputBuffer const&) = delete;
+
+	// the buffer for stdin, shared by the whole process
+	static InputBuffer& standard_input();
+
+	// The next line, without its newline. False at the end of the input.
+	bool read_line(string_view& line, OutputBuffer* tied = nullptr);
+	// The next run of non-whitespace characters. False at the end of the
+	// input.
+	bool read_token(string_view& token, OutputBuffer* tied = nullptr);
+
+	// Parse the next token. They read a zero when there are no more tokens,
+	// or when the token doesn't start with a number.
+	int read_integer(OutputBuffer* tied = nullptr);
+	float read_number(OutputBuffer* tied = nullptr);
+
+  private:
+	// Reads more of the file, keeping the bytes that weren't handed out.
+	// False if there was nothing more to read.
+	bool fill(OutputBuffer* tied);
+};
+
+} // namespace Interpreter
@@ -3,24 +3,41 @@
 #include <cassert>
 
 #include "garbage_collector.hpp"
+#include "native.hpp"
 #include "utils.hpp"
 
 namespace Interpreter {
 
+int GlobalScope::slot(const Identifier& i) {
+	auto insertion_result = m_slots.insert({i, int(m_variables.size())});
+	if (insertion_result.second)
+		m_variables.push_back(nullptr);
+	return insertion_result.first->second;
+}
+
 void GlobalScope::declare(const Identifier& i, Variable* v) {
-	auto insertion_result = m_declarations.insert({i, v});
-	assert(insertion_result.second);
+	auto& variable = m_variables[slot(i)];
+	assert(!variable);
+	variable = v;
 }
 
 Variable* GlobalScope::access(const Identifier& i) {
-	auto v = m_declarations.find(i);
+	auto v = m_slots.find(i);
 
-	if (v == m_declarations.end()) {
+	if (v == m_slots.end()) {
 		// TODO: error
 		return nullptr;
 	}
 
-	return v->second;
+	return m_variables[v->second];
+}
+
+Interpreter::Interpreter(
+    GC* gc,
+    std::vector<std::vector<AST::Declaration*>> const* declaration_order)
+    : m_gc {gc}
+    , m_declaration_order {declaration_order} {
+	reserve_native_slots(m_global_scope);
 }
 
 void Interpreter::global_declare_direct(const Identifier& i, Variable* r) {
@@ -38,6 +55,10 @@ Variable* Interpreter::global_access(const Identifier& i) {
 	return m_global_scope.access(i);
 }
 
+int Interpreter::global_slot(const Identifier& i) {
+	return m_global_scope.slot(i);
+}
+
 
 void Interpreter::save_return_value(Value v) {
 	// ensure we are not in a return sequence already
@@ -66,8 +87,9 @@ void Interpreter::run_gc() {
 		}
 	});
 
-	for (auto& p : m_global_scope.m_declarations)
-		p.second->visit();
+	for (auto variable : m_global_scope.m_variables)
+		if (variable)
+			variable->visit();
 
 	m_gc->sweep();
 }
@@ -77,6 +99,17 @@ void Interpreter::run_gc_if_needed(){
 		run_gc();
 		m_gc_size_on_last_pass = m_gc->size();
 	}
+	check_heap_limit();
+}
+
+void Interpreter::check_heap_limit() {
+	if (!m_gc->over_heap_limit())
+		return;
+
+	run_gc();
+	m_gc_size_on_last_pass = m_gc->size();
+	if (m_gc->over_heap_limit())
+		throw BudgetExceeded {BudgetExceeded::Kind::Heap};
 }
 
 
@@ -126,8 +159,8 @@ void Interpreter::push_record(RecordType declarations) {
 	run_gc_if_needed();
 }
 
-void Interpreter::push_function(FunctionType def, CapturesType s) {
-	m_stack.push(Value{m_gc->new_function_raw(def, std::move(s))});
+void Interpreter::push_function(FunctionType def, int capture_count) {
+	m_stack.push(Value{m_gc->new_function_raw(def, capture_count)});
 	run_gc_if_needed();
 }
 
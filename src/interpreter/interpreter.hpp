@@ -1,10 +1,16 @@
 #pragma once
 
+#include "budget.hpp"
+#include "code_cache.hpp"
+#include "input.hpp"
+#include "output.hpp"
 #include "stack.hpp"
 #include "value.hpp"
 
 #include <map>
 
+#include <climits>
+
 namespace AST {
 struct Declaration;
 }
@@ -16,12 +22,29 @@ struct TypeChecker;
 namespace Interpreter {
 
 struct GC;
+struct LazyProgram;
+struct Task;
 
+/*
+ * Globals live in a flat table, indexed by slot. Names map to slots, and
+ * identifiers are bound to the slot of the name they refer to before they
+ * run, so they never pay for the lookup.
+ *
+ * A slot is made the first time a name is declared or looked up, and is
+ * empty (nullptr) until the name is declared. The natives always take the
+ * first slots, and the program's globals follow in declaration order, so
+ * a program gets the same slots every time it runs.
+ */
 struct GlobalScope {
-	std::map<InternedString, Variable*> m_declarations;
+	std::map<InternedString, int> m_slots;
+	std::vector<Variable*> m_variables;
 
+	int slot(const Identifier& i);
 	void declare(const Identifier& i, Variable* v);
 	Variable* access(const Identifier& i);
+	Variable* access(int slot) {
+		return m_variables[slot];
+	}
 };
 
 struct Interpreter {
@@ -32,23 +55,56 @@ struct Interpreter {
 	bool m_returning{false};
 	Value m_return_value {nullptr};
 	GlobalScope m_global_scope;
+	Bytecode::CodeCache m_code_cache;
+	// Every call and every iteration of a loop burns a unit of fuel, and
+	// running out throws BudgetExceeded. There's no limit by default.
+	long long m_fuel {LLONG_MAX};
+	// The task the interpreter is running in, if any
+	Task* m_task {nullptr};
+	// Where print writes to. Flushed when the interpreter is destroyed.
+	OutputBuffer m_output;
+	// Where the input natives read from, when not running in a task. All
+	// interpreters share the one for stdin, so none of them reads ahead
+	// what the others should get. A host that wants an isolate to read
+	// something else points this at its own buffer.
+	InputBuffer* m_input {&InputBuffer::standard_input()};
+
+	// In lazy mode, the top level functions that weren't parsed up front.
+	// eval_expression parses them once an expression refers to them.
+	LazyProgram* m_lazy_program {nullptr};
 
+	// The natives get the first slots of the globals, so every interpreter
+	// has them in the same place
 	Interpreter(
 	    GC* gc,
-	    std::vector<std::vector<AST::Declaration*>> const* declaration_order)
-	    : m_gc {gc}
-	    , m_declaration_order {declaration_order} {}
+	    std::vector<std::vector<AST::Declaration*>> const* declaration_order);
 
 	void save_return_value(Value);
 	Value fetch_return_value();
 
 	void run_gc();
 	void run_gc_if_needed();
+	// Collects if the heap went over its limit, and throws BudgetExceeded
+	// if it's still over after that. It can only be called where run_gc
+	// could.
+	void check_heap_limit();
+
+	// Called on every call and every iteration of a loop, where nothing is
+	// held outside the stack, so it's also where the heap limit is checked
+	void burn_fuel() {
+		if (--m_fuel < 0)
+			throw BudgetExceeded {BudgetExceeded::Kind::Fuel};
+		check_heap_limit();
+	}
 
 	// Binds a global name to the given variable
 	void global_declare_direct(const Identifier& i, Variable* v);
 	void global_declare(const Identifier& i, Value v);
 	Variable* global_access(const Identifier& i);
+	int global_slot(const Identifier& i);
+	Variable* global_access(int slot) {
+		return m_global_scope.access(slot);
+	}
 
 	auto null() -> Value;
 	void push_integer(int);
@@ -60,7 +116,7 @@ struct Interpreter {
 	void push_list(ArrayType);
 	void push_variant(InternedString constructor, Value);
 	void push_record(RecordType);
-	void push_function(FunctionType, CapturesType);
+	void push_function(FunctionType, int capture_count);
 	void push_variable(Value);
 };
 
@@ -0,0 +1,233 @@
+#include "isolate.hpp"
+
+#include "../ast.hpp"
+#include "../compute_offsets.hpp"
+#include "../convert_ast.hpp"
+#include "../fold_constants.hpp"
+#include "../frontend_context.hpp"
+#include "../inline_functions.hpp"
+#include "../parser.hpp"
+#include "../symbol_resolution.hpp"
+#include "../typechecker/check_cache.hpp"
+#include "../typechecker/ct_eval.hpp"
+#include "../typechecker/metacheck.hpp"
+#include "../typechecker/typecheck.hpp"
+#include "budget.hpp"
+#include "eval.hpp"
+#include "global_slots.hpp"
+#include "native.hpp"
+#include "utils.hpp"
+
+namespace Interpreter {
+
+ExitStatus load_program(
+    string_view source, ExecuteSettings const& settings, CompiledProgram& program) {
+	program.m_source = source.to_string();
+
+	Frontend::Context file_context {program.m_source};
+
+	auto parse_result = settings.lazy_declarations
+	    ? parse_program_lazily(
+	          file_context, program.m_cst_allocator, settings.entry_point, program.m_skipped)
+	    : parse_program(file_context, program.m_cst_allocator);
+
+	if (not parse_result.ok()) {
+		parse_result.error().print();
+		return ExitStatus::ParseError;
+	}
+
+	if (settings.dump_cst)
+		print(parse_result.cst(), 1);
+
+	auto ast = AST::convert_program(parse_result.cst(), program.m_ast_allocator);
+	program.m_ast = ast;
+
+	auto& tc = program.m_tc;
+	auto& context = program.m_context;
+
+	{
+		for (auto& bucket : tc.m_builtin_declarations.m_buckets)
+			for (auto& decl : bucket)
+				context.declare(&decl);
+		auto err = Frontend::resolve_symbols_program(ast, parse_result.file_context(), context);
+		if (!err.ok()) {
+			err.print();
+			return ExitStatus::StaticError;
+		}
+	}
+
+	tc.compute_declaration_order(ast);
+
+	if (settings.typecheck) {
+		TypeChecker::metacheck_program(ast);
+		TypeChecker::reify_types(ast, tc);
+
+		if (settings.check_cache) {
+			auto cache = TypeChecker::load_check_cache(settings.check_cache);
+			auto fingerprints = TypeChecker::fingerprint_components(tc);
+			auto needs_check = TypeChecker::components_to_check(tc, fingerprints, cache);
+			if (!TypeChecker::restore_cached_types(tc, fingerprints, cache, needs_check))
+				needs_check.assign(needs_check.size(), true);
+			TypeChecker::typecheck_program(ast, tc, needs_check, settings.typecheck_threads);
+
+			// a stale cache only costs time, so we keep going
+			auto err = TypeChecker::save_check_cache(
+			    settings.check_cache, tc, fingerprints, cache);
+			if (!err.ok())
+				err.print();
+		} else {
+			TypeChecker::typecheck_program(ast, tc, settings.typecheck_threads);
+		}
+	}
+
+	// a declaration loaded later could assign to a global we took to be
+	// constant, so we neither inline nor fold when declarations are loaded
+	// lazily
+	if (settings.inline_functions && !settings.lazy_declarations)
+		TypeChecker::inline_functions_program(ast, tc, settings.inline_size_limit);
+
+	if (settings.fold_constants && !settings.lazy_declarations)
+		TypeChecker::fold_constants_program(ast, tc);
+
+	TypeChecker::compute_offsets_program(ast, 0);
+
+	return ExitStatus::Ok;
+}
+
+namespace {
+
+// Lays out the globals the way every isolate will, using an interpreter
+// that doesn't run anything, and compiles the functions ahead
+void link_program(CompiledProgram& program) {
+	GC gc;
+	Interpreter env = {&gc, &program.m_tc.declaration_order()};
+
+	std::vector<AST::FunctionLiteral*> functions;
+	bind_global_slots(program.m_tc.declaration_order(), env.m_global_scope, &functions);
+
+	for (auto function : functions)
+		program.m_code.compile_ahead(function, env);
+
+	program.m_global_slots = env.m_global_scope.m_slots;
+	program.m_linked = true;
+}
+
+} // namespace
+
+ExitStatus compile_program(
+    string_view source, ExecuteSettings const& settings, CompiledProgram& program) {
+	ExecuteSettings eager_settings = settings;
+	eager_settings.lazy_declarations = false;
+
+	auto status = load_program(source, eager_settings, program);
+	if (status != ExitStatus::Ok)
+		return status;
+
+	link_program(program);
+	return ExitStatus::Ok;
+}
+
+Isolate::Isolate(CompiledProgram const& program)
+    : m_program {&program}
+    , m_env {&m_gc, &program.m_tc.declaration_order()}
+    , m_context {program.m_context} {
+	assert(program.m_linked);
+
+	m_env.m_global_scope.m_slots = program.m_global_slots;
+	m_env.m_global_scope.m_variables.resize(program.m_global_slots.size(), nullptr);
+	m_env.m_code_cache.m_shared = &program.m_code;
+
+	declare_native_functions(m_env);
+	::Interpreter::run(program.m_ast, m_env);
+
+	m_gc.set_watermark();
+	m_saved_gc_size_on_last_pass = m_env.m_gc_size_on_last_pass;
+	for (auto cell : m_gc.m_blocks) {
+		switch (cell->type()) {
+		case ValueTag::Variable: {
+			auto variable = static_cast<Variable*>(cell);
+			m_saved_variables.push_back({variable, variable->m_value});
+			break;
+		}
+		case ValueTag::Array: {
+			auto array = static_cast<Array*>(cell);
+			m_saved_arrays.push_back({array, array->m_value});
+			break;
+		}
+		case ValueTag::Record: {
+			auto record = static_cast<Record*>(cell);
+			m_saved_records.push_back({record, record->m_value});
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
+
+void Isolate::set_budget(long long max_steps, size_t max_heap_bytes) {
+	m_env.m_fuel = max_steps != 0 ? max_steps : LLONG_MAX;
+	m_gc.m_heap_limit = max_heap_bytes;
+}
+
+ExitStatus Isolate::run(Runner* runner) {
+	ExitStatus status;
+	try {
+		status = runner(m_env, m_context);
+	} catch (BudgetExceeded const&) {
+		status = ExitStatus::BudgetExceeded;
+	}
+	// whatever the run printed is written out before the host goes on
+	m_env.m_output.flush();
+	return status;
+}
+
+Value Isolate::eval(std::string const& expr) {
+	return eval_expression(expr, m_env, m_context);
+}
+
+void Isolate::reset() {
+	m_env.m_output.flush();
+
+	for (auto& saved : m_saved_variables)
+		saved.first->m_value = saved.second;
+	for (auto& saved : m_saved_arrays)
+		saved.first->m_value = saved.second;
+	for (auto& saved : m_saved_records)
+		saved.first->m_value = saved.second;
+
+	m_gc.rewind();
+	m_env.m_stack.clear();
+	m_env.m_gc_size_on_last_pass = m_saved_gc_size_on_last_pass;
+	m_env.m_returning = false;
+	m_env.m_return_value = m_env.null();
+}
+
+IsolatePool::IsolatePool(CompiledProgram const& program, int initial_size)
+    : m_program {&program} {
+	for (int i = 0; i < initial_size; ++i)
+		m_free.push_back(std::make_unique<Isolate>(program));
+}
+
+std::unique_ptr<Isolate> IsolatePool::acquire() {
+	{
+		std::lock_guard<std::mutex> lock {m_mutex};
+		if (!m_free.empty()) {
+			auto isolate = std::move(m_free.back());
+			m_free.pop_back();
+			return isolate;
+		}
+	}
+
+	return std::make_unique<Isolate>(*m_program);
+}
+
+void IsolatePool::release(std::unique_ptr<Isolate> isolate) {
+	assert(isolate->m_program == m_program);
+	isolate->reset();
+
+	std::lock_guard<std::mutex> lock {m_mutex};
+	m_free.push_back(std::move(isolate));
+}
+
+} // namespace Interpreter
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "../ast_allocator.hpp"
+#include "../cst_allocator.hpp"
+#include "../parser.hpp"
+#include "../symbol_table.hpp"
+#include "../typechecker/typechecker.hpp"
+#include "../utils/string_view.hpp"
+#include "code_cache.hpp"
+#include "execute.hpp"
+#include "garbage_collector.hpp"
+#include "interpreter.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Interpreter {
+
+/*
+ * A program that went through the front end once, and can then be run by
+ * any number of isolates.
+ *
+ * compile_program also links it: the slot of every global is fixed, every
+ * identifier is bound to its slot, and every function that can be compiled
+ * to bytecode is compiled. After that, nothing in the program changes, so
+ * isolates can share it from different threads without locking.
+ */
+struct CompiledProgram {
+	// the program owns a copy of its source, which the AST points into
+	std::string m_source;
+	CST::Allocator m_cst_allocator;
+	AST::Allocator m_ast_allocator;
+	TypeChecker::TypeChecker m_tc {m_ast_allocator};
+	Frontend::SymbolTable m_context;
+	AST::Program* m_ast {nullptr};
+
+	// With ExecuteSettings::lazy_declarations, the top level functions the
+	// entry point can't reach, which execute loads if something refers to
+	// them later
+	SkippedDeclarations m_skipped;
+
+	// Filled in when linking
+	bool m_linked {false};
+	std::map<InternedString, int> m_global_slots;
+	Bytecode::CodeCache m_code;
+
+	CompiledProgram() = default;
+	CompiledProgram(CompiledProgram const&) = delete;
+	CompiledProgram& operator=(CompiledProgram const&) = delete;
+};
+
+// Runs the front end over the source, as execute does, and leaves the
+// result in the given program, which must be empty. The program is not
+// linked, so it can't be run by isolates.
+ExitStatus load_program(string_view source, ExecuteSettings const&, CompiledProgram&);
+
+// Loads the program, and links it so isolates can run it. Settings that
+// don't have to do with the front end are ignored. Every declaration is
+// loaded eagerly, since isolates can't add to a program they share.
+ExitStatus compile_program(string_view source, ExecuteSettings const&, CompiledProgram&);
+
+/*
+ * An interpreter of its own for a linked program: the stack, the heap and
+ * the values of the globals belong to the isolate, while the AST and the
+ * bytecode belong to the program, which must outlive it.
+ *
+ * Isolates of the same program can run at the same time on different
+ * threads, but each isolate must only be used by one thread at a time.
+ *
+ * Once the globals are declared, the heap is pinned and the contents of
+ * its mutable cells are saved, so reset can bring the isolate back to that
+ * point without running anything again.
+ */
+struct Isolate {
+	CompiledProgram const* m_program;
+	GC m_gc;
+	Interpreter m_env;
+	Frontend::SymbolTable m_context;
+
+	// what the mutable cells below the heap's watermark held
+	std::vector<std::pair<Variable*, Value>> m_saved_variables;
+	std::vector<std::pair<Array*, ArrayType>> m_saved_arrays;
+	std::vector<std::pair<Record*, RecordType>> m_saved_records;
+	int m_saved_gc_size_on_last_pass;
+
+	// Declares the natives and runs the declarations of the globals
+	explicit Isolate(CompiledProgram const&);
+	Isolate(Isolate const&) = delete;
+	Isolate& operator=(Isolate const&) = delete;
+
+	// Limits what the code run from now on can use, the way
+	// ExecuteSettings::max_steps and max_heap_bytes do. The fuel isn't
+	// given back by reset.
+	void set_budget(long long max_steps, size_t max_heap_bytes);
+
+	// Returns ExitStatus::BudgetExceeded if the runner goes over budget
+	ExitStatus run(Runner* runner);
+
+	// evaluates an expression, which can refer to the program's globals,
+	// and returns the resulting value. Going over budget throws
+	// BudgetExceeded.
+	Value eval(std::string const& expr);
+
+	// Goes back to how the isolate was right after its globals were
+	// declared. Values that were handed out since then are freed. This is
+	// also how an isolate that went over budget is made usable again.
+	void reset();
+};
+
+/*
+ * Isolates of one program, kept around between uses. acquire hands out
+ * an isolate in the state its globals' declarations left it in, and only
+ * makes a new one if every isolate in the pool is in use. release resets
+ * the isolate and puts it back. Both can be called from any thread.
+ */
+struct IsolatePool {
+	CompiledProgram const* m_program;
+	std::mutex m_mutex;
+	std::vector<std::unique_ptr<Isolate>> m_free;
+
+	explicit IsolatePool(CompiledProgram const&, int initial_size = 0);
+
+	std::unique_ptr<Isolate> acquire();
+	void release(std::unique_ptr<Isolate>);
+};
+
+} // namespace Interpreter
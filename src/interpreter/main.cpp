@@ -1,71 +1,137 @@
-#include <fstream>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
-#include <string>
 
 #include "../ast.hpp"
 #include "../ast_allocator.hpp"
 #include "../convert_ast.hpp"
 #include "../cst_allocator.hpp"
 #include "../frontend_context.hpp"
-#include "../lexer.hpp"
 #include "../parser.hpp"
 #include "../symbol_table.hpp"
+#include "../utils/file_contents.hpp"
 #include "eval.hpp"
 #include "execute.hpp"
 #include "exit_status_tag.hpp"
+#include "global_slots.hpp"
+#include "image.hpp"
 #include "interpreter.hpp"
 #include "value.hpp"
 
+// set by --code-stats
+static bool show_code_stats = false;
+
 int main(int argc, char** argv) {
 
-	if (argc < 2) {
-		std::cout << "Argument missing: source file" << std::endl;
-		return 1;
+	// With --lazy, we only process the functions the program can reach, and
+	// errors in the others go unreported. With --check, we stop after the
+	// static checks, and don't run anything. With --cache <file>, we skip
+	// inference for declarations that passed it in an earlier run and
+	// haven't changed since. --typecheck-threads <n> infers independent
+	// declarations on n threads. With --compile-to <file>, we write a program
+	// image instead of running, and a later run given that image skips the
+	// front end. Adding --snapshot runs the global declarations before writing
+	// the image, and stores the heap they build.
+	// --no-inline keeps every call a call, which helps when profiling, and
+	// --code-stats reports how calls were split between bytecode and the
+	// tree walker. --max-steps <n> and --max-heap <bytes> stop programs that
+	// make too many calls and loop iterations, or that grow the heap too much.
+	Interpreter::ExecuteSettings settings;
+
+	char const* source_file = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--lazy") == 0) {
+			settings.lazy_declarations = true;
+		} else if (strcmp(argv[i], "--check") == 0) {
+			settings.check_only = true;
+		} else if (strcmp(argv[i], "--typecheck-threads") == 0) {
+			if (i + 1 == argc) {
+				std::cout << "Argument missing: thread count" << std::endl;
+				return 1;
+			}
+			settings.typecheck_threads = std::atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--cache") == 0) {
+			if (i + 1 == argc) {
+				std::cout << "Argument missing: cache file" << std::endl;
+				return 1;
+			}
+			settings.check_cache = argv[++i];
+		} else if (strcmp(argv[i], "--compile-to") == 0) {
+			if (i + 1 == argc) {
+				std::cout << "Argument missing: image file" << std::endl;
+				return 1;
+			}
+			settings.compile_to = argv[++i];
+		} else if (strcmp(argv[i], "--snapshot") == 0) {
+			settings.snapshot_heap = true;
+		} else if (strcmp(argv[i], "--no-inline") == 0) {
+			settings.inline_functions = false;
+		} else if (strcmp(argv[i], "--code-stats") == 0) {
+			show_code_stats = true;
+		} else if (strcmp(argv[i], "--max-steps") == 0) {
+			if (i + 1 == argc) {
+				std::cout << "Argument missing: step count" << std::endl;
+				return 1;
+			}
+			settings.max_steps = std::strtoll(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--max-heap") == 0) {
+			if (i + 1 == argc) {
+				std::cout << "Argument missing: heap size" << std::endl;
+				return 1;
+			}
+			settings.max_heap_bytes = std::strtoull(argv[++i], nullptr, 10);
+		} else {
+			source_file = argv[i];
+		}
 	}
 
-	std::ifstream in_fs(argv[1]);
-	if (!in_fs.good()) {
-		std::cout << "Failed to open '" << argv[1] << "'" << std::endl;
+	if (!source_file) {
+		std::cout << "Argument missing: source file" << std::endl;
 		return 1;
 	}
 
-	std::stringstream file_content;
-	std::string line;
-
-	while (std::getline(in_fs, line)) {
-		file_content << line << '\n';
+	auto file = read_file(source_file);
+	if (!file.ok()) {
+		std::cout << file.error().m_text << std::endl;
+		return 1;
 	}
 
-	std::string source = file_content.str();
+	string_view source = file.m_result.view();
 
-	Interpreter::ExecuteSettings settings;
+	auto runner = +[](Interpreter::Interpreter& env,
+	                  Frontend::SymbolTable& context) -> ExitStatus {
+		// NOTE: We currently implement funcion evaluation in eval(ASTCallExpression)
+		// this means we need to create a call expression node to run the program.
 
-	ExitStatus exit_code = execute(
-		source,
-		settings,
-		+[](Interpreter::Interpreter& env,
-		    Frontend::SymbolTable& context) -> ExitStatus {
-			// NOTE: We currently implement funcion evaluation in eval(ASTCallExpression)
-			// this means we need to create a call expression node to run the program.
+		{
+			CST::Allocator cst_allocator;
+			auto parser_result = parse_expression({"__invoke()"}, cst_allocator);
 
-			{
-				LexerResult lexer_result = tokenize({"__invoke()"});
+			AST::Allocator ast_allocator;
+			auto ast = AST::convert_expr(parser_result.cst(), ast_allocator);
+			Interpreter::bind_global_slots(ast, env.m_global_scope);
 
-				CST::Allocator cst_allocator;
-				auto parser_result = parse_expression(lexer_result, cst_allocator);
+			eval(ast, env);
+			auto result = env.m_stack.pop();
 
-				AST::Allocator ast_allocator;
-				auto ast = AST::convert_expr(parser_result.cst(), ast_allocator);
+			Interpreter::print(result, env.m_output);
+		}
 
-				eval(ast, env);
-				auto result = env.m_stack.pop();
+		if (show_code_stats) {
+			auto const& stats = env.m_code_cache.m_stats;
+			std::cerr << "calls running bytecode: " << stats.m_hits << "\n"
+			          << "calls interpreted: " << stats.m_misses << "\n"
+			          << "functions compiled: " << stats.m_compilations
+			          << " (" << stats.m_failed_compilations << " failed)\n"
+			          << "time compiling: " << stats.m_compile_seconds * 1000 << "ms\n";
+		}
 
-				Interpreter::print(result);
-			}
+		return ExitStatus::Ok;
+	};
 
-			return ExitStatus::Ok;
-		});
+	ExitStatus exit_code = Interpreter::is_image(source)
+	    ? Interpreter::execute_image(source, runner)
+	    : execute(source, settings, runner);
 
 	return static_cast<int>(exit_code);
 }
@@ -1,14 +1,20 @@
+#include "native.hpp"
+
 #include "../utils/span.hpp"
 #include "garbage_collector.hpp"
 #include "interpreter.hpp"
+#include "task.hpp"
 #include "utils.hpp"
 #include "value.hpp"
 #include "value_tag.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 
 #include <cassert>
+#include <cctype>
 
 namespace Interpreter {
 
@@ -23,7 +29,7 @@ using ArgsType = Span<Value>;
 // print(vals...) prints the values in vals
 Value print(ArgsType v, Interpreter& e) {
 	for (auto value : v)
-		print(value);
+		print(value, e.m_output);
 	return e.null();
 }
 
@@ -32,6 +38,7 @@ Value array_append(ArgsType v, Interpreter& e) {
 	// TODO proper error handling
 	assert(v.size() > 0);
 	Array* array = v[0].as<Array>();
+	e.m_gc->charge((v.size() - 1) * sizeof(Value));
 	for (unsigned int i = 1; i < v.size(); i++) {
 		array->append(v[i]);
 	}
@@ -40,39 +47,28 @@ Value array_append(ArgsType v, Interpreter& e) {
 
 // array_extend(arr1, arr2) appends the values in arr2 to
 // arr1
-Value array_extend(ArgsType v, Interpreter& e) {
-	// TODO proper error handling
-	assert(v.size() == 2);
-	Array* arr1 = v[0].as<Array>();
-	Array* arr2 = v[1].as<Array>();
+Array* array_extend(Interpreter& e, Array* arr1, Array* arr2) {
+	e.m_gc->charge(arr2->m_value.size() * sizeof(Value));
 	arr1->m_value.insert(
 	    arr1->m_value.end(), arr2->m_value.begin(), arr2->m_value.end());
-	return Value {arr1};
+	return arr1;
 }
 
 // size(array) returns the size of the array
-Value size(ArgsType v, Interpreter& e) {
-	// TODO proper error handling
-	assert(v.size() == 1);
-	Array* array = v[0].as<Array>();
-
-	return Value {int(array->m_value.size())};
+int size(Array* array) {
+	return int(array->m_value.size());
 }
 
 // array_join(array, string) returns a string with
 // the array values separated by the string element
-Value array_join(ArgsType v, Interpreter& e) {
+std::string array_join(Array* array, String* sep) {
 	// TODO make it more general
-	// TODO proper error handling
-	assert(v.size() == 2);
-	Array* array = v[0].as<Array>();
-	String* sep = v[1].as<String>();
 	std::stringstream result;
 	for (unsigned int i = 0; i < array->m_value.size(); i++) {
 		if (i > 0) result << sep->m_value;
 		result << array->m_value[i].get_integer();
 	}
-	return Value{e.m_gc->new_string_raw(result.str())};
+	return result.str();
 }
 
 Value value_add(ArgsType v, Interpreter& e) {
@@ -145,40 +141,16 @@ Value value_div(ArgsType v, Interpreter& e) {
 	}
 }
 
-Value value_logicand(ArgsType v, Interpreter& e) {
-	auto lhs = v[0];
-	auto rhs = v[1];
-
-	if (lhs.type() == ValueTag::Boolean and rhs.type() == ValueTag::Boolean)
-		return OP_(as_boolean, lhs, &&, rhs);
-	std::cerr << "ERROR: logical and operator not defined for types "
-	          << value_string[static_cast<int>(lhs.type())] << " and "
-	          << value_string[static_cast<int>(rhs.type())];
-	assert(0);
+bool value_logicand(bool lhs, bool rhs) {
+	return lhs && rhs;
 }
 
-Value value_logicor(ArgsType v, Interpreter& e) {
-	auto lhs = v[0];
-	auto rhs = v[1];
-
-	if (lhs.type() == ValueTag::Boolean and rhs.type() == ValueTag::Boolean)
-		return OP_(as_boolean, lhs, ||, rhs);
-	std::cerr << "ERROR: logical or operator not defined for types "
-	          << value_string[static_cast<int>(lhs.type())] << " and "
-	          << value_string[static_cast<int>(rhs.type())];
-	assert(0);
+bool value_logicor(bool lhs, bool rhs) {
+	return lhs || rhs;
 }
 
-Value value_logicxor(ArgsType v, Interpreter& e) {
-	auto lhs = v[0];
-	auto rhs = v[1];
-
-	if (lhs.type() == ValueTag::Boolean and rhs.type() == ValueTag::Boolean)
-		return OP_(as_boolean, lhs, !=, rhs);
-	std::cerr << "ERROR: exclusive or operator not defined for types "
-	          << value_string[static_cast<int>(lhs.type())] << " and "
-	          << value_string[static_cast<int>(rhs.type())];
-	assert(0);
+bool value_logicxor(bool lhs, bool rhs) {
+	return lhs != rhs;
 }
 
 Value value_equals(ArgsType v, Interpreter& e) {
@@ -247,66 +219,169 @@ Value value_less_or_equal(ArgsType v, Interpreter& e) {
 	return Value {bool(!b)};
 }
 
-Value read_integer(ArgsType v, Interpreter& e) {
-	// TODO: error handling
-	int result;
-	std::cin >> result;
-	return Value {result};
+// The input natives suspend the task they run in, if there is one, and
+// return what the host resumes it with. Otherwise they read from stdin
+// through the input buffer the interpreter shares with the others, which
+// they hold until they are done with what they read. The interpreter's
+// output is tied to the read, so that a prompt is written out before we
+// wait for the answer.
+
+// TODO: error handling. For now, the end of the input reads as empty
+// strings and zeros
+
+int read_integer(Interpreter& e) {
+	if (e.m_task)
+		return e.m_task->await("read_integer").get_integer();
+
+	std::lock_guard<std::mutex> lock {e.m_input->m_mutex};
+	return e.m_input->read_integer(&e.m_output);
+}
+
+float read_number(Interpreter& e) {
+	if (e.m_task)
+		return e.m_task->await("read_number").get_float();
+
+	std::lock_guard<std::mutex> lock {e.m_input->m_mutex};
+	return e.m_input->read_number(&e.m_output);
 }
 
-Value read_number(ArgsType v, Interpreter& e) {
-	// TODO: error handling
-	float result;
-	std::cin >> result;
-	return Value {result};
+Value read_line(Interpreter& e) {
+	if (e.m_task)
+		return e.m_task->await("read_line");
+
+	std::lock_guard<std::mutex> lock {e.m_input->m_mutex};
+	string_view line;
+	e.m_input->read_line(line, &e.m_output);
+	return Value {e.m_gc->new_string_raw(line.to_string())};
 }
 
-Value read_line(ArgsType v, Interpreter& e) {
-	// TODO: error handling
-	std::string result;
-	std::getline(std::cin, result);
-	return Value {e.m_gc->new_string_raw(std::move(result))};
+Value read_string(Interpreter& e) {
+	if (e.m_task)
+		return e.m_task->await("read_string");
+
+	std::lock_guard<std::mutex> lock {e.m_input->m_mutex};
+	string_view token;
+	e.m_input->read_token(token, &e.m_output);
+	return Value {e.m_gc->new_string_raw(token.to_string())};
 }
 
-Value read_string(ArgsType v, Interpreter& e) {
-	// TODO: error handling
-	std::string result;
-	std::cin >> result;
-	return Value {e.m_gc->new_string_raw(std::move(result))};
+static bool is_space(char c) {
+	return std::isspace(static_cast<unsigned char>(c));
 }
 
-void declare_native_functions(Interpreter& env) {
-	auto declare = [&](char const* name, NativeFunction* func) {
-		env.global_declare(name, Value {func});
+// read_fields(separator) reads a line, and returns the fields between each
+// occurrence of the separator. With an empty separator, fields are split
+// by runs of whitespace instead, and the whitespace at the ends is dropped.
+Array* read_fields(Interpreter& e, String* separator) {
+	string_view line;
+	std::unique_lock<std::mutex> lock;
+	if (e.m_task) {
+		// the separator stays on this side, so the host only sees a line
+		line = e.m_task->await("read_line").as<String>()->m_value;
+	} else {
+		lock = std::unique_lock<std::mutex> {e.m_input->m_mutex};
+		e.m_input->read_line(line, &e.m_output);
+	}
+
+	Array* result = e.m_gc->new_list_raw({});
+	auto add_field = [&](char const* begin, char const* end) {
+		e.m_gc->charge(sizeof(Value));
+		result->append(Value {e.m_gc->new_string_raw(std::string(begin, end))});
 	};
 
-	env.global_declare("int", env.null());
-	env.global_declare("float", env.null());
-
-	declare("print", print);
-	declare("array_append", array_append);
-	declare("array_extend", array_extend);
-	declare("size", size);
-	declare("array_join", array_join);
-	declare("+", value_add);
-	declare("-", value_sub);
-	declare("*", value_mul);
-	declare("/", value_div);
-	declare("<", value_less);
-	declare(">=", value_greater_or_equal);
-	declare(">", value_greater);
-	declare("<=", value_less_or_equal);
-	declare("==", value_equals);
-	declare("!=", value_not_equals);
-	declare("^^", value_logicxor);
-	declare("&&", value_logicand);
-	declare("||", value_logicor);
+	auto const& sep = separator->m_value;
+	char const* p = line.begin();
+
+	if (sep.empty()) {
+		while (true) {
+			while (p != line.end() && is_space(*p))
+				++p;
+			if (p == line.end())
+				break;
+			char const* start = p;
+			while (p != line.end() && !is_space(*p))
+				++p;
+			add_field(start, p);
+		}
+	} else {
+		while (true) {
+			char const* next = std::search(p, line.end(), sep.begin(), sep.end());
+			add_field(p, next);
+			if (next == line.end())
+				break;
+			p = next + sep.size();
+		}
+	}
+
+	return result;
+}
+
+struct NativeFunctionEntry {
+	char const* name;
+	NativeFunction* func;
+};
+
+#define TYPED(name, func) {name, TYPED_NATIVE(func)}
+
+static NativeFunctionEntry const native_functions[] = {
+	{"print", print},
+	{"array_append", array_append},
+	TYPED("array_extend", array_extend),
+	TYPED("size", size),
+	TYPED("array_join", array_join),
+	{"+", value_add},
+	{"-", value_sub},
+	{"*", value_mul},
+	{"/", value_div},
+	{"<", value_less},
+	{">=", value_greater_or_equal},
+	{">", value_greater},
+	{"<=", value_less_or_equal},
+	{"==", value_equals},
+	{"!=", value_not_equals},
+	TYPED("^^", value_logicxor),
+	TYPED("&&", value_logicand),
+	TYPED("||", value_logicor),
 
 	// Input
-	declare("read_integer", read_integer);
-	declare("read_number", read_number);
-	declare("read_string", read_string);
-	declare("read_line", read_line);
+	TYPED("read_integer", read_integer),
+	TYPED("read_number", read_number),
+	TYPED("read_string", read_string),
+	TYPED("read_line", read_line),
+	TYPED("read_fields", read_fields),
+};
+
+#undef TYPED
+
+// names the typechecker knows as values, that are null at run time
+static char const* const native_types[] = {"int", "float"};
+
+void reserve_native_slots(GlobalScope& scope) {
+	for (auto name : native_types)
+		scope.slot(name);
+	for (auto const& native : native_functions)
+		scope.slot(native.name);
+}
+
+void declare_native_functions(Interpreter& env) {
+	for (auto name : native_types)
+		env.global_declare(name, env.null());
+	for (auto const& native : native_functions)
+		env.global_declare(native.name, Value {native.func});
+}
+
+char const* native_function_name(NativeFunction* func) {
+	for (auto const& native : native_functions)
+		if (native.func == func)
+			return native.name;
+	return nullptr;
+}
+
+NativeFunction* native_function_named(string_view name) {
+	for (auto const& native : native_functions)
+		if (name == native.name)
+			return native.func;
+	return nullptr;
 }
 
 #undef OP
@@ -1,9 +1,139 @@
 #pragma once
 
+#include "../utils/span.hpp"
+#include "../utils/string_view.hpp"
+#include "garbage_collector.hpp"
+#include "interpreter.hpp"
+#include "value.hpp"
+
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <cassert>
+
 namespace Interpreter {
 
+struct GlobalScope;
 struct Interpreter;
 
+// Makes the slots of the natives, in the order they are declared in
+void reserve_native_slots(GlobalScope&);
 void declare_native_functions(Interpreter& env);
 
-}
+// The global name a native function is declared with, so values that hold
+// one can be saved and restored. Null or nullptr when there is none.
+char const* native_function_name(NativeFunction*);
+NativeFunction* native_function_named(string_view name);
+
+/*
+ * Natives can be written as plain C++ functions, like `int f(int, int)`,
+ * and turned into a NativeFunction with TYPED_NATIVE(f). The wrapper
+ * unboxes the arguments into the parameter types, and boxes the result,
+ * with the conversions picked at compile time. Natives that need the
+ * interpreter can take an Interpreter& before their other parameters.
+ *
+ * The types that can be used are:
+ *  - int, float and bool, for the matching Jasper types
+ *  - std::string (by value) for strings, String* and Array* for the cells
+ *    themselves, and Value for anything
+ *  - void, only as a return type, for natives that return null
+ */
+
+template <typename T>
+struct NativeType;
+
+template <>
+struct NativeType<int> {
+	static int unbox(Value v) { return v.get_integer(); }
+	static Value box(int x, Interpreter&) { return Value {x}; }
+};
+
+template <>
+struct NativeType<float> {
+	static float unbox(Value v) { return v.get_float(); }
+	static Value box(float x, Interpreter&) { return Value {x}; }
+};
+
+template <>
+struct NativeType<bool> {
+	static bool unbox(Value v) { return v.get_boolean(); }
+	static Value box(bool x, Interpreter&) { return Value {x}; }
+};
+
+template <>
+struct NativeType<std::string> {
+	static std::string unbox(Value v) { return v.as<String>()->m_value; }
+	static Value box(std::string x, Interpreter& e) {
+		return Value {e.m_gc->new_string_raw(std::move(x))};
+	}
+};
+
+template <>
+struct NativeType<String*> {
+	static String* unbox(Value v) { return v.as<String>(); }
+	static Value box(String* x, Interpreter&) { return Value {x}; }
+};
+
+template <>
+struct NativeType<Array*> {
+	static Array* unbox(Value v) { return v.as<Array>(); }
+	static Value box(Array* x, Interpreter&) { return Value {x}; }
+};
+
+template <>
+struct NativeType<Value> {
+	static Value unbox(Value v) { return v; }
+	static Value box(Value x, Interpreter&) { return x; }
+};
+
+template <typename Signature, Signature func>
+struct TypedNative;
+
+template <typename R, typename... Args, R (*func)(Args...)>
+struct TypedNative<R (*)(Args...), func> {
+	static constexpr int arity = sizeof...(Args);
+
+	static Value call(Span<Value> args, Interpreter& e) {
+		assert(args.size() == arity);
+		return call(args, e, std::is_void<R> {}, std::index_sequence_for<Args...> {});
+	}
+
+  private:
+	template <size_t... I>
+	static Value call(Span<Value> args, Interpreter& e, std::false_type, std::index_sequence<I...>) {
+		return NativeType<R>::box(func(NativeType<std::decay_t<Args>>::unbox(args[I])...), e);
+	}
+
+	template <size_t... I>
+	static Value call(Span<Value> args, Interpreter& e, std::true_type, std::index_sequence<I...>) {
+		func(NativeType<std::decay_t<Args>>::unbox(args[I])...);
+		return e.null();
+	}
+};
+
+template <typename R, typename... Args, R (*func)(Interpreter&, Args...)>
+struct TypedNative<R (*)(Interpreter&, Args...), func> {
+	static constexpr int arity = sizeof...(Args);
+
+	static Value call(Span<Value> args, Interpreter& e) {
+		assert(args.size() == arity);
+		return call(args, e, std::is_void<R> {}, std::index_sequence_for<Args...> {});
+	}
+
+  private:
+	template <size_t... I>
+	static Value call(Span<Value> args, Interpreter& e, std::false_type, std::index_sequence<I...>) {
+		return NativeType<R>::box(func(e, NativeType<std::decay_t<Args>>::unbox(args[I])...), e);
+	}
+
+	template <size_t... I>
+	static Value call(Span<Value> args, Interpreter& e, std::true_type, std::index_sequence<I...>) {
+		func(e, NativeType<std::decay_t<Args>>::unbox(args[I])...);
+		return e.null();
+	}
+};
+
+#define TYPED_NATIVE(func) (&::Interpreter::TypedNative<decltype(&func), &func>::call)
+
+} // namespace Interpreter
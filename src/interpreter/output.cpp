@@ -0,0 +1,87 @@
+#include "output.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+
+namespace Interpreter {
+
+static void write_all(int fd, char const* data, size_t size) {
+	while (size > 0) {
+		auto written = ::write(fd, data, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		// there is nowhere to report the error to, so the output is dropped
+		if (written < 0)
+			return;
+		data += written;
+		size -= written;
+	}
+}
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity)
+    : m_fd {fd}
+    , m_line_buffered {isatty(fd) == 1}
+    , m_data {new char[capacity]}
+    , m_capacity {capacity} {}
+
+OutputBuffer::~OutputBuffer() {
+	flush();
+}
+
+void OutputBuffer::write(char const* data, size_t size) {
+	if (m_size + size > m_capacity) {
+		flush();
+		// too big to be worth copying
+		if (size > m_capacity)
+			return write_all(m_fd, data, size);
+	}
+
+	std::memcpy(&m_data[m_size], data, size);
+	m_size += size;
+}
+
+void OutputBuffer::write(char const* str) {
+	write(str, std::strlen(str));
+}
+
+void OutputBuffer::write(int value) {
+	// enough for the digits of any int, and a sign
+	char digits[16];
+	char* end = digits + sizeof(digits);
+	char* begin = end;
+
+	// works on the magnitude as unsigned, so INT_MIN doesn't overflow
+	unsigned int magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+	do {
+		*--begin = char('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude != 0);
+
+	if (value < 0)
+		*--begin = '-';
+
+	write(begin, end - begin);
+}
+
+void OutputBuffer::write(float value) {
+	// %g is what iostreams use by default
+	char digits[32];
+	int size = std::snprintf(digits, sizeof(digits), "%g", double(value));
+	write(digits, size);
+}
+
+void OutputBuffer::end_line() {
+	write('\n');
+	if (m_line_buffered)
+		flush();
+}
+
+void OutputBuffer::flush() {
+	write_all(m_fd, m_data.get(), m_size);
+	m_size = 0;
+}
+
+} // namespace Interpreter
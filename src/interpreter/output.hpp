@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../utils/string_view.hpp"
+
+#include <memory>
+
+#include <cstddef>
+
+namespace Interpreter {
+
+/*
+ * Where an interpreter's output goes. Writes pile up in a buffer, which is
+ * handed to write(2) when it fills up, on flush, and when the buffer is
+ * destroyed. If the file is a terminal, every line is flushed as soon as
+ * it's complete, so interactive programs aren't held back.
+ *
+ * Numbers are formatted straight into the buffer, the same way iostreams
+ * format them by default.
+ */
+struct OutputBuffer {
+	int m_fd;
+	bool m_line_buffered;
+	std::unique_ptr<char[]> m_data;
+	size_t m_capacity;
+	size_t m_size {0};
+
+	explicit OutputBuffer(int fd = 1, size_t capacity = 1 << 16);
+	OutputBuffer(OutputBuffer const&) = delete;
+	OutputBuffer& operator=(OutputBuffer const&) = delete;
+	~OutputBuffer();
+
+	void write(char c) {
+		if (m_size == m_capacity)
+			flush();
+		m_data[m_size++] = c;
+	}
+
+	void write(char const* data, size_t size);
+	void write(string_view str) {
+		write(str.data(), str.size());
+	}
+	void write(char const* str);
+	void write(int);
+	void write(float);
+
+	// writes a newline, which is where line buffered output is flushed
+	void end_line();
+
+	void flush();
+};
+
+} // namespace Interpreter
@@ -29,6 +29,14 @@ void Stack::end_region() {
 	m_stack.resize(m_stack_ptr);
 }
 
+void Stack::clear() {
+	m_frame_ptr = 0;
+	m_stack_ptr = 0;
+	m_stack.clear();
+	m_fp_stack.clear();
+	m_sp_stack.clear();
+}
+
 void Stack::push(Value ref){
 	m_stack.push_back(ref);
 	m_stack_ptr += 1;
@@ -41,6 +49,12 @@ Value Stack::pop() {
 	return result;
 }
 
+void Stack::drop(int count) {
+	assert(m_stack_ptr - count >= 0);
+	m_stack_ptr -= count;
+	m_stack.resize(m_stack_ptr);
+}
+
 Value& Stack::access(int offset) {
 	return m_stack[m_stack_ptr - 1 - offset];
 }
@@ -60,4 +74,9 @@ Span<Value> Stack::frame_range(int offset, int length) {
 	return {start_address, length};
 }
 
+Span<Value> Stack::top_range(int length) {
+	assert(m_stack_ptr - length >= 0);
+	return {m_stack.data() + m_stack_ptr - length, length};
+}
+
 } // namespace Interpreter
@@ -14,12 +14,17 @@ struct Stack {
 	void start_region(int size = 0);
 	void end_region();
 
+	// Drops every value, frame and region
+	void clear();
+
 	void push(Value ref);
 	Value pop();
+	void drop(int count);
 
 	Value& access(int offset);
 	Value& frame_at(int offset);
 	Span<Value> frame_range(int offset, int length);
+	Span<Value> top_range(int length);
 
 	template<typename Function>
 	void for_each(Function&& f) {
@@ -0,0 +1,142 @@
+#include "task.hpp"
+
+#include "budget.hpp"
+#include "interpreter.hpp"
+
+#include <new>
+
+#include <cassert>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// The address sanitizer keeps track of the stack we're on, so it has to be
+// told about every switch
+#if defined(__SANITIZE_ADDRESS__)
+#define TASK_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define TASK_ASAN 1
+#endif
+#endif
+
+#ifdef TASK_ASAN
+#include <sanitizer/common_interface_defs.h>
+#define START_SWITCH(fake_stack, bottom, size)                                 \
+	__sanitizer_start_switch_fiber(fake_stack, bottom, size)
+#define FINISH_SWITCH(fake_stack, bottom, size)                                \
+	__sanitizer_finish_switch_fiber(fake_stack, bottom, size)
+#else
+#define START_SWITCH(fake_stack, bottom, size) (void)(fake_stack)
+#define FINISH_SWITCH(fake_stack, bottom, size) (void)(fake_stack)
+#endif
+
+namespace Interpreter {
+
+// makecontext can only pass ints to the entry point, so the task that is
+// being started is passed here instead
+static thread_local Task* starting_task = nullptr;
+
+static size_t page_size() {
+	static size_t const size = sysconf(_SC_PAGESIZE);
+	return size;
+}
+
+Task::Task(
+    Interpreter& env, Frontend::SymbolTable& context, Runner* runner, size_t stack_size)
+    : m_env {&env}
+    , m_context {&context}
+    , m_runner {runner} {
+	size_t page = page_size();
+	m_stack_size = (stack_size + page - 1) / page * page;
+	m_mapping_size = m_stack_size + page;
+
+	void* mapping = mmap(
+	    nullptr, m_mapping_size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+		throw std::bad_alloc {};
+	m_mapping = static_cast<char*>(mapping);
+
+	// stacks grow down, so the guard goes at the lowest address
+	if (mprotect(m_mapping, page, PROT_NONE) != 0) {
+		munmap(m_mapping, m_mapping_size);
+		throw std::bad_alloc {};
+	}
+	m_stack = m_mapping + page;
+
+	getcontext(&m_task_context);
+	m_task_context.uc_stack.ss_sp = m_stack;
+	m_task_context.uc_stack.ss_size = m_stack_size;
+	m_task_context.uc_link = nullptr;
+	makecontext(&m_task_context, &Task::entry, 0);
+}
+
+Task::~Task() {
+	munmap(m_mapping, m_mapping_size);
+}
+
+Task::State Task::resume(Value result) {
+	assert(m_state != State::Done);
+	assert(!m_env->m_task);
+
+	m_result = result;
+	m_env->m_task = this;
+	starting_task = this;
+
+	void* host_fake_stack = nullptr;
+	START_SWITCH(&host_fake_stack, m_stack, m_stack_size);
+	swapcontext(&m_host_context, &m_task_context);
+	FINISH_SWITCH(host_fake_stack, nullptr, nullptr);
+
+	m_env->m_task = nullptr;
+
+	if (m_exception) {
+		auto exception = m_exception;
+		m_exception = nullptr;
+		std::rethrow_exception(exception);
+	}
+
+	return m_state;
+}
+
+Value Task::await(char const* native) {
+	assert(m_env->m_task == this);
+
+	m_pending = native;
+	m_state = State::Suspended;
+
+	// the host is going to ask for the answer, so it should see the question
+	m_env->m_output.flush();
+
+	START_SWITCH(&m_fake_stack, m_host_stack_bottom, m_host_stack_size);
+	swapcontext(&m_task_context, &m_host_context);
+	FINISH_SWITCH(m_fake_stack, &m_host_stack_bottom, &m_host_stack_size);
+
+	m_pending = nullptr;
+	m_state = State::Ready;
+	return m_result;
+}
+
+void Task::entry() {
+	Task* task = starting_task;
+	FINISH_SWITCH(nullptr, &task->m_host_stack_bottom, &task->m_host_stack_size);
+
+	// exceptions can't cross into the host's stack, so they are caught here
+	// and thrown again by resume
+	try {
+		task->m_status = task->m_runner(*task->m_env, *task->m_context);
+	} catch (BudgetExceeded const&) {
+		task->m_status = ExitStatus::BudgetExceeded;
+	} catch (...) {
+		task->m_exception = std::current_exception();
+	}
+
+	task->m_state = State::Done;
+
+	// the task's stack is never used again, so there's no fake stack to keep
+	START_SWITCH(nullptr, task->m_host_stack_bottom, task->m_host_stack_size);
+	setcontext(&task->m_host_context);
+}
+
+} // namespace Interpreter
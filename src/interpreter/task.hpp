@@ -0,0 +1,84 @@
+#pragma once
+
+#include "execute.hpp"
+#include "value.hpp"
+
+#include <exception>
+
+#include <cstddef>
+#include <ucontext.h>
+
+namespace Frontend {
+struct SymbolTable;
+}
+
+namespace Interpreter {
+
+struct Interpreter;
+
+/*
+ * Runs a runner on a stack of its own, so it can be suspended in the middle
+ * of a native call, and resumed later, once what the native was waiting on
+ * is available. One thread can drive many tasks, each with an interpreter
+ * of its own, by resuming whichever of them can make progress.
+ *
+ * Natives suspend the task they run in with await, which returns the value
+ * the host passes to the next resume. While a task is suspended, the host
+ * may allocate the value in the task's heap, but must not run anything else
+ * in its interpreter.
+ *
+ * A task that is destroyed while suspended never finishes its call, and
+ * what was on its stack is not cleaned up, so its interpreter can only be
+ * reset or thrown away after that.
+ *
+ * The stack is mapped on its own, with an inaccessible page below it, so a
+ * task that overflows it crashes instead of writing over other memory.
+ */
+struct Task {
+	enum class State { Ready, Suspended, Done };
+
+	Interpreter* m_env;
+	Frontend::SymbolTable* m_context;
+	Runner* m_runner;
+
+	State m_state {State::Ready};
+	// The name of the native that is waiting, while suspended
+	char const* m_pending {nullptr};
+	// What the runner returned, once done
+	ExitStatus m_status {ExitStatus::Ok};
+
+	Task(Interpreter&, Frontend::SymbolTable&, Runner*, size_t stack_size = 1 << 20);
+	Task(Task const&) = delete;
+	Task& operator=(Task const&) = delete;
+	~Task();
+
+	// Runs the task until it is suspended or done. The value is what the
+	// native that suspended it returns, and is ignored when starting.
+	State resume(Value result = Value {nullptr});
+
+	// Suspends the task until the host resumes it, and returns the value it
+	// resumes it with. Only natives running in the task may call it.
+	Value await(char const* native);
+
+  private:
+	static void entry();
+
+	Value m_result {nullptr};
+	std::exception_ptr m_exception;
+
+	// the whole mapping, guard page included, and the stack above it
+	char* m_mapping;
+	size_t m_mapping_size;
+	char* m_stack;
+	size_t m_stack_size;
+	ucontext_t m_task_context;
+	ucontext_t m_host_context;
+
+	// Kept for the address sanitizer, which has to be told when we switch
+	// stacks
+	void* m_fake_stack {nullptr};
+	void const* m_host_stack_bottom {nullptr};
+	size_t m_host_stack_size {0};
+};
+
+} // namespace Interpreter
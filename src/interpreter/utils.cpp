@@ -8,6 +8,12 @@
 
 namespace Interpreter {
 
+int global_slot(AST::Identifier* ast) {
+	if (ast->m_global_slot == -1)
+		Log::fatal() << "missing global slot for identifier '" << ast->text() << "'";
+	return ast->m_global_slot;
+}
+
 void eval_call_function(Function* callee, int arg_count, Interpreter& e) {
 
 	for (int i = 0; i < arg_count; ++i) {
@@ -20,21 +26,9 @@ void eval_call_function(Function* callee, int arg_count, Interpreter& e) {
 	// TODO: error handling ?
 	assert(callee->m_def->m_args.size() == arg_count);
 
-	if (!callee->m_def->tried_compilation) {
-		callee->m_def->tried_compilation = true;
-
-		Writer<Bytecode::Executable> bytecode = Bytecode::compile(callee->m_def->m_body);
-		if (bytecode.ok()) {
-			callee->m_def->bytecode =
-			    new Bytecode::Executable {std::move(bytecode.m_result)};
-		}
-	}
-
-	for (auto capture : callee->m_captures)
-		e.m_stack.push(Value{capture});
-
-	if (callee->m_def->bytecode) {
-		Bytecode::execute(*callee->m_def->bytecode, e);
+	auto code = e.m_code_cache.code_for_call(callee->m_def, e);
+	if (code) {
+		Bytecode::execute(*code, e);
 	} else {
 		eval(callee->m_def->m_body, e);
 	}
@@ -57,6 +51,25 @@ void eval_call_callable(Value callee, int arg_count, Interpreter& e) {
 }
 
 
+void eval_call(Value callee, int arg_count, Interpreter& e) {
+	e.burn_fuel();
 
+	if (callee.type() == ValueTag::NativeFunction) {
+		auto args = e.m_stack.top_range(arg_count);
+		Value result = callee.get_native_func()(args, e);
+		e.m_stack.drop(arg_count);
+		e.m_stack.access(0) = result;
+		return;
+	}
+
+	e.m_stack.start_frame(arg_count);
+
+	eval_call_callable(callee, arg_count, e);
+
+	// pop the result of the function, and clobber the callee
+	e.m_stack.frame_at(-1) = e.m_stack.pop();
+
+	e.m_stack.end_frame();
+}
 
 } // namespace Interpreter
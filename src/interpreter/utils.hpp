@@ -4,8 +4,21 @@
 
 #include "value.hpp"
 
+namespace AST {
+struct Identifier;
+}
+
 namespace Interpreter {
 
 void eval_call_callable(Value callee, int arg_count, Interpreter&);
 
+// Calls the callee with the `arg_count` values on top of the stack as
+// arguments, and replaces the callee, which is right below them, with the
+// result. Native functions are called in place, without setting up a frame.
+void eval_call(Value callee, int arg_count, Interpreter&);
+
+// The slot of a global identifier. It's only read here: bind_global_slots
+// must have bound it before the identifier is evaluated or compiled.
+int global_slot(AST::Identifier*);
+
 } // namespace Interpreter
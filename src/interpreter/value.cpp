@@ -1,6 +1,9 @@
 #include "value.hpp"
 
+#include "output.hpp"
+
 #include <iostream>
+#include <new>
 
 namespace Interpreter {
 
@@ -56,10 +59,22 @@ Variant::Variant(InternedString constructor, Value v)
     , m_constructor(constructor)
     , m_inner_value(v) {}
 
-Function::Function(FunctionType def, CapturesType captures)
+Function::Function(FunctionType def, int capture_count)
     : GcCell(ValueTag::Function)
     , m_def(def)
-    , m_captures(std::move(captures)) {}
+    , m_capture_count(capture_count) {
+	for (int i = 0; i < capture_count; ++i)
+		captures()[i] = nullptr;
+}
+
+Function* Function::make(FunctionType def, int capture_count) {
+	static_assert(
+	    sizeof(Function) % alignof(Variable*) == 0,
+	    "the captures that follow a Function must be aligned");
+	void* memory =
+	    ::operator new(sizeof(Function) + capture_count * sizeof(Variable*));
+	return new (memory) Function(def, capture_count);
+}
 
 Variable::Variable(Value value)
     : GcCell {ValueTag::Variable}
@@ -77,126 +92,149 @@ RecordConstructor::RecordConstructor(std::vector<InternedString> keys)
 // = === === print === === = //
 
 
-void print(Value h, int d);
-static void print(GcCell* v, int d);
+void print(Value h, OutputBuffer& out, int d);
+static void print(GcCell* v, OutputBuffer& out, int d);
 
-void print_spaces(int n) {
+static void print_spaces(OutputBuffer& out, int n) {
 	for (int i = 0; i < n; ++i)
-		std::cout << ' ';
+		out.write(' ');
 }
 
-static void print(int v, int d) {
-	print_spaces(d);
-	std::cout << value_string[int(ValueTag::Integer)] << ' ' << v << '\n';
+static void print(int v, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write(value_string[int(ValueTag::Integer)]);
+	out.write(' ');
+	out.write(v);
+	out.end_line();
 }
 
-static void print(float v, int d) {
-	print_spaces(d);
-	std::cout << value_string[int(ValueTag::Float)] << ' ' << v << '\n';
+static void print(float v, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write(value_string[int(ValueTag::Float)]);
+	out.write(' ');
+	out.write(v);
+	out.end_line();
 }
 
-static void print(String* v, int d) {
-	print_spaces(d);
-	std::cout << value_string[int(v->type())] << ' ' << '"' << v->m_value
-	          << '"' << '\n';
+static void print(String* v, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write(value_string[int(v->type())]);
+	out.write(" \"");
+	out.write(v->m_value.data(), v->m_value.size());
+	out.write('"');
+	out.end_line();
 }
 
-static void print(bool b, int d) {
-	print_spaces(d);
-	std::cout << value_string[int(ValueTag::Boolean)] << ' ' << b << '\n';
+static void print(bool b, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write(value_string[int(ValueTag::Boolean)]);
+	out.write(' ');
+	out.write(b ? '1' : '0');
+	out.end_line();
 }
 
-static void print(Record* o, int d) {
-	print_spaces(d);
-	std::cout << value_string[int(o->type())] << '\n';
+static void print(Record* o, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write(value_string[int(o->type())]);
+	out.end_line();
 	for (auto& kv : o->m_value){
-		print_spaces(d+1);
+		print_spaces(out, d+1);
 		std::cerr << kv.first << " := \n";
-		print(kv.second, d+1);
+		print(kv.second, out, d+1);
 	}
 }
 
-static void print(Variant* m, int d) {
-	print_spaces(d);
-	std::cout << value_string[int(m->type())] << " " << m->m_constructor << '\n';
-	print(m->m_inner_value, d);
+static void print(Variant* m, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write(value_string[int(m->type())]);
+	out.write(' ');
+	out.write(m->m_constructor.str());
+	out.end_line();
+	print(m->m_inner_value, out, d);
 }
 
-static void print(Function* f, int d) {
+static void print(Function* f, OutputBuffer& out, int d) {
 	// TODO
-	print_spaces(d);
-	std::cout << value_string[int(f->type())] << '\n';
+	print_spaces(out, d);
+	out.write(value_string[int(f->type())]);
+	out.end_line();
 }
 
-static void print(NativeFunction* f, int d) {
+static void print(NativeFunction* f, OutputBuffer& out, int d) {
 	// TODO
-	print_spaces(d);
-	std::cout << value_string[int(ValueTag::NativeFunction)] << '\n';
+	print_spaces(out, d);
+	out.write(value_string[int(ValueTag::NativeFunction)]);
+	out.end_line();
 }
 
-static void print(Array* l, int d) {
-	print_spaces(d);
-	std::cout << value_string[int(l->type())] << '\n';
+static void print(Array* l, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write(value_string[int(l->type())]);
+	out.end_line();
 	for (auto child : l->m_value) {
-		print(child, d + 1);
+		print(child, out, d + 1);
 	}
 }
 
-static void print(Variable* l, int d) {
-	print_spaces(d);
-	std::cout << value_string[int(l->type())] << '\n';
-	print(l->m_value, d + 1);
+static void print(Variable* l, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write(value_string[int(l->type())]);
+	out.end_line();
+	print(l->m_value, out, d + 1);
 }
 
-static void print(RecordConstructor* l, int d) {
-	print_spaces(d);
-	std::cout << "RecordConstructor\n";
+static void print(RecordConstructor* l, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write("RecordConstructor");
+	out.end_line();
 }
 
-static void print(VariantConstructor* l, int d) {
-	print_spaces(d);
-	std::cout << "VariantConstructor\n";
+static void print(VariantConstructor* l, OutputBuffer& out, int d) {
+	print_spaces(out, d);
+	out.write("VariantConstructor");
+	out.end_line();
 }
 
-static void print(GcCell* v, int d) {
+static void print(GcCell* v, OutputBuffer& out, int d) {
 
 	switch (v->type()) {
 	case ValueTag::String:
-		return print(static_cast<String*>(v), d);
+		return print(static_cast<String*>(v), out, d);
 	case ValueTag::Array:
-		return print(static_cast<Array*>(v), d);
+		return print(static_cast<Array*>(v), out, d);
 	case ValueTag::Record:
-		return print(static_cast<Record*>(v), d);
+		return print(static_cast<Record*>(v), out, d);
 	case ValueTag::Variant:
-		return print(static_cast<Variant*>(v), d);
+		return print(static_cast<Variant*>(v), out, d);
 	case ValueTag::Function:
-		return print(static_cast<Function*>(v), d);
+		return print(static_cast<Function*>(v), out, d);
 	case ValueTag::Variable:
-		return print(static_cast<Variable*>(v), d);
+		return print(static_cast<Variable*>(v), out, d);
 	case ValueTag::VariantConstructor:
-		return print(static_cast<VariantConstructor*>(v), d);
+		return print(static_cast<VariantConstructor*>(v), out, d);
 	case ValueTag::RecordConstructor:
-		return print(static_cast<RecordConstructor*>(v), d);
+		return print(static_cast<RecordConstructor*>(v), out, d);
 	default:
 		assert(0);
 	}
 }
 
-void print(Value h, int d) {
+void print(Value h, OutputBuffer& out, int d) {
 	if (is_heap_type(h.type()))
-		return print(h.get(), d);
+		return print(h.get(), out, d);
 	switch (h.type()) {
 	case ValueTag::Boolean:
-		return print(h.as_boolean, d);
+		return print(h.as_boolean, out, d);
 	case ValueTag::Integer:
-		return print(h.as_integer, d);
+		return print(h.as_integer, out, d);
 	case ValueTag::Float:
-		return print(h.as_float, d);
+		return print(h.as_float, out, d);
 	case ValueTag::NativeFunction:
-		return print(h.as_native_func, d);
+		return print(h.as_native_func, out, d);
 	case ValueTag::Null:
-		print_spaces(d);
-		return void(std::cout << "(null)\n");
+		print_spaces(out, d);
+		out.write("(null)");
+		return out.end_line();
 	default:
 		assert(0);
 	}
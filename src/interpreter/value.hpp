@@ -25,7 +25,6 @@ using RecordType = std::unordered_map<Identifier, Value>;
 using ArrayType = std::vector<Value>;
 using FunctionType = AST::FunctionLiteral*;
 using NativeFunction = auto(Span<Value>, Interpreter&) -> Value;
-using CapturesType = std::vector<Variable*>;
 
 inline bool is_heap_type(ValueTag tag) {
 	return tag != ValueTag::Null && tag != ValueTag::Boolean &&
@@ -113,7 +112,9 @@ struct Value {
 	};
 };
 
-void print(Value v, int d = 0);
+struct OutputBuffer;
+
+void print(Value v, OutputBuffer& out, int d = 0);
 
 struct String : GcCell {
 	std::string m_value = "";
@@ -150,11 +151,27 @@ struct Variant : GcCell {
 	Variant(InternedString constructor, Value v);
 };
 
+/*
+ * A closure is a single cell: the variables it captures are stored right
+ * after it, in an array that is sized when the closure is made.
+ */
 struct Function : GcCell {
 	FunctionType m_def;
-	CapturesType m_captures;
+	int m_capture_count;
+
+	// captures start out as nullptr
+	static Function* make(FunctionType, int capture_count);
+
+	Variable** captures() {
+		return reinterpret_cast<Variable**>(this + 1);
+	}
+
+	static void operator delete(void* ptr) {
+		::operator delete(ptr);
+	}
 
-	Function(FunctionType, CapturesType);
+private:
+	Function(FunctionType, int capture_count);
 };
 
 struct Variable : GcCell {
@@ -1,6 +1,7 @@
 #include "lexer.hpp"
 
 #include "./algorithms/automaton.hpp"
+#include "./utils/char_scan.hpp"
 #include "./utils/string_view.hpp"
 #include "token.hpp"
 
@@ -70,9 +71,6 @@ namespace EndStates {
 	X(LPoly, POLY_OPEN, "<:")                                                  \
 	X(RPoly, POLY_CLOSE, ":>")                                                 \
                                                                                \
-	X(Identifier, END, {})                                                     \
-	X(String, STRING, {})                                                      \
-	X(Comment, END, {})                                                        \
 	X(Integer, INTEGER, {})                                                    \
 	X(Number, NUMBER, {})
 
@@ -89,7 +87,7 @@ constexpr int last_fixed_string = RPoly;
 } // namespace EndStates
 
 #define X(name, token_tag, string) string,
-static InternedString fixed_strings[] = { END_STATES };
+static string_view fixed_strings[] = { END_STATES };
 #undef X
 
 #define X(name, token_tag, string) TokenTag::token_tag,
@@ -107,17 +105,14 @@ constexpr void init_transitions(AutomatonBuilder& builder) {
 		builder.default_transition(i, Error);
 
 	State start = builder.new_state();
-	State saw_open_string = builder.new_state();
-	State saw_comment_marker = builder.new_state();
 	State saw_number_dot = builder.new_state();
 
 	builder
 
+	// NOTE: identifiers, string literals and comments are handled by the
+	// fast paths in Lexer::next, and never reach the automaton.
+
 	.from_state(start)
-		.transition('_', Identifier)
-		.transition(Range {'a', 'z'}, Identifier)
-		.transition(Range {'A', 'Z'}, Identifier)
-		.transition('"', saw_open_string)
 		.transition(Range {'0', '9'}, Integer)
 		.transition('/', Slash)
 		.transition('=', Assign)
@@ -144,18 +139,6 @@ constexpr void init_transitions(AutomatonBuilder& builder) {
 		.transition('~', Tilde)
 		.transition('@', At)
 
-	// Identifiers
-	.from_state(Identifier)
-		.self_transition('_')
-		.self_transition(Range {'a', 'z'})
-		.self_transition(Range {'A', 'Z'})
-		.self_transition(Range {'0', '9'})
-
-	// String literals
-	.from_state(saw_open_string)
-		.default_transition(saw_open_string)
-		.transition('"', String)
-
 	// numeric literals
 	.from_state(Integer)
 		.self_transition(Range {'0', '9'})
@@ -165,14 +148,9 @@ constexpr void init_transitions(AutomatonBuilder& builder) {
 	.from_state(Number)
 		.self_transition(Range {'0', '9'})
 
-	// slash (/) tokens, including comments
+	// slash (/) tokens
 	.from_state(Slash)
 		.transition('=', SlashEq)
-		.transition('/', saw_comment_marker)
-	.from_state(saw_comment_marker)
-		.default_transition(saw_comment_marker)
-		.transition('\n', Comment)
-		.transition('\0', Comment)
 
 	// equal sign (=) tokens
 	.from_state(Assign)
@@ -273,7 +251,7 @@ constexpr TokenTag token_tags[] = { END_STATES };
 #undef X
 
 #define X(name, token_tag, string) string,
-static InternedString fixed_strings[] = { END_STATES };
+static string_view fixed_strings[] = { END_STATES };
 #undef X
 
 constexpr Automaton make() {
@@ -296,7 +274,15 @@ static void print_error(char const* p) {
 	printf("Error -- last two chars are: %c%c\n", *(p-2), *(p-1));
 }
 
-static void push_identifier_or_keyword(Automaton const& a, std::vector<Token>& ta, string_view str, int start_offset) {
+static bool is_identifier_start(char c) {
+	return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_';
+}
+
+static constexpr Automaton main_automaton = MainLexer::make();
+static constexpr Automaton keyword_automaton = KeywordLexer::make();
+
+static Token identifier_or_keyword(string_view str, int start_offset) {
+	Automaton const& a = keyword_automaton;
 
 	int state = state_count - 1;
 	for (int i = 0; i < str.size(); ++i) {
@@ -306,89 +292,93 @@ static void push_identifier_or_keyword(Automaton const& a, std::vector<Token>& t
 	}
 
 	if (KeywordLexer::EndStates::Count <= state || state == KeywordLexer::EndStates::Error) {
-		ta.push_back({
-			TokenTag::IDENTIFIER,
-			start_offset,
-			InternedString(str.begin(), str.size()),
-		});
+		return {TokenTag::IDENTIFIER, start_offset, str};
 	} else {
-		ta.push_back({
+		return {
 			KeywordLexer::token_tags[state - 1],
 			start_offset,
 			KeywordLexer::fixed_strings[state - 1],
-		});
+		};
 	}
 }
 
-static std::vector<Token> tokenize(char const* p) {
-	// Implementation detail: We store indices into the source buffer
-	// in the source_locations at first, then resolve them in another pass.
+Lexer::Lexer(Frontend::Context const& file_context, int start_offset)
+    : m_file_context {file_context}
+    , m_cursor {skip_whitespace(file_context.source.data() + start_offset)} {}
+
+Token Lexer::next() {
+	char const* const code_start = m_file_context.source.data();
+	char const* p = m_cursor;
 
-	char const* const code_start = p;
+	while (*p != '\0' && !m_failed) {
+		char const* const p0 = p;
 
-	constexpr Automaton a = MainLexer::make();
-	constexpr Automaton ka = KeywordLexer::make();
+		// Fast paths: identifiers, comments and string literals can be long,
+		// so we scan them in bulk instead of stepping through the automaton
+		// one byte at a time.
 
-	std::vector<Token> ta;
+		if (is_identifier_start(*p)) {
+			p = skip_identifier_chars(p + 1);
+			m_cursor = skip_whitespace(p);
+			return identifier_or_keyword(string_view(p0, p - p0), p0 - code_start);
+		}
 
-	auto eat_whitespace = [&] {
-		while (*p == ' ' || *p == '\t' || *p == '\n') {
+		if (p[0] == '/' && p[1] == '/') {
+			p = find_char_or_nul(p + 2, '\n');
+			p = skip_whitespace(p);
+			continue;
+		}
+
+		if (*p == '"') {
+			p = find_char_or_nul(p + 1, '"');
+			if (*p == '\0') {
+				printf("Error -- unterminated string literal\n");
+				m_failed = true;
+				break;
+			}
 			p += 1;
+			m_cursor = skip_whitespace(p);
+			return {
+				TokenTag::STRING,
+				int(p0 - code_start),
+				string_view(p0 + 1, p - p0 - 2),
+			};
 		}
-	};
 
-	eat_whitespace();
-	while (*p != '\0') {
-		char const* const p0 = p;
+		// Everything else (operators and numeric literals) is short, so we
+		// just run the automaton.
 
 		int state = state_count - 1;
-		int new_state = a.go(state, *p++);
+		int new_state = main_automaton.go(state, *p++);
 		while (new_state != MainLexer::EndStates::Error) {
 			state = new_state;
-			new_state = a.go(state, *p++);
+			new_state = main_automaton.go(state, *p++);
 		}
 
 		if (MainLexer::EndStates::Count <= state) {
 			print_error(p);
+			m_failed = true;
 			break;
 		}
 
 		p -= 1;
+		m_cursor = skip_whitespace(p);
 
 		if(state <= MainLexer::EndStates::last_fixed_string) {
-			ta.push_back({
+			return {
 				MainLexer::token_tags[state - 1],
-				p0 - code_start,
+				int(p0 - code_start),
 				MainLexer::fixed_strings[state - 1],
-			});
-		} else if(state == MainLexer::EndStates::Identifier) {
-			push_identifier_or_keyword(ka, ta, string_view(p0, p - p0), p0 - code_start);
-		} else if(state == MainLexer::EndStates::Comment) {
-			// do nothing.
-		} else if(state == MainLexer::EndStates::String) {
-			ta.push_back({
-				MainLexer::token_tags[state - 1],
-				p0 - code_start,
-				InternedString(p0 + 1, p - p0 - 2),
-			});
+			};
 		} else {
-			ta.push_back({
+			return {
 				MainLexer::token_tags[state - 1],
-				p0 - code_start,
-				InternedString(p0, p - p0),
-			});
+				int(p0 - code_start),
+				string_view(p0, p - p0),
+			};
 		}
-
-		eat_whitespace();
 	}
-	ta.push_back({TokenTag::END, p-code_start, InternedString()});
-
-	return ta;
-}
 
-LexerResult tokenize(Frontend::Context ctx) {
-	LexerResult result;
-	result.tokens = tokenize(ctx.source.c_str());
-	result.file_context = std::move(ctx);
-	return result;
+	m_cursor = p;
+	return {TokenTag::END, int(p - code_start), {}};
 }
@@ -1,6 +1,28 @@
 #pragma once
 
 #include "frontend_context.hpp"
-#include "lexer_result.hpp"
+#include "token.hpp"
 
-LexerResult tokenize(Frontend::Context);
+// Turns source code into tokens on demand, one at a time, so that the parser
+// never needs the whole token sequence in memory.
+//
+// Token text points into the source buffer, so the source has to outlive
+// every token the lexer produces.
+struct Lexer {
+	// Starts lexing at the given offset into the source. Token offsets are
+	// still measured from the start of the source.
+	explicit Lexer(Frontend::Context const&, int start_offset = 0);
+
+	// Returns the next token. Once the input is exhausted (or a lexical error
+	// is found), every call returns an END token.
+	Token next();
+
+	Frontend::Context const& file_context() const {
+		return m_file_context;
+	}
+
+  private:
+	Frontend::Context m_file_context;
+	char const* m_cursor;
+	bool m_failed {false};
+};
@@ -6,9 +6,11 @@
 #include "cst.hpp"
 #include "cst_allocator.hpp"
 #include "frontend_context.hpp"
-#include "lexer_result.hpp"
+#include "lexer.hpp"
 
+#include <algorithm>
 #include <sstream>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -19,20 +21,61 @@ Writer<T> make_writer(T x) {
 	return {{}, std::move(x)};
 }
 
+// Pulls tokens out of the lexer as the parser asks for them, keeping only a
+// small window of lookahead around. A token returned by peek() is overwritten
+// once the stream moves `lookahead` tokens past it, so anything that outlives
+// that has to be copied (see Parser::keep).
+struct TokenStream {
+	static constexpr int lookahead = 4;
+	static_assert((lookahead & (lookahead - 1)) == 0, "lookahead must be a power of two");
+
+	Lexer m_lexer;
+	Token m_ring[lookahead];
+	int m_head {0};     // index of the current token in m_ring
+	int m_buffered {0}; // number of tokens lexed but not consumed yet
+
+	TokenStream(Lexer lexer)
+	    : m_lexer {std::move(lexer)} {}
+
+	Token const& peek(int dt) {
+		assert(0 <= dt && dt < lookahead);
+		while (m_buffered <= dt) {
+			m_ring[(m_head + m_buffered) & (lookahead - 1)] = m_lexer.next();
+			m_buffered += 1;
+		}
+		return m_ring[(m_head + dt) & (lookahead - 1)];
+	}
+
+	void advance() {
+		peek(0);
+		m_head = (m_head + 1) & (lookahead - 1);
+		m_buffered -= 1;
+	}
+};
+
+// What the preparser learns about a top level declaration without building
+// its CST: where it starts, its name, and every identifier it mentions.
+struct PreparsedDeclaration {
+	int m_start_offset;
+	string_view m_name;
+	bool m_is_function;
+	std::vector<string_view> m_references;
+};
 
 struct Parser {
 	/* token handler */
-	std::vector<Token> const& m_tokens;
+	TokenStream m_tokens;
 	Frontend::Context const& m_file_context;
 	CST::Allocator& m_cst_allocator;
-	int m_token_cursor { 0 };
 
-	Parser(std::vector<Token> const& tokens, Frontend::Context const& file_context, CST::Allocator& cst_allocator)
-	    : m_tokens {tokens}
+	Parser(Frontend::Context const& file_context, CST::Allocator& cst_allocator, int start_offset = 0)
+	    : m_tokens {Lexer {file_context, start_offset}}
 		, m_file_context {file_context}
 	    , m_cst_allocator {cst_allocator} {}
 
 	Writer<CST::Program*> parse_top_level();
+	Writer<CST::Declaration*> parse_top_level_declaration();
+	Writer<PreparsedDeclaration> preparse_declaration();
 
 	Writer<CST::SequenceExpression*> parse_sequence_expression();
 	Writer<CST::MatchExpression*> parse_match_expression();
@@ -69,20 +112,20 @@ struct Parser {
 	Writer<std::pair<std::vector<CST::Identifier>, std::vector<CST::Expr*>>> parse_type_list(bool);
 	Writer<std::pair<Token const*, CST::Expr*>> parse_name_and_type(bool required_type = false);
 
-	ErrorReport make_located_error(string_view text, Token const* token) {
-		SourceLocation token_location = m_file_context.char_offset_to_location(token->m_start_offset);
+	ErrorReport make_located_error(string_view text, Token const& token) {
+		SourceLocation token_location = m_file_context.char_offset_to_location(token.m_start_offset);
 		return ::make_located_error(text, token_location);
 	}
 
-	ErrorReport make_expected_error(string_view expected, Token const* found_token) {
+	ErrorReport make_expected_error(string_view expected, Token const& found_token) {
 		std::stringstream ss;
 
 		ss << "Expected " << expected << " but got ";
 
-		if (found_token->m_type == TokenTag::END) {
+		if (found_token.m_type == TokenTag::END) {
 			ss << "to the end of the file";
 		} else {
-			ss << token_string[int(found_token->m_type)] << ' ' << found_token->m_text;
+			ss << token_string[int(found_token.m_type)] << ' ' << found_token.m_text;
 		}
 
 		ss << " instead";
@@ -90,23 +133,22 @@ struct Parser {
 		return make_located_error(ss.str(), found_token);
 	}
 
-	ErrorReport make_expected_error(TokenTag tag, Token const* found_token) {
+	ErrorReport make_expected_error(TokenTag tag, Token const& found_token) {
 		return make_expected_error(token_string[int(tag)], found_token);
 	}
 
 	void advance_token_cursor() {
-		m_token_cursor += 1;
+		m_tokens.advance();
 	}
 
-	Token const* peek(int dt = 0) {
-		int index = m_token_cursor + dt;
-		return &m_tokens.at(index);
+	Token const& peek(int dt = 0) {
+		return m_tokens.peek(dt);
 	}
 
-	Writer<Token const*> require(TokenTag expected_type) {
-		Token const* current_token = peek();
+	Writer<Token> require(TokenTag expected_type) {
+		Token current_token = peek();
 
-		if (current_token->m_type != expected_type) {
+		if (current_token.m_type != expected_type) {
 			return {make_expected_error(expected_type, current_token)};
 		}
 
@@ -116,8 +158,7 @@ struct Parser {
 	}
 
 	bool match(TokenTag expected_type) {
-		Token const* current_token = peek();
-		return current_token->m_type == expected_type;
+		return peek().m_type == expected_type;
 	}
 
 	bool consume(TokenTag expected_type) {
@@ -132,6 +173,11 @@ struct Parser {
 	T* make(Args&& ...args) {
 		return m_cst_allocator.make<T>(std::forward<Args>(args)...);
 	}
+
+	// copies a token out of the lookahead window, so a CST node can refer to it
+	Token const* keep(Token const& token) {
+		return m_cst_allocator.keep(token);
+	}
 };
 
 // These macros use the non-standard "statement expression" syntax, a GNU
@@ -162,13 +208,75 @@ Writer<CST::Program*> Parser::parse_top_level() {
 
 	std::vector<CST::Declaration*> declarations;
 	while (!match(TokenTag::END)) {
-		declarations.push_back(TRY(parse_declaration()));
+		declarations.push_back(TRY(parse_top_level_declaration()));
 	}
 
 	return make_writer(make<CST::Program>(std::move(declarations)));
 }
 
+Writer<CST::Declaration*> Parser::parse_top_level_declaration() {
+	int start_offset = peek().m_start_offset;
+	auto declaration = TRY(parse_declaration());
+	int end_offset = peek().m_start_offset;
 
+	declaration->m_source = string_view(
+	    m_file_context.source.data() + start_offset, end_offset - start_offset);
+	return make_writer(declaration);
+}
+
+
+/*
+ * The preparser only needs to find where a top level declaration ends, so it
+ * matches brackets and looks for the closing semicolon. Along the way it
+ * records every identifier, which over-approximates what the declaration
+ * refers to. That is all we need to work out which declarations are reachable.
+ */
+Writer<PreparsedDeclaration> Parser::preparse_declaration() {
+	PreparsedDeclaration result;
+	result.m_start_offset = peek().m_start_offset;
+
+	if (consume(TokenTag::KEYWORD_FN)) {
+		result.m_name = REQUIRE(TokenTag::IDENTIFIER).m_text;
+		result.m_is_function = true;
+	} else {
+		result.m_name = REQUIRE(TokenTag::IDENTIFIER).m_text;
+		result.m_is_function =
+		    match(TokenTag::DECLARE_ASSIGN) && peek(1).m_type == TokenTag::KEYWORD_FN;
+	}
+
+	int depth = 0;
+	while (1) {
+		Token token = peek();
+		switch (token.m_type) {
+		case TokenTag::END:
+			return make_expected_error(TokenTag::SEMICOLON, token);
+		case TokenTag::PAREN_OPEN:
+		case TokenTag::BRACE_OPEN:
+		case TokenTag::BRACKET_OPEN:
+			depth += 1;
+			break;
+		case TokenTag::PAREN_CLOSE:
+		case TokenTag::BRACE_CLOSE:
+		case TokenTag::BRACKET_CLOSE:
+			depth -= 1;
+			if (depth < 0)
+				return make_located_error("Unbalanced closing bracket", token);
+			break;
+		case TokenTag::IDENTIFIER:
+			result.m_references.push_back(token.m_text);
+			break;
+		default:
+			break;
+		}
+
+		advance_token_cursor();
+
+		if (token.m_type == TokenTag::SEMICOLON && depth == 0)
+			break;
+	}
+
+	return make_writer(std::move(result));
+}
 
 
 // These are important for infix expression parsing.
@@ -260,7 +368,7 @@ Writer<CST::Expr*> Parser::parse_expression(int bp) {
 Writer<CST::Expr*> Parser::parse_expression(CST::Expr* lhs, int bp) {
 	assert(lhs);
 	while (1) {
-		auto op = peek();
+		Token op = peek();
 
 		if (match(TokenTag::SEMICOLON) ||
 		    match(TokenTag::END) ||
@@ -273,10 +381,10 @@ Writer<CST::Expr*> Parser::parse_expression(CST::Expr* lhs, int bp) {
 			break;
 		}
 
-		if (not is_binary_operator(op->m_type))
+		if (not is_binary_operator(op.m_type))
 			return make_expected_error("a binary operator", op);
 
-		auto op_bp = binding_power_of(op->m_type);
+		auto op_bp = binding_power_of(op.m_type);
 		auto& lp = op_bp.left;
 		auto& rp = op_bp.right;
 
@@ -304,7 +412,7 @@ Writer<CST::Expr*> Parser::parse_expression(CST::Expr* lhs, int bp) {
 		}
 
 		if (consume(TokenTag::DOT)) {
-			lhs = make<CST::AccessExpression>(lhs, REQUIRE(TokenTag::IDENTIFIER));
+			lhs = make<CST::AccessExpression>(lhs, keep(REQUIRE(TokenTag::IDENTIFIER)));
 			continue;
 		}
 
@@ -319,7 +427,7 @@ Writer<CST::Expr*> Parser::parse_expression(CST::Expr* lhs, int bp) {
 		advance_token_cursor();
 		auto rhs = TRY(parse_expression(rp));
 
-		lhs = make<CST::BinaryExpression>(op, lhs, rhs);
+		lhs = make<CST::BinaryExpression>(keep(op), lhs, rhs);
 	}
 
 	return make_writer(lhs);
@@ -329,31 +437,31 @@ Writer<CST::Expr*> Parser::parse_expression(CST::Expr* lhs, int bp) {
  * This is not what the term usually means in the literature.
  */
 Writer<CST::Expr*> Parser::parse_terminal() {
-	auto token = peek();
+	Token token = peek();
 
 	if (consume(TokenTag::KEYWORD_NULL)) {
 		return make_writer(make<CST::NullLiteral>());
 	}
 
 	if (consume(TokenTag::KEYWORD_TRUE)) {
-		return make_writer(make<CST::BooleanLiteral>(token));
+		return make_writer(make<CST::BooleanLiteral>(keep(token)));
 	}
 
 	if (consume(TokenTag::KEYWORD_FALSE)) {
-		return make_writer(make<CST::BooleanLiteral>(token));
+		return make_writer(make<CST::BooleanLiteral>(keep(token)));
 	}
 
 	if (consume(TokenTag::SUB) || consume(TokenTag::ADD)) {
 
 		// NOTE: we store the sign token of the source code for future
 		// feature of printing the source code when an error occurs
-		auto value = peek();
+		Token value = peek();
 
-		bool is_negative = token->m_type == TokenTag::SUB;
+		bool is_negative = token.m_type == TokenTag::SUB;
 		if (consume(TokenTag::INTEGER)) {
-			return make_writer(make<CST::IntegerLiteral>(is_negative, token, value));
+			return make_writer(make<CST::IntegerLiteral>(is_negative, keep(token), keep(value)));
 		} else if (consume(TokenTag::NUMBER)) {
-			return make_writer(make<CST::NumberLiteral>(is_negative, token, value));
+			return make_writer(make<CST::NumberLiteral>(is_negative, keep(token), keep(value)));
 		}
 
 		return is_negative
@@ -362,19 +470,19 @@ Writer<CST::Expr*> Parser::parse_terminal() {
 	}
 
 	if (consume(TokenTag::INTEGER)) {
-		return make_writer(make<CST::IntegerLiteral>(false, nullptr, token));
+		return make_writer(make<CST::IntegerLiteral>(false, nullptr, keep(token)));
 	}
 
 	if (consume(TokenTag::NUMBER)) {
-		return make_writer(make<CST::NumberLiteral>(false, nullptr, token));
+		return make_writer(make<CST::NumberLiteral>(false, nullptr, keep(token)));
 	}
 
 	if (consume(TokenTag::IDENTIFIER)) {
-		return make_writer(make<CST::Identifier>(token));
+		return make_writer(make<CST::Identifier>(keep(token)));
 	}
 
 	if (consume(TokenTag::STRING)) {
-		return make_writer(make<CST::StringLiteral>(token));
+		return make_writer(make<CST::StringLiteral>(keep(token)));
 	}
 
 	if (match(TokenTag::KEYWORD_FN)) {
@@ -442,23 +550,23 @@ Writer<CST::TernaryExpression*> Parser::parse_if_else_expression(CST::Expr* cond
 Writer<CST::Identifier*> Parser::parse_term_identifier() {
 	ErrorReport result = {{"Failed to parse identifier"}};
 
-	Token const* token = REQUIRE_WITH(result, TokenTag::IDENTIFIER);
+	Token token = REQUIRE_WITH(result, TokenTag::IDENTIFIER);
 
-	return make_writer(make<CST::Identifier>(token));
+	return make_writer(make<CST::Identifier>(keep(token)));
 }
 
 Writer<CST::Identifier*> Parser::parse_type_identifier() {
 	ErrorReport result = {{"Failed to parse identifier"}};
 
-	Token const* token = peek();
+	Token token = peek();
 
-	if (token->m_type != TokenTag::KEYWORD_ARRAY && token->m_type != TokenTag::IDENTIFIER) {
+	if (token.m_type != TokenTag::KEYWORD_ARRAY && token.m_type != TokenTag::IDENTIFIER) {
 		return make_expected_error("an identifier or 'array'", token);
 	} else {
 		advance_token_cursor();
 	}
 
-	return make_writer(make<CST::Identifier>(token));
+	return make_writer(make<CST::Identifier>(keep(token)));
 }
 
 Writer<CST::ArrayLiteral*> Parser::parse_array_literal() {
@@ -520,7 +628,7 @@ Writer<CST::MatchExpression*> Parser::parse_match_expression() {
 		REQUIRE_WITH(result, TokenTag::SEMICOLON);
 
 		cases.push_back({
-			case_name,
+			keep(case_name),
 			name_and_type.first,
 			name_and_type.second,
 			expression});
@@ -547,8 +655,8 @@ Writer<CST::Stmt*> Parser::parse_statement() {
 	ErrorReport result = {{"Failed to parse statement"}};
 
 	if (match(TokenTag::IDENTIFIER) &&
-	    (peek(1)->m_type == TokenTag::DECLARE ||
-	     peek(1)->m_type == TokenTag::DECLARE_ASSIGN)) {
+	    (peek(1).m_type == TokenTag::DECLARE ||
+	     peek(1).m_type == TokenTag::DECLARE_ASSIGN)) {
 		return parse_declaration();
 	} else if (match(TokenTag::KEYWORD_RETURN)) {
 		return parse_return_statement();
@@ -591,7 +699,7 @@ Writer<CST::Declaration*> Parser::parse_func_declaration() {
 
 		REQUIRE_WITH(result, TokenTag::SEMICOLON);
 
-		return make_writer(make<CST::FuncDeclaration>(identifier, std::move(args), expression));
+		return make_writer(make<CST::FuncDeclaration>(keep(identifier), std::move(args), expression));
 	}
 
 	if (match(TokenTag::BRACE_OPEN)) {
@@ -599,7 +707,7 @@ Writer<CST::Declaration*> Parser::parse_func_declaration() {
 
 		REQUIRE_WITH(result, TokenTag::SEMICOLON);
 
-		return make_writer(make<CST::BlockFuncDeclaration>(identifier, std::move(args), block));
+		return make_writer(make<CST::BlockFuncDeclaration>(keep(identifier), std::move(args), block));
 	}
 
 	result.add_sub_error(make_expected_error("'=>' or '{'", peek()));
@@ -746,7 +854,7 @@ Writer<CST::Expr*> Parser::parse_type_var() {
 
 	auto token = REQUIRE_WITH(result, TokenTag::IDENTIFIER);
 
-	return make_writer(make<CST::TypeVar>(token));
+	return make_writer(make<CST::TypeVar>(keep(token)));
 }
 
 Writer<CST::Expr*> Parser::parse_type_function() {
@@ -782,7 +890,7 @@ Writer<CST::DeclarationData> Parser::parse_plain_declaration_data() {
 
 	REQUIRE(TokenTag::SEMICOLON);
 
-	return make_writer<CST::DeclarationData>({name, type, value});
+	return make_writer<CST::DeclarationData>({keep(name), type, value});
 }
 
 Writer<CST::FuncParameters> Parser::parse_function_parameters() {
@@ -798,10 +906,8 @@ Writer<CST::FuncParameters> Parser::parse_function_parameters() {
 		if (!match(TokenTag::IDENTIFIER))
 			return make_expected_error("a parameter name", peek());
 
-		CST::DeclarationData arg_data;
-
 		// consume parameter name
-		arg_data.m_identifier_token = peek();
+		CST::DeclarationData arg_data {keep(peek()), nullptr, nullptr};
 		advance_token_cursor();
 
 		// optionally consume a type hint
@@ -852,7 +958,7 @@ Writer<std::vector<CST::Expr*>> Parser::parse_expression_list(
 
 		expressions.push_back(TRY(parse_expression()));
 
-		auto p0 = peek();
+		Token p0 = peek();
 
 		if (consume(delimiter)) {
 
@@ -917,18 +1023,130 @@ Writer<std::pair<Token const*, CST::Expr*>> Parser::parse_name_and_type(bool req
 		type = TRY_WITH(result, parse_type_term());
 	}
 
-	return make_writer<std::pair<Token const*, CST::Expr*>>({name, type});
+	return make_writer<std::pair<Token const*, CST::Expr*>>({keep(name), type});
 }
 
 
-ParserResult<CST::Program> parse_program(LexerResult lexer_result, CST::Allocator& allocator) {
-	Parser p {lexer_result.tokens, lexer_result.file_context, allocator};
+ParserResult<CST::Program> parse_program(Frontend::Context const& file_context, CST::Allocator& allocator) {
+	Parser p {file_context, allocator};
 	Writer<CST::Program*> w = p.parse_top_level();
-	return {w.m_result, std::move(w.m_error), std::move(lexer_result.tokens), std::move(lexer_result.file_context)};
+	return {w.m_result, std::move(w.m_error), file_context};
+}
+
+ParserResult<CST::Program> parse_program_lazily(
+    Frontend::Context const& file_context,
+    CST::Allocator& allocator,
+    string_view entry_point,
+    SkippedDeclarations& skipped) {
+
+	std::vector<PreparsedDeclaration> preparsed;
+	{
+		Parser p {file_context, allocator};
+		while (!p.match(TokenTag::END)) {
+			auto w = p.preparse_declaration();
+
+			// Let the full parser find and report the error
+			if (!w.ok())
+				return parse_program(file_context, allocator);
+
+			preparsed.push_back(std::move(w.m_result));
+		}
+	}
+
+	int const n = preparsed.size();
+	std::unordered_map<string_view, int> index_of;
+	std::vector<bool> reachable(n, false);
+	std::vector<int> pending;
+
+	auto reach = [&](int i) {
+		if (!reachable[i]) {
+			reachable[i] = true;
+			pending.push_back(i);
+		}
+	};
+
+	// Values are evaluated at startup, and redeclarations have to reach the
+	// symbol resolver so it can report them, so all of those are roots.
+	for (int i = 0; i < n; ++i) {
+		auto inserted = index_of.insert({preparsed[i].m_name, i});
+		if (!inserted.second) {
+			reach(inserted.first->second);
+			reach(i);
+		}
+		if (!preparsed[i].m_is_function || preparsed[i].m_name == entry_point)
+			reach(i);
+	}
+
+	while (!pending.empty()) {
+		int i = pending.back();
+		pending.pop_back();
+		for (string_view reference : preparsed[i].m_references) {
+			auto it = index_of.find(reference);
+			if (it != index_of.end())
+				reach(it->second);
+		}
+	}
+
+	std::vector<CST::Declaration*> declarations;
+	for (int i = 0; i < n; ++i) {
+		if (!reachable[i]) {
+			skipped.m_entries[preparsed[i].m_name] = {
+			    preparsed[i].m_start_offset, std::move(preparsed[i].m_references)};
+			continue;
+		}
+
+		Parser p {file_context, allocator, preparsed[i].m_start_offset};
+		Writer<CST::Declaration*> w = p.parse_top_level_declaration();
+		if (!w.ok())
+			return {nullptr, std::move(w.m_error), file_context};
+
+		declarations.push_back(w.m_result);
+	}
+
+	auto program = allocator.make<CST::Program>(std::move(declarations));
+	return {program, {}, file_context};
+}
+
+ParserResult<CST::Program> parse_skipped_declarations(
+    Frontend::Context const& file_context,
+    CST::Allocator& allocator,
+    SkippedDeclarations& skipped,
+    std::vector<string_view> const& names) {
+
+	std::vector<SkippedDeclarations::Entry> found;
+	std::vector<string_view> pending = names;
+	while (!pending.empty()) {
+		auto it = skipped.m_entries.find(pending.back());
+		pending.pop_back();
+		if (it == skipped.m_entries.end())
+			continue;
+
+		for (string_view reference : it->second.m_references)
+			pending.push_back(reference);
+		found.push_back(std::move(it->second));
+		skipped.m_entries.erase(it);
+	}
+
+	std::sort(found.begin(), found.end(), [](auto const& a, auto const& b) {
+		return a.m_start_offset < b.m_start_offset;
+	});
+
+	std::vector<CST::Declaration*> declarations;
+	for (auto const& entry : found) {
+		Parser p {file_context, allocator, entry.m_start_offset};
+		Writer<CST::Declaration*> w = p.parse_declaration();
+		if (!w.ok())
+			return {nullptr, std::move(w.m_error), file_context};
+
+		declarations.push_back(w.m_result);
+	}
+
+	auto program = allocator.make<CST::Program>(std::move(declarations));
+	return {program, {}, file_context};
 }
 
-ParserResult<CST::Expr> parse_expression(LexerResult lexer_result, CST::Allocator& allocator) {
-	Parser p {lexer_result.tokens, lexer_result.file_context, allocator};
+ParserResult<CST::Expr> parse_expression(Frontend::Context const& file_context, CST::Allocator& allocator) {
+	Parser p {file_context, allocator};
 	Writer<CST::Expr*> w = p.parse_expression();
-	return {w.m_result, std::move(w.m_error), std::move(lexer_result.tokens), std::move(lexer_result.file_context)};
+	return {w.m_result, std::move(w.m_error), file_context};
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 
-#include "./lexer_result.hpp"
+#include "./frontend_context.hpp"
 #include "./parser_result.hpp"
 
 namespace CST {
@@ -11,5 +13,36 @@ struct Program;
 struct Expr;
 }
 
-ParserResult<CST::Program> parse_program(LexerResult, CST::Allocator&);
-ParserResult<CST::Expr> parse_expression(LexerResult, CST::Allocator&);
+ParserResult<CST::Program> parse_program(Frontend::Context const&, CST::Allocator&);
+
+// The top level functions that parse_program_lazily left out, by name: where
+// each one starts, and every identifier it mentions.
+struct SkippedDeclarations {
+	struct Entry {
+		int m_start_offset;
+		std::vector<string_view> m_references;
+	};
+
+	std::unordered_map<string_view, Entry> m_entries;
+};
+
+// Like parse_program, but the first pass only matches brackets to find where
+// each top level declaration ends. Then only the declarations reachable from
+// `entry_point`, or from a top level value, are fully parsed. The rest are
+// recorded in `skipped`, and don't reach the later stages unless they are
+// parsed with parse_skipped_declarations.
+ParserResult<CST::Program> parse_program_lazily(
+    Frontend::Context const&,
+    CST::Allocator&,
+    string_view entry_point,
+    SkippedDeclarations& skipped);
+
+// Fully parses the skipped declarations named in `names`, along with the
+// skipped declarations those mention in turn, and removes them from
+// `skipped`. They come back in source order.
+ParserResult<CST::Program> parse_skipped_declarations(
+    Frontend::Context const&,
+    CST::Allocator&,
+    SkippedDeclarations& skipped,
+    std::vector<string_view> const& names);
+ParserResult<CST::Expr> parse_expression(Frontend::Context const&, CST::Allocator&);
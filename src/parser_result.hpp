@@ -9,11 +9,10 @@ template<typename T>
 struct ParserResult {
 	// TODO: check that T is CST or a subtype of CST
 
-	ParserResult(T* cst, ErrorReport error, std::vector<Token> tokens, Frontend::Context file_context)
+	ParserResult(T* cst, ErrorReport error, Frontend::Context file_context)
 	    : m_cst {cst}
 		, m_file_context {std::move(file_context)}
-	    , m_error {std::move(error)}
-		, m_tokens {std::move(tokens)} {}
+	    , m_error {std::move(error)} {}
 
 	bool ok() const {
 		return m_error.ok();
@@ -36,5 +35,4 @@ private:
 	T* m_cst;
 	Frontend::Context m_file_context;
 	ErrorReport m_error;
-	std::vector<Token> m_tokens;
 };
@@ -1,13 +1,10 @@
-#include <fstream>
 #include <iostream>
-#include <sstream>
-#include <string>
 
 #include "../ast.hpp"
 #include "../ast_allocator.hpp"
 #include "../cst_allocator.hpp"
-#include "../lexer.hpp"
 #include "../parser.hpp"
+#include "../utils/file_contents.hpp"
 
 int main(int argc, char** argv) {
 
@@ -16,26 +13,17 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
-	std::ifstream in_fs(argv[1]);
-	if (!in_fs.good()) {
-		std::cout << "Failed to open '" << argv[1] << "'" << std::endl;
+	auto file = read_file(argv[1]);
+	if (!file.ok()) {
+		std::cout << file.error().m_text << std::endl;
 		return 1;
 	}
 
-	std::stringstream file_content;
-	std::string line;
-
-	while (std::getline(in_fs, line)) {
-		file_content << line << '\n';
-	}
-
-	std::string source = file_content.str();
+	string_view source = file.m_result.view();
 
 	{
-		auto ta = tokenize({source});
-
 		CST::Allocator cst_allocator;
-		auto parse_result = parse_program(ta, cst_allocator);
+		auto parse_result = parse_program({source}, cst_allocator);
 
 		if (not parse_result.ok()) {
 			parse_result.error().print();
@@ -100,7 +100,7 @@ private:
 			auto token = ast->token();
 			SourceLocation token_location = file_context.char_offset_to_location(token->m_start_offset);
 			return make_located_error(
-				"accessed undeclared identifier '" + ast->text().str() + "'",
+				"accessed undeclared identifier '" + ast->text().str().to_string() + "'",
 				token_location);
 		}
 
@@ -187,7 +187,7 @@ private:
 		if (ast->m_value) {
 			CHECK_AND_WRAP(
 			    resolve(ast->m_value),
-			    "While scanning declaration '" + ast->identifier_text().str() + "'");
+			    "While scanning declaration '" + ast->identifier_text().str().to_string() + "'");
 		}
 
 		return {};
@@ -385,7 +385,7 @@ private:
 				CHECK_AND_WRAP(
 					resolve(decl.m_value),
 					"While scanning top level declaration '" +
-						decl.identifier_text().str() + "'");
+						decl.identifier_text().str().to_string() + "'");
 
 			top_level.exit();
 		}
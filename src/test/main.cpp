@@ -1,14 +1,77 @@
 #include <cassert>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "../algorithms/tarjan_solver.hpp"
+#include "../ast.hpp"
+#include "../ast_allocator.hpp"
+#include "../convert_ast.hpp"
+#include "../cst_allocator.hpp"
 #include "../interpreter/execute.hpp"
+#include "../interpreter/garbage_collector.hpp"
+#include "../interpreter/image.hpp"
+#include "../interpreter/input.hpp"
+#include "../interpreter/interpreter.hpp"
+#include "../interpreter/isolate.hpp"
+#include "../interpreter/native.hpp"
+#include "../interpreter/output.hpp"
+#include "../interpreter/task.hpp"
+#include "../parser.hpp"
+#include "../symbol_resolution.hpp"
+#include "../symbol_table.hpp"
+#include "../typechecker/check_cache.hpp"
+#include "../typechecker/core.hpp"
+#include "../typechecker/ct_eval.hpp"
+#include "../typechecker/metacheck.hpp"
+#include "../typechecker/typecheck.hpp"
+#include "../typechecker/typechecker.hpp"
+#include "../utils/char_scan.hpp"
+#include "../utils/file_contents.hpp"
+#include "../utils/flat_map.hpp"
 #include "../utils/string_set.hpp"
 #include "test_status_tag.hpp"
 #include "test_utils.hpp"
 #include "tester.hpp"
 
+// A file in /tmp, which is removed when it goes out of scope, so a test
+// that fails halfway doesn't leave it behind
+struct TempFile {
+	std::string m_path;
+	int m_fd;
+
+	explicit TempFile(char const* name)
+	    : m_path {"/tmp/" + std::string(name) + "_XXXXXX"}
+	    , m_fd {mkstemp(&m_path[0])} {}
+
+	TempFile(TempFile const&) = delete;
+	TempFile& operator=(TempFile const&) = delete;
+
+	~TempFile() {
+		if (m_fd >= 0) {
+			close(m_fd);
+			unlink(m_path.c_str());
+		}
+	}
+
+	bool ok() const {
+		return m_fd >= 0;
+	}
+
+	char const* path() const {
+		return m_path.c_str();
+	}
+
+	bool write(std::string const& contents) {
+		return ::write(m_fd, contents.data(), contents.size()) == ssize_t(contents.size());
+	}
+};
+
 #define EQUALS(expr, value)                                                    \
 	+[](Interpreter::Interpreter& env,                                         \
 	    Frontend::SymbolTable& context) -> ExitStatus {                        \
@@ -119,7 +182,8 @@ void interpreter_tests(Test::Tester& tests) {
 	            EQUALS("b", "hello"),
 	            ARRAY_OF_SIZE("c", 2),
 	            ARRAY_OF_SIZE("__invoke()", 3),
-	            EQUALS("extract()", 4)}));
+	            EQUALS("extract()", 4),
+	            EQUALS("poly_id()", 1)}));
 
 	    tests.add_test(std::make_unique<Test::InterpreterTestSet>(
 	        "tests/union.jp",
@@ -179,6 +243,29 @@ void tarjan_algorithm_tests(Test::Tester& tester) {
 			            TestStatus::Fail,
 			            "SCCs should be in reverse topological sort."};
 
+		        return {TestStatus::Ok};
+	        },
+	        +[]() -> TestReport {
+		        // two cycles {0, 1} and {2, 3}, with both 0 and 1 pointing at 2,
+		        // and an isolated vertex 4
+		        TarjanSolver solver(5);
+		        solver.add_edge(0, 1);
+		        solver.add_edge(1, 0);
+		        solver.add_edge(2, 3);
+		        solver.add_edge(3, 2);
+		        solver.add_edge(0, 2);
+		        solver.add_edge(1, 2);
+		        solver.solve();
+
+		        auto const& cov = solver.component_of_vertices();
+		        auto const& edges = solver.edges_of_components();
+
+		        if (edges[cov[0]] != std::vector<int> {cov[2]})
+			        return {TestStatus::Fail, "Edges between components should be merged"};
+
+		        if (!edges[cov[2]].empty() || !edges[cov[4]].empty())
+			        return {TestStatus::Fail, "Edges inside a component should be dropped"};
+
 		        return {TestStatus::Ok};
 	        }}));
 }
@@ -205,6 +292,1285 @@ void string_set_tests(Test::Tester& tester) {
 			    return {TestStatus::Fail, "BBB is not in the set after inserting it"};
 
 		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    StringSet s;
+		    auto first = s.insert("AAA");
+		    auto second = s.insert(std::string {"AAA"});
+		    if (!first.second || second.second || first.first != second.first)
+			    return {TestStatus::Fail, "Inserting AAA twice should yield the same entry"};
+
+		    // larger than an arena block, so it lands in a block of its own
+		    std::string big(64 * 1024, 'x');
+		    auto big_entry = s.insert(big).first;
+		    for (int i = 0; i < 1000; ++i)
+			    s.insert(std::to_string(i));
+
+		    if (big_entry->view() != string_view {big})
+			    return {TestStatus::Fail, "Entries should survive rehashing"};
+
+		    if (first.first->data()[first.first->length] != '\0')
+			    return {TestStatus::Fail, "Entries should be NUL-terminated"};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    // each thread interns the same names, through a different
+		    // constructor, so they race on the same entries
+		    constexpr int thread_count = 4;
+		    constexpr int name_count = 2000;
+		    std::vector<std::vector<InternedString>> results(thread_count);
+
+		    auto run = [&](int which) {
+			    for (int i = 0; i < name_count; ++i) {
+				    std::string name = "interned_from_threads_" + std::to_string(i);
+				    switch (which) {
+				    case 0: results[which].push_back(InternedString {name}); break;
+				    case 1: results[which].push_back(InternedString {name.c_str()}); break;
+				    case 2: results[which].push_back(InternedString {string_view {name}}); break;
+				    case 3:
+					    results[which].push_back(InternedString {name.c_str(), name.size()});
+					    break;
+				    }
+			    }
+		    };
+
+		    std::vector<std::thread> threads;
+		    for (int i = 0; i < thread_count; ++i)
+			    threads.emplace_back(run, i);
+		    for (auto& thread : threads)
+			    thread.join();
+
+		    for (int i = 0; i < name_count; ++i) {
+			    std::string name = "interned_from_threads_" + std::to_string(i);
+			    for (int which = 0; which < thread_count; ++which)
+				    if (!(results[which][i] == results[0][i]) ||
+				        results[which][i].str() != string_view {name})
+					    return {TestStatus::Fail, "Every thread should get the same entries"};
+		    }
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void char_scan_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    // try every starting alignment and run length, so that we cover
+		    // runs that start, end, and span vector block boundaries
+		    for (int start = 0; start < 64; ++start) {
+			    for (int length = 0; length < 96; ++length) {
+				    std::string prefix(start, '#');
+
+				    std::string ws = prefix + std::string(length, ' ') + "x";
+				    if (skip_whitespace(ws.c_str() + start) != ws.c_str() + start + length)
+					    return {TestStatus::Fail, "skip_whitespace stopped at the wrong place"};
+
+				    std::string id = prefix + std::string(length, 'a') + "+";
+				    if (skip_identifier_chars(id.c_str() + start) != id.c_str() + start + length)
+					    return {TestStatus::Fail, "skip_identifier_chars stopped at the wrong place"};
+
+				    std::string str = prefix + std::string(length, 'a') + "\"";
+				    if (find_char_or_nul(str.c_str() + start, '"') != str.c_str() + start + length)
+					    return {TestStatus::Fail, "find_char_or_nul missed the character"};
+
+				    std::string nul = prefix + std::string(length, 'a');
+				    if (find_char_or_nul(nul.c_str() + start, '"') != nul.c_str() + start + length)
+					    return {TestStatus::Fail, "find_char_or_nul missed the terminator"};
+			    }
+		    }
+
+		    char const* mixed = "aZ_09[`{@/:";
+		    if (skip_identifier_chars(mixed) != mixed + 5)
+			    return {TestStatus::Fail, "skip_identifier_chars accepted a non identifier character"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void flat_map_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    FlatMap<int, int> map {{{5, 50}, {1, 10}, {3, 30}}};
+
+		    if (!map.find(1) || *map.find(1) != 10 || map.find(2))
+			    return {TestStatus::Fail, "find should only see the inserted keys"};
+
+		    if (map.insert(3, 0) || !map.insert(2, 20) || *map.find(3) != 30)
+			    return {TestStatus::Fail, "insert should not overwrite existing keys"};
+
+		    FlatMap<int, int> other {{{0, 0}, {3, 31}, {6, 60}}};
+		    std::vector<std::pair<int, int>> both;
+		    map.merge(other, [&](int ours, int theirs) { both.push_back({ours, theirs}); });
+
+		    std::vector<int> keys;
+		    for (auto const& entry : map)
+			    keys.push_back(entry.first);
+
+		    if (keys != std::vector<int> {0, 1, 2, 3, 5, 6})
+			    return {TestStatus::Fail, "merge should keep the keys sorted and unique"};
+
+		    if (both.size() != 1 || both[0] != std::make_pair(30, 31) || *map.find(3) != 30)
+			    return {TestStatus::Fail, "merge should report the keys present in both maps"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void file_contents_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    // small files are read, and so are sizes that are multiples of
+		    // the page size, which have no room for the terminator in the
+		    // mapping. The rest are mapped.
+		    long page = sysconf(_SC_PAGESIZE);
+		    long big = 1 << 16;
+		    for (long size : {0L, 10L, page - 1, page, big + 1, 2 * big, 2 * big + 1}) {
+			    TempFile temp {"jasper_file_contents"};
+			    if (!temp.ok())
+				    return {TestStatus::Error, "Failed to create a temporary file"};
+
+			    std::string content;
+			    for (long i = 0; i < size; ++i)
+				    content.push_back('a' + i % 26);
+			    if (!temp.write(content))
+				    return {TestStatus::Error, "Failed to write a temporary file"};
+
+			    auto file = read_file(temp.path());
+			    if (!file.ok())
+				    return {TestStatus::Fail, "Failed to read back a temporary file"};
+
+			    string_view view = file.m_result.view();
+			    if (view != string_view {content})
+				    return {TestStatus::Fail, "File contents do not match what was written"};
+
+			    if (view.data()[view.size()] != '\0')
+				    return {TestStatus::Fail, "File contents should be NUL-terminated"};
+
+			    bool should_map = size >= big && size % page != 0;
+			    if (file.m_result.is_mapped() != should_map)
+				    return {TestStatus::Fail, "Only big files with room for the terminator should be mapped"};
+		    }
+
+		    if (read_file("/nonexistent/jasper/file").ok())
+			    return {TestStatus::Fail, "Reading a missing file should fail"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void type_system_core_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    TypeSystemCore core;
+		    TypeFunc function = core.new_builtin_type_function(-1);
+		    TypeFunc integer = core.new_builtin_type_function(0);
+
+		    Type int_a = core.new_term(integer, {});
+		    Type int_b = core.new_term(integer, {});
+		    if (int_a != int_b)
+			    return {TestStatus::Fail, "Equal ground terms should be shared"};
+
+		    Type int_to_int_a = core.new_term(function, {int_a, int_a});
+		    Type int_to_int_b = core.new_term(function, {int_b, int_b});
+		    if (int_to_int_a != int_to_int_b)
+			    return {TestStatus::Fail, "Equal nested ground terms should be shared"};
+
+		    Type var = core.ll_new_var();
+		    Type var_to_int_a = core.new_term(function, {var, int_a});
+		    Type var_to_int_b = core.new_term(function, {var, int_a});
+		    if (var_to_int_a == var_to_int_b)
+			    return {TestStatus::Fail, "Terms with type variables should not be shared"};
+
+		    core.ll_unify(var_to_int_a, int_to_int_a);
+		    if (core.apply_substitution(var) != int_a)
+			    return {TestStatus::Fail, "Unifying with a shared term should bind the variable"};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    // deep enough that a recursive walk would exhaust the stack
+		    int const depth = 200000;
+
+		    TypeSystemCore core;
+		    TypeFunc array = core.new_builtin_type_function(1);
+
+		    std::vector<Type> vars;
+		    for (int i = 0; i < depth; ++i)
+			    vars.push_back(core.ll_new_var());
+		    for (int i = 1; i < depth; ++i)
+			    core.ll_unify(vars[i - 1], vars[i]);
+
+		    Type nested = core.ll_new_var();
+		    for (int i = 0; i < depth; ++i)
+			    nested = core.new_term(array, {nested});
+
+		    core.ll_unify(vars[0], nested);
+		    if (core.apply_substitution(vars[depth - 1]) != nested)
+			    return {TestStatus::Fail, "Deep terms should be unified and substituted without recursion"};
+
+		    // generalizing walks the whole term to find its variables, and
+		    // instantiating rebuilds it
+		    auto free_vars = core.free_vars(nested);
+		    if (free_vars.size() != 1)
+			    return {TestStatus::Fail, "A deep term should have the variable at its bottom free"};
+		    PolyId poly = core.forall({free_vars.begin(), free_vars.end()}, nested);
+		    Type left = core.inst_fresh(poly);
+		    Type right = core.inst_fresh(poly);
+		    if (left == right || core.free_vars(left) == core.free_vars(right))
+			    return {TestStatus::Fail, "Instances of a deep type should have fresh variables"};
+
+		    // and unifying two deep terms walks them side by side
+		    core.ll_unify(left, right);
+		    if (core.free_vars(core.apply_substitution(left)) !=
+		        core.free_vars(core.apply_substitution(right)))
+			    return {TestStatus::Fail, "Deep terms should be unified without recursion"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void lazy_declaration_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    // nothing reaches `unused`, so its body is never parsed, and the
+		    // syntax error in it goes unnoticed. `twice` is only reached from
+		    // an expression evaluated later on, so it's parsed then.
+		    char const* source =
+		        "helper := fn(x) => x + 1;\n"
+		        "unused := fn() { return helper(1 + ); };\n"
+		        "id := fn(x) => x;\n"
+		        "value := id(5);\n"
+		        "twice := fn(x) => double(helper(x));\n"
+		        "double := fn(x) => x * 2;\n"
+		        "__invoke := fn() => helper(value);\n";
+
+		    Interpreter::ExecuteSettings settings;
+		    settings.lazy_declarations = true;
+
+		    auto status = Interpreter::execute(
+		        source,
+		        settings,
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        if (context.access("unused") || context.access("twice"))
+				        return ExitStatus::StaticError;
+			        auto status = Assert::equals(eval_expression("__invoke()", env, context), 6);
+			        if (status != ExitStatus::Ok)
+				        return status;
+			        return Assert::equals(eval_expression("twice(3)", env, context), 8);
+		        });
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "Lazy mode should only process reachable declarations"};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    Interpreter::ExecuteSettings settings;
+		    settings.check_only = true;
+
+		    auto status = Interpreter::execute(
+		        "unused := fn() => 1;\n",
+		        settings,
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        return ExitStatus::Empty;
+		        });
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "Check mode should stop before running"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void parallel_typecheck_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    // Enough independent functions for every worker to get some.
+		    // The polymorphic ones are imported from the workers, and used
+		    // at two types each. The ones that append to `log` refer to its
+		    // type, which still has a free variable, so they are inferred
+		    // in the shared core.
+		    std::string source = "log := array {};\n";
+		    std::string uses = "0";
+		    for (int k = 0; k < 60; ++k) {
+			    std::string name = "f" + std::to_string(k);
+			    switch (k % 3) {
+			    case 0:
+				    source += name + " := fn(x) => x;\n";
+				    uses += " + " + name + "(1) + size(" + name + "(array { \"a\"; }))";
+				    break;
+			    case 1:
+				    source += name + " := fn(x, y) => array { x; y; };\n";
+				    uses += " + size(" + name + "(1, 2)) + size(" + name + "(\"a\", \"b\"))";
+				    break;
+			    case 2:
+				    source += name + " := fn(x) { array_append(log, x); return x; };\n";
+				    uses += " + " + name + "(" + std::to_string(k) + ")";
+				    break;
+			    }
+		    }
+		    source += "__invoke := fn() => " + uses + " + size(log);\n";
+
+		    Interpreter::ExecuteSettings settings;
+		    settings.typecheck_threads = 4;
+
+		    auto status = Interpreter::execute(
+		        source,
+		        settings,
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        return Assert::equals(eval_expression("__invoke()", env, context), 750);
+		        });
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "Components inferred on workers should get the same types"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void check_cache_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    TempFile cache {"jasper_check_cache"};
+		    if (!cache.ok())
+			    return {TestStatus::Error, "Failed to create a temporary file"};
+
+		    // an empty file is not a cache we wrote, so it counts as empty
+		    if (!TypeChecker::load_check_cache(cache.path()).m_checked.empty())
+			    return {TestStatus::Fail, "A file without the header should load as an empty cache"};
+
+		    Interpreter::ExecuteSettings settings;
+		    settings.check_cache = cache.path();
+
+		    auto run = [&](char const* source) {
+			    return Interpreter::execute(
+			        source,
+			        settings,
+			        +[](Interpreter::Interpreter& env,
+			            Frontend::SymbolTable& context) -> ExitStatus {
+				        return Assert::equals(eval_expression("__invoke()", env, context), 7);
+			        });
+		    };
+
+		    // the first run checks everything, the second one nothing, and
+		    // the third only what changed and what depends on it
+		    ExitStatus first = run(
+		        "id := fn(x) => x;\n"
+		        "inc := fn(x) => x + 1;\n"
+		        "__invoke := fn() => inc(id(6));\n");
+		    int cached = TypeChecker::load_check_cache(cache.path()).m_checked.size();
+		    ExitStatus second = run(
+		        "id := fn(x) => x;\n"
+		        "inc := fn(x) => x + 1;\n"
+		        "__invoke := fn() => inc(id(6));\n");
+		    ExitStatus third = run(
+		        "id := fn(x) => x;\n"
+		        "inc := fn(x) => id(x) + 1;\n"
+		        "__invoke := fn() => inc(id(6));\n");
+		    int recached = TypeChecker::load_check_cache(cache.path()).m_checked.size();
+
+		    if (first != ExitStatus::Ok || second != ExitStatus::Ok || third != ExitStatus::Ok)
+			    return {TestStatus::Fail, "Programs should run the same with a check cache"};
+
+		    if (cached != 3 || recached != 3)
+			    return {TestStatus::Fail, "The cache should hold one fingerprint per component"};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    TempFile cache_file {"jasper_check_cache"};
+		    if (!cache_file.ok())
+			    return {TestStatus::Error, "Failed to create a temporary file"};
+
+		    Interpreter::ExecuteSettings settings;
+		    settings.check_cache = cache_file.path();
+		    auto first = Interpreter::execute(
+		        "id := fn(x) => x;\n"
+		        "pair := fn(x, y) => array { x; y; };\n"
+		        "__invoke := fn() => size(pair(id(1), 2));\n",
+		        settings,
+		        +[](Interpreter::Interpreter& env, Frontend::SymbolTable& context) -> ExitStatus {
+			        return Assert::equals(eval_expression("__invoke()", env, context), 2);
+		        });
+		    if (first != ExitStatus::Ok)
+			    return {TestStatus::Fail, "The first run should check everything"};
+
+		    // only __invoke changes, and it uses what it calls at new types
+		    char const* edited =
+		        "id := fn(x) => x;\n"
+		        "pair := fn(x, y) => array { x; y; };\n"
+		        "__invoke := fn() => id(10) + size(pair(\"a\", id(\"b\")));\n";
+
+		    // go through the front end by hand, to see what gets checked
+		    CST::Allocator cst_allocator;
+		    AST::Allocator ast_allocator;
+		    Frontend::Context file_context {edited};
+		    auto parse_result = parse_program(file_context, cst_allocator);
+		    if (!parse_result.ok())
+			    return {TestStatus::Error, "The edited program should parse"};
+
+		    auto ast = AST::convert_program(parse_result.cst(), ast_allocator);
+		    TypeChecker::TypeChecker tc {ast_allocator};
+		    Frontend::SymbolTable context;
+		    for (auto& bucket : tc.m_builtin_declarations.m_buckets)
+			    for (auto& decl : bucket)
+				    context.declare(&decl);
+		    if (!Frontend::resolve_symbols_program(ast, file_context, context).ok())
+			    return {TestStatus::Error, "The edited program should resolve"};
+
+		    tc.compute_declaration_order(ast);
+		    TypeChecker::metacheck_program(ast);
+		    TypeChecker::reify_types(ast, tc);
+
+		    auto cache = TypeChecker::load_check_cache(cache_file.path());
+		    auto fingerprints = TypeChecker::fingerprint_components(tc);
+		    auto needs_check = TypeChecker::components_to_check(tc, fingerprints, cache);
+
+		    int checked = 0;
+		    AST::Declaration* pair = nullptr;
+		    for (int c = 0; c < int(needs_check.size()); ++c) {
+			    for (auto decl : tc.declaration_order()[c]) {
+				    if (decl->identifier_text() == InternedString {"pair"})
+					    pair = decl;
+				    if (needs_check[c] && !(decl->identifier_text() == InternedString {"__invoke"}))
+					    return {TestStatus::Fail, "Unchanged components should not be checked"};
+			    }
+			    checked += needs_check[c];
+		    }
+		    if (checked != 1)
+			    return {TestStatus::Fail, "The edited component should be checked"};
+
+		    if (!TypeChecker::restore_cached_types(tc, fingerprints, cache, needs_check) ||
+		        !pair->m_is_polymorphic || tc.core().poly_vars(pair->m_decl_type).size() != 1)
+			    return {TestStatus::Fail, "The generalized types of what it uses should be restored"};
+		    TypeChecker::typecheck_program(ast, tc, needs_check);
+
+		    auto second = Interpreter::execute(
+		        edited,
+		        settings,
+		        +[](Interpreter::Interpreter& env, Frontend::SymbolTable& context) -> ExitStatus {
+			        return Assert::equals(eval_expression("__invoke()", env, context), 12);
+		        });
+
+		    if (second != ExitStatus::Ok)
+			    return {TestStatus::Fail, "Programs should run the same with restored types"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void image_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    TempFile image_file {"jasper_image"};
+		    if (!image_file.ok())
+			    return {TestStatus::Error, "Failed to create a temporary file"};
+
+		    Interpreter::ExecuteSettings settings;
+		    settings.compile_to = image_file.path();
+
+		    auto compiled = Interpreter::execute(
+		        "point := struct { x : int<::>; y : int<::>; };\n"
+		        "sum := fn(p) => p.x + p.y;\n"
+		        "__invoke := fn() {\n"
+		        "	total := 0;\n"
+		        "	add := fn(n) { total = total + n; };\n"
+		        "	add(sum(point<::>{ 3; 4; }));\n"
+		        "	return total;\n"
+		        "};\n",
+		        settings,
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        return ExitStatus::Empty;
+		        });
+
+		    auto image = read_file(image_file.path());
+		    if (compiled != ExitStatus::Ok || !image.ok())
+			    return {TestStatus::Fail, "Failed to write a program image"};
+
+		    string_view contents = image.m_result.view();
+		    if (!Interpreter::is_image(contents))
+			    return {TestStatus::Fail, "A written image should be recognized as one"};
+
+		    auto status = Interpreter::execute_image(contents, EQUALS("__invoke()", 7));
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "A program image should run like its source"};
+
+		    std::string truncated = contents.to_string();
+		    truncated.pop_back();
+		    Interpreter::GC gc;
+		    Interpreter::Interpreter env {&gc, nullptr};
+		    AST::Allocator allocator;
+		    auto truncated_result = Interpreter::read_image(truncated, allocator, env);
+		    if (truncated_result.ok())
+			    return {TestStatus::Fail, "A truncated image should be rejected"};
+		    if (truncated_result.error().m_text != "The program image is corrupt")
+			    return {TestStatus::Fail, "A truncated image should be reported as corrupt"};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    TempFile image_file {"jasper_image"};
+		    if (!image_file.ok())
+			    return {TestStatus::Error, "Failed to create a temporary file"};
+
+		    Interpreter::ExecuteSettings settings;
+		    settings.compile_to = image_file.path();
+		    auto compiled = Interpreter::execute(
+		        "x := 1;\n",
+		        settings,
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        return ExitStatus::Empty;
+		        });
+
+		    auto image = read_file(image_file.path());
+		    if (compiled != ExitStatus::Ok || !image.ok())
+			    return {TestStatus::Fail, "Failed to write a program image"};
+
+		    // the magic and the version, followed by a declaration of `x`
+		    // whose value is an array literal nested `depth` times
+		    auto nested_image = [&](int depth) {
+			    std::string result = image.m_result.view().to_string().substr(0, 12);
+			    auto put = [&](uint32_t n) {
+				    result.append(reinterpret_cast<char const*>(&n), sizeof(n));
+			    };
+			    put(1); // strings
+			    put(1);
+			    result += 'x';
+			    put(1); // components
+			    put(1); // declarations
+			    put(0);
+			    for (int i = 0; i < depth; ++i) {
+				    result += char(AST::ExprTag::ArrayLiteral);
+				    put(1);
+			    }
+			    result += char(AST::ExprTag::IntegerLiteral);
+			    put(0);
+			    result += '\0'; // no heap snapshot
+			    return result;
+		    };
+
+		    Interpreter::GC gc;
+		    Interpreter::Interpreter env {&gc, nullptr};
+
+		    AST::Allocator shallow_allocator;
+		    auto shallow = Interpreter::read_image(nested_image(100), shallow_allocator, env);
+		    if (!shallow.ok())
+			    return {TestStatus::Fail, "A nested image should be read"};
+
+		    // deep enough to overflow the stack if it were read
+		    AST::Allocator deep_allocator;
+		    auto deep = Interpreter::read_image(nested_image(1000000), deep_allocator, env);
+		    if (deep.ok())
+			    return {TestStatus::Fail, "An image nested too deeply should be rejected"};
+		    if (deep.error().m_text != "The program image is nested too deeply")
+			    return {TestStatus::Fail, "An image nested too deeply should say so"};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    TempFile image_file {"jasper_snapshot"};
+		    if (!image_file.ok())
+			    return {TestStatus::Error, "Failed to create a temporary file"};
+
+		    Interpreter::ExecuteSettings settings;
+		    settings.compile_to = image_file.path();
+		    settings.snapshot_heap = true;
+
+		    // the snapshot has to keep aliasing, variants, and the
+		    // variables closures capture
+		    auto compiled = Interpreter::execute(
+		        "either := union { left : int<::>; right : string<::>; };\n"
+		        "pick := fn(x : either<::>) => match(x) {\n"
+		        "	left { i } => i;\n"
+		        "	right { s } => 100;\n"
+		        "};\n"
+		        "values := array { either<::>.left{ 3 }; either<::>.right{ \"x\" }; };\n"
+		        "alias := values;\n"
+		        "make_counter := fn() {\n"
+		        "	n := 0;\n"
+		        "	return fn() { n = n + 1; return n; };\n"
+		        "};\n"
+		        "counter := make_counter();\n"
+		        "__invoke := fn() {\n"
+		        "	counter();\n"
+		        "	array_append(alias, either<::>.left{ 4 });\n"
+		        "	return pick(values[0]) + pick(values[1]) + size(values) + counter();\n"
+		        "};\n",
+		        settings,
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        return ExitStatus::Empty;
+		        });
+
+		    auto image = read_file(image_file.path());
+		    if (compiled != ExitStatus::Ok || !image.ok())
+			    return {TestStatus::Fail, "Failed to write a program image with a heap snapshot"};
+
+		    auto status = Interpreter::execute_image(image.m_result.view(), EQUALS("__invoke()", 108));
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "A restored heap should behave like the one it was taken from"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void fold_constants_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    char const* source =
+		        "width := 4 + 2 * 3;\n"
+		        "height := width - 1;\n"
+		        "tall := height > width;\n"
+		        "name := \"w\" + \"h\";\n"
+		        "moving := 1;\n"
+		        "area := fn() => if (tall) then 0 else width * height;\n"
+		        "__invoke := fn() {\n"
+		        "	moving = moving + 1;\n"
+		        "	if (width == 10) return area() + moving;\n"
+		        "	return 0;\n"
+		        "};\n";
+
+		    // the runner can't capture, so it leaves the reason it failed here
+		    static std::string failure;
+		    failure.clear();
+
+		    auto status = Interpreter::execute(
+		        source,
+		        {},
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        auto fail = [](char const* reason) {
+				        failure = reason;
+				        return ExitStatus::ValueError;
+			        };
+
+			        auto is_folded = [&](char const* name) {
+				        auto value = context.access(name)->m_value;
+				        return value->type() == AST::ExprTag::IntegerLiteral ||
+				               value->type() == AST::ExprTag::BooleanLiteral ||
+				               value->type() == AST::ExprTag::StringLiteral;
+			        };
+
+			        if (!is_folded("width") || !is_folded("height") ||
+			            !is_folded("tall") || !is_folded("name"))
+				        return fail("Constant globals should be folded into literals");
+
+			        // `moving` is assigned to, so uses of it must stay
+			        auto function =
+			            dynamic_cast<AST::FunctionLiteral*>(context.access("__invoke")->m_value);
+			        if (!function)
+				        return fail("__invoke should still be a function literal");
+			        auto sequence = dynamic_cast<AST::SequenceExpression*>(function->m_body);
+			        if (!sequence || sequence->m_body->m_body.empty())
+				        return fail("The body of __invoke should still be a block");
+			        auto increment =
+			            dynamic_cast<AST::ExpressionStatement*>(sequence->m_body->m_body[0]);
+			        auto assignment = increment
+			            ? dynamic_cast<AST::AssignmentExpression*>(increment->m_expression)
+			            : nullptr;
+			        if (!assignment)
+				        return fail("The assignment to `moving` should be kept");
+			        auto sum = dynamic_cast<AST::CallExpression*>(assignment->m_value);
+			        if (!sum || sum->m_args.empty())
+				        return fail("`moving + 1` should not be folded");
+			        if (sum->m_args[0]->type() != AST::ExprTag::Identifier)
+				        return fail("Uses of an assigned global should not be replaced");
+
+			        if (Assert::equals(eval_expression("__invoke()", env, context), 92) != ExitStatus::Ok)
+				        return fail("The folded program should compute the same result");
+			        return ExitStatus::Ok;
+		        });
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, failure};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    // division by zero is left for the program to run into
+		    static std::string failure;
+		    failure.clear();
+
+		    auto status = Interpreter::execute(
+		        "zero := 0;\n"
+		        "broken := fn() => 1 / zero;\n",
+		        {},
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        auto function =
+			            dynamic_cast<AST::FunctionLiteral*>(context.access("broken")->m_value);
+			        if (!function) {
+				        failure = "broken should still be a function literal";
+				        return ExitStatus::ValueError;
+			        }
+			        if (!dynamic_cast<AST::CallExpression*>(function->m_body)) {
+				        failure = "Folding should not evaluate divisions by zero";
+				        return ExitStatus::ValueError;
+			        }
+			        return ExitStatus::Ok;
+		        });
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, failure};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void inline_functions_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    // after inlining, the folder is left with nothing but literals
+		    char const* source =
+		        "I := fn(x) => x;\n"
+		        "twice := fn(x) => x + x;\n"
+		        "__invoke := fn() => twice(3) + I(4);\n";
+
+		    // the runner can't capture, so it leaves the reason it failed here
+		    static std::string failure;
+		    failure.clear();
+
+		    auto status = Interpreter::execute(
+		        source,
+		        {},
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        auto fail = [](char const* reason) {
+				        failure = reason;
+				        return ExitStatus::ValueError;
+			        };
+
+			        auto function =
+			            dynamic_cast<AST::FunctionLiteral*>(context.access("__invoke")->m_value);
+			        if (!function)
+				        return fail("__invoke should still be a function literal");
+			        if (!dynamic_cast<AST::IntegerLiteral*>(function->m_body))
+				        return fail("Small functions should be inlined into their callers");
+
+			        if (Assert::equals(eval_expression("__invoke()", env, context), 10) != ExitStatus::Ok)
+				        return fail("Inlined calls should compute the same result");
+			        return ExitStatus::Ok;
+		        });
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, failure};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    // `count` may change between the call and the use of its value,
+		    // and `down` calls itself, so neither call is inlined
+		    char const* source =
+		        "count := 5;\n"
+		        "bump := fn() { count = count + 1; return 0; };\n"
+		        "first := fn(a, b) => a;\n"
+		        "down := fn(n) => if (n < 1) then 0 else down(0);\n"
+		        "__invoke := fn() => first(count, bump()) + down(5);\n";
+
+		    static std::string failure;
+		    failure.clear();
+
+		    auto status = Interpreter::execute(
+		        source,
+		        {},
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        auto fail = [](char const* reason) {
+				        failure = reason;
+				        return ExitStatus::ValueError;
+			        };
+
+			        auto down =
+			            dynamic_cast<AST::FunctionLiteral*>(context.access("down")->m_value);
+			        if (!down)
+				        return fail("down should still be a function literal");
+			        if (!dynamic_cast<AST::TernaryExpression*>(down->m_body))
+				        return fail("A recursive function should not be inlined into itself");
+
+			        // the body is `+`, called on the call to `first`
+			        auto invoke =
+			            dynamic_cast<AST::FunctionLiteral*>(context.access("__invoke")->m_value);
+			        if (!invoke)
+				        return fail("__invoke should still be a function literal");
+			        auto sum = dynamic_cast<AST::CallExpression*>(invoke->m_body);
+			        if (!sum || sum->m_args.empty())
+				        return fail("The body of __invoke should still be a call to +");
+			        if (!dynamic_cast<AST::CallExpression*>(sum->m_args[0]))
+				        return fail("A call whose arguments may change each other should not be inlined");
+
+			        // `count` is read before `bump` changes it
+			        if (Assert::equals(eval_expression("__invoke()", env, context), 5) != ExitStatus::Ok)
+				        return fail("Inlining should not change what a program does");
+			        return ExitStatus::Ok;
+		        });
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, failure};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void code_cache_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    char const* source =
+		        "hot := fn() => 7;\n"
+		        "__invoke := fn() {\n"
+		        "	total := 0;\n"
+		        "	i := 0;\n"
+		        "	while (i < 5) {\n"
+		        "		total = total + hot();\n"
+		        "		i = i + 1;\n"
+		        "	}\n"
+		        "	return total;\n"
+		        "};\n";
+
+		    Interpreter::ExecuteSettings settings;
+		    settings.inline_functions = false;
+		    settings.compile_after_calls = 2;
+
+		    auto status = Interpreter::execute(
+		        source,
+		        settings,
+		        +[](Interpreter::Interpreter& env,
+		            Frontend::SymbolTable& context) -> ExitStatus {
+			        auto result = Assert::equals(eval_expression("__invoke()", env, context), 35);
+			        if (result != ExitStatus::Ok)
+				        return result;
+
+			        // `hot` runs in the tree walker twice, gets compiled on
+			        // the third call, and runs from bytecode from then on
+			        auto const& stats = env.m_code_cache.m_stats;
+			        if (stats.m_compilations != 1 || stats.m_hits != 2)
+				        return ExitStatus::ValueError;
+
+			        return ExitStatus::Ok;
+		        });
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "Functions should be compiled once they get hot"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void native_function_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    char const* source =
+		        "xs := array { 1; 2; 3; };\n"
+		        "__invoke := fn() {\n"
+		        "	yes := size(xs) == 3;\n"
+		        "	no := size(xs) == 4;\n"
+		        "	total := size(xs) + size(array_extend(array { 4; }, xs));\n"
+		        "	if (yes && (no || yes)) total = total * 10;\n"
+		        "	return total;\n"
+		        "};\n";
+
+		    auto status = Interpreter::execute(source, {}, EQUALS("__invoke()", 70));
+
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "Typed natives should be called directly"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void isolate_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    char const* source =
+		        "count := 0;\n"
+		        "bump := fn(n) {\n"
+		        "	i := 0;\n"
+		        "	while (i < n) {\n"
+		        "		count = count + 1;\n"
+		        "		i = i + 1;\n"
+		        "	}\n"
+		        "	return count;\n"
+		        "};\n";
+
+		    Interpreter::CompiledProgram program;
+		    auto status = Interpreter::compile_program(source, {}, program);
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "The program should compile"};
+
+		    // each isolate has globals of its own, so both see only their
+		    // own calls to `bump`
+		    int results[2][2] {};
+		    auto run = [&program, &results](int which) {
+			    Interpreter::Isolate isolate {program};
+			    results[which][0] = isolate.eval("bump(1000)").get_integer();
+			    results[which][1] = isolate.eval("bump(1000)").get_integer();
+		    };
+
+		    std::thread first {run, 0};
+		    std::thread second {run, 1};
+		    first.join();
+		    second.join();
+
+		    for (auto& result : results)
+			    if (result[0] != 1000 || result[1] != 2000)
+				    return {TestStatus::Fail, "Isolates should not share globals"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void isolate_pool_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    char const* source =
+		        "count := 0;\n"
+		        "xs := array { 1; };\n"
+		        "bump := fn() {\n"
+		        "	count = count + 1;\n"
+		        "	array_append(xs, count);\n"
+		        "	return count * 10 + size(xs);\n"
+		        "};\n";
+
+		    Interpreter::CompiledProgram program;
+		    auto status = Interpreter::compile_program(source, {}, program);
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "The program should compile"};
+
+		    Interpreter::IsolatePool pool {program, 1};
+
+		    auto isolate = pool.acquire();
+		    auto heap_size = isolate->m_gc.size();
+		    if (isolate->eval("bump()").get_integer() != 12
+		        || isolate->eval("bump()").get_integer() != 23)
+			    return {TestStatus::Fail, "Globals should keep their values between calls"};
+
+		    auto used = isolate.get();
+		    pool.release(std::move(isolate));
+
+		    isolate = pool.acquire();
+		    if (isolate.get() != used)
+			    return {TestStatus::Fail, "Released isolates should be reused"};
+		    if (isolate->m_gc.size() != heap_size)
+			    return {TestStatus::Fail, "Resetting should rewind the heap"};
+		    if (isolate->eval("bump()").get_integer() != 12)
+			    return {TestStatus::Fail, "Resetting should restore the globals"};
+
+		    pool.release(std::move(isolate));
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void budget_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {
+	        +[]() -> TestReport {
+		        char const* source =
+		            "__invoke := fn() {\n"
+		            "	i := 0;\n"
+		            "	while (i < 1) {}\n"
+		            "	return i;\n"
+		            "};\n";
+
+		        Interpreter::ExecuteSettings settings;
+		        settings.max_steps = 1000;
+
+		        auto status = Interpreter::execute(source, settings, EQUALS("__invoke()", 0));
+		        if (status != ExitStatus::BudgetExceeded)
+			        return {TestStatus::Fail, "Loops should stop when they run out of fuel"};
+
+		        return {TestStatus::Ok};
+	        },
+	        +[]() -> TestReport {
+		        char const* source =
+		            "xs := array { 1; };\n"
+		            "__invoke := fn() {\n"
+		            "	while (size(xs) > 0) { array_extend(xs, xs); }\n"
+		            "	return 0;\n"
+		            "};\n";
+
+		        Interpreter::ExecuteSettings settings;
+		        settings.max_heap_bytes = 1 << 20;
+
+		        auto status = Interpreter::execute(source, settings, EQUALS("__invoke()", 0));
+		        if (status != ExitStatus::BudgetExceeded)
+			        return {TestStatus::Fail, "Programs should stop when they run out of heap"};
+
+		        return {TestStatus::Ok};
+	        },
+	        +[]() -> TestReport {
+		        // each iteration leaves a 1000 element array behind, so the
+		        // program allocates far more than the limit in total, but
+		        // never has more than one of them live
+		        char const* source =
+		            "__invoke := fn() {\n"
+		            "	i := 0;\n"
+		            "	while (i < 2000) {\n"
+		            "		xs := array { 1; };\n"
+		            "		while (size(xs) < 1000) { array_extend(xs, xs); }\n"
+		            "		i = i + 1;\n"
+		            "	}\n"
+		            "	return i;\n"
+		            "};\n";
+
+		        Interpreter::ExecuteSettings settings;
+		        settings.max_heap_bytes = 1 << 20;
+
+		        auto status = Interpreter::execute(source, settings, EQUALS("__invoke()", 2000));
+		        if (status != ExitStatus::Ok)
+			        return {TestStatus::Fail, "The heap limit should only count live cells"};
+
+		        return {TestStatus::Ok};
+	        },
+	        +[]() -> TestReport {
+		        char const* source =
+		            "down := fn(n) => if (n < 1) then 0 else down(n - 1);\n";
+
+		        Interpreter::CompiledProgram program;
+		        auto status = Interpreter::compile_program(source, {}, program);
+		        if (status != ExitStatus::Ok)
+			        return {TestStatus::Fail, "The program should compile"};
+
+		        Interpreter::Isolate isolate {program};
+		        isolate.set_budget(100, 0);
+		        status = isolate.run(EQUALS("down(1000)", 0));
+		        if (status != ExitStatus::BudgetExceeded)
+			        return {TestStatus::Fail, "Calls should stop when they run out of fuel"};
+
+		        isolate.reset();
+		        isolate.set_budget(0, 0);
+		        if (isolate.eval("down(1000)").get_integer() != 0)
+			        return {TestStatus::Fail, "An isolate should be usable after a reset"};
+
+		        return {TestStatus::Ok};
+	        },
+	    }));
+}
+
+void task_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    char const* source =
+		        "add_input := fn() => read_integer() + read_integer();\n";
+
+		    Interpreter::CompiledProgram program;
+		    auto status = Interpreter::compile_program(source, {}, program);
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "The program should compile"};
+
+		    // two scripts waiting on input at the same time, driven by
+		    // a single thread
+		    Interpreter::Isolate first_isolate {program};
+		    Interpreter::Isolate second_isolate {program};
+		    Interpreter::Task first {
+		        first_isolate.m_env, first_isolate.m_context, EQUALS("add_input()", 5)};
+		    Interpreter::Task second {
+		        second_isolate.m_env, second_isolate.m_context, EQUALS("add_input()", 30)};
+
+		    using State = Interpreter::Task::State;
+		    if (first.resume() != State::Suspended || second.resume() != State::Suspended)
+			    return {TestStatus::Fail, "Reading input should suspend the task"};
+		    if (std::string(first.m_pending) != "read_integer")
+			    return {TestStatus::Fail, "Tasks should tell what they are waiting on"};
+
+		    if (second.resume(Interpreter::Value {10}) != State::Suspended
+		        || first.resume(Interpreter::Value {2}) != State::Suspended
+		        || first.resume(Interpreter::Value {3}) != State::Done
+		        || second.resume(Interpreter::Value {20}) != State::Done)
+			    return {TestStatus::Fail, "Tasks should run until they need more input"};
+
+		    if (first.m_status != ExitStatus::Ok || second.m_status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "Resumed natives should return the given values"};
+
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void output_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    int fds[2];
+		    if (pipe(fds) != 0)
+			    return {TestStatus::Error, "Could not open a pipe"};
+
+		    {
+			    // small enough that everything goes through a flush
+			    Interpreter::OutputBuffer out {fds[1], 16};
+			    Interpreter::print(Interpreter::Value {-2147483647 - 1}, out);
+			    Interpreter::print(Interpreter::Value {2.5f}, out);
+			    Interpreter::print(Interpreter::Value {true}, out);
+			    out.write("longer than the whole buffer");
+		    }
+		    close(fds[1]);
+
+		    std::string written;
+		    char chunk[64];
+		    ssize_t size;
+		    while ((size = read(fds[0], chunk, sizeof(chunk))) > 0)
+			    written.append(chunk, size);
+		    close(fds[0]);
+
+		    if (written != "Integer -2147483648\nFloat 2.5\nBoolean 1\nlonger than the whole buffer")
+			    return {TestStatus::Fail, "Buffered output should match what was written"};
+
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    char const* source =
+		        "ask := fn() { print(7); return read_integer(); };\n";
+
+		    Interpreter::CompiledProgram program;
+		    auto status = Interpreter::compile_program(source, {}, program);
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "The program should compile"};
+
+		    int fds[2];
+		    if (pipe(fds) != 0)
+			    return {TestStatus::Error, "Could not open a pipe"};
+		    // so a missing flush fails instead of hanging
+		    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+		    std::string got;
+		    {
+			    Interpreter::Isolate isolate {program};
+			    isolate.m_env.m_output.m_fd = fds[1];
+			    Interpreter::Task task {
+			        isolate.m_env, isolate.m_context, EQUALS("ask()", 1)};
+			    task.resume();
+
+			    // the question has to be out while the task waits for the
+			    // answer, not when the buffer goes away
+			    char chunk[64];
+			    ssize_t size = read(fds[0], chunk, sizeof(chunk));
+			    if (size > 0)
+				    got.assign(chunk, size);
+			    task.resume(Interpreter::Value {1});
+		    }
+		    close(fds[0]);
+		    close(fds[1]);
+
+		    if (got != "Integer 7\n")
+			    return {TestStatus::Fail, "Output should be flushed before a task waits for input"};
+		    return {TestStatus::Ok};
+	    }}));
+}
+
+void input_tests(Test::Tester& tester) {
+	tester.add_test(std::make_unique<Test::NormalTestSet>(
+	    std::vector<Test::NormalTestSet::TestFunction> {+[]() -> TestReport {
+		    int fds[2];
+		    if (pipe(fds) != 0)
+			    return {TestStatus::Error, "Could not open a pipe"};
+
+		    char const text[] = "a line longer than the buffer\n -12 34\n2.5 word\nno newline";
+		    if (write(fds[1], text, sizeof(text) - 1) != sizeof(text) - 1)
+			    return {TestStatus::Error, "Could not write to the pipe"};
+		    close(fds[1]);
+
+		    // small enough that lines have to grow it
+		    Interpreter::InputBuffer in {fds[0], 4};
+		    string_view view;
+
+		    if (!in.read_line(view) || view != "a line longer than the buffer")
+			    return {TestStatus::Fail, "A line should be read whole"};
+		    if (in.read_integer() != -12 || in.read_integer() != 34)
+			    return {TestStatus::Fail, "Integers should be read"};
+		    if (in.read_number() != 2.5f)
+			    return {TestStatus::Fail, "Numbers should be read"};
+		    if (!in.read_token(view) || view != "word")
+			    return {TestStatus::Fail, "Tokens should be read"};
+		    // what is left of the line the token was on
+		    if (!in.read_line(view) || view != "")
+			    return {TestStatus::Fail, "The rest of the line should be read"};
+		    if (!in.read_line(view) || view != "no newline")
+			    return {TestStatus::Fail, "The last line should be read without a newline"};
+		    if (in.read_line(view))
+			    return {TestStatus::Fail, "Nothing should be read at the end"};
+
+		    close(fds[0]);
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    int in_fds[2], out_fds[2];
+		    if (pipe(in_fds) != 0 || pipe(out_fds) != 0)
+			    return {TestStatus::Error, "Could not open a pipe"};
+
+		    if (write(in_fds[1], "42\n", 3) != 3)
+			    return {TestStatus::Error, "Could not write to the pipe"};
+		    close(in_fds[1]);
+		    // so a missing flush fails instead of hanging
+		    fcntl(out_fds[0], F_SETFL, O_NONBLOCK);
+
+		    Interpreter::InputBuffer in {in_fds[0]};
+		    int answer;
+		    {
+			    Interpreter::OutputBuffer out {out_fds[1]};
+			    out.write("question? ");
+			    answer = in.read_integer(&out);
+
+			    // the prompt has to be out before the read, not when the
+			    // buffer goes away
+			    char got[16] {};
+			    if (read(out_fds[0], got, sizeof(got) - 1) != 10 ||
+			        std::string(got) != "question? ")
+				    return {TestStatus::Fail, "A tied output should be flushed before reading"};
+		    }
+
+		    close(in_fds[0]);
+		    close(out_fds[0]);
+		    close(out_fds[1]);
+		    if (answer != 42)
+			    return {TestStatus::Fail, "The answer should be read"};
+		    return {TestStatus::Ok};
+	    },
+	    +[]() -> TestReport {
+		    char const* source =
+		        "sum_input := fn(n) {\n"
+		        "	sum := 0;\n"
+		        "	for (i := 0; i < n; i = i + 1) {\n"
+		        "		sum = sum + read_integer();\n"
+		        "	}\n"
+		        "	return sum;\n"
+		        "};\n";
+
+		    Interpreter::CompiledProgram program;
+		    auto status = Interpreter::compile_program(source, {}, program);
+		    if (status != ExitStatus::Ok)
+			    return {TestStatus::Fail, "The program should compile"};
+
+		    int fds[2];
+		    if (pipe(fds) != 0)
+			    return {TestStatus::Error, "Could not open a pipe"};
+		    std::string numbers;
+		    for (int i = 1; i <= 200; ++i)
+			    numbers += std::to_string(i) + "\n";
+		    if (write(fds[1], numbers.data(), numbers.size()) != ssize_t(numbers.size()))
+			    return {TestStatus::Error, "Could not write to the pipe"};
+		    close(fds[1]);
+
+		    // two isolates on different threads read the same file, so
+		    // every number goes to exactly one of them
+		    Interpreter::InputBuffer in {fds[0], 16};
+		    int sums[2] {};
+		    auto run = [&program, &in, &sums](int which) {
+			    Interpreter::Isolate isolate {program};
+			    isolate.m_env.m_input = &in;
+			    sums[which] = isolate.eval("sum_input(100)").get_integer();
+		    };
+
+		    std::thread first {run, 0};
+		    std::thread second {run, 1};
+		    first.join();
+		    second.join();
+		    close(fds[0]);
+
+		    if (sums[0] + sums[1] != 200 * 201 / 2)
+			    return {TestStatus::Fail, "A shared input should hand each number out once"};
+		    return {TestStatus::Ok};
 	    }}));
 }
 
@@ -213,6 +1579,24 @@ int main() {
 	tarjan_algorithm_tests(tests);
 	allocator_tests(tests);
 	string_set_tests(tests);
+	char_scan_tests(tests);
+	flat_map_tests(tests);
+	file_contents_tests(tests);
+	type_system_core_tests(tests);
+	lazy_declaration_tests(tests);
+	parallel_typecheck_tests(tests);
+	check_cache_tests(tests);
+	image_tests(tests);
+	fold_constants_tests(tests);
+	inline_functions_tests(tests);
+	code_cache_tests(tests);
+	native_function_tests(tests);
+	isolate_tests(tests);
+	isolate_pool_tests(tests);
+	budget_tests(tests);
+	task_tests(tests);
+	output_tests(tests);
+	input_tests(tests);
 	interpreter_tests(tests);
 	auto test_result = tests.execute();
 	if (test_result.m_code != TestStatus::Ok)
@@ -1,8 +1,6 @@
-#include <fstream>
-#include <sstream>
-
 #include "../interpreter/execute.hpp"
 #include "../symbol_table.hpp"
+#include "../utils/file_contents.hpp"
 #include "test_set.hpp"
 
 namespace Test {
@@ -23,21 +21,15 @@ TestReport InterpreterTestSet::execute() {
 		return {TestStatus::Empty};
 
 	try {
-		std::ifstream in_fs(m_source_file);
-		if (!in_fs.good())
+		auto file = read_file(m_source_file.c_str());
+		if (!file.ok())
 			return {TestStatus::MissingFile};
 
-		std::stringstream file_content;
-		std::string line;
-
-		while (std::getline(in_fs, line))
-			file_content << line << '\n';
-
 		Interpreter::ExecuteSettings settings;
 		settings.dump_cst = m_dump;
 
 		for (auto* f : m_testers) {
-			ExitStatus answer = Interpreter::execute(file_content.str(), settings, f);
+			ExitStatus answer = Interpreter::execute(file.m_result.view(), settings, f);
 
 			if (ExitStatus::Ok != answer)
 				return {TestStatus::Fail};
@@ -1,7 +1,6 @@
 #pragma once
 
-#include "./utils/interned_string.hpp"
-#include "./utils/source_location.hpp"
+#include "./utils/string_view.hpp"
 #include "token_tag.hpp"
 
 struct Token {
@@ -9,6 +8,7 @@ struct Token {
 	TokenTag m_type;
 	int m_start_offset;
 
-	/* source code representation of token */
-	InternedString m_text;
+	/* source code representation of token. Points into the source buffer, or
+	 * into static storage for keywords and operators */
+	string_view m_text;
 };
@@ -0,0 +1,461 @@
+#include "check_cache.hpp"
+
+#include "../ast.hpp"
+#include "../cst.hpp"
+#include "typecheck.hpp"
+#include "typechecker.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <cassert>
+
+namespace TypeChecker {
+
+using AST::ExprTag;
+
+// Bump this whenever a change to the type checker can change the outcome of
+// checking the same source
+static char const* const cache_header = "jasper-check-cache 2";
+
+// FNV-1a. Fingerprints are stored on disk, so unlike std::hash this has to
+// give the same results on every run.
+static uint64_t hash_bytes(uint64_t hash, void const* data, size_t size) {
+	auto bytes = static_cast<unsigned char const*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t const hash_seed = 14695981039346656037ull;
+
+CheckCache load_check_cache(char const* path) {
+	CheckCache result;
+
+	std::ifstream file(path);
+	std::string header;
+	if (!std::getline(file, header) || header != cache_header)
+		return result;
+
+	// one component per line: its fingerprint, and then its types, if it
+	// has them
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream in(line);
+		uint64_t fingerprint;
+		if (!(in >> std::hex >> fingerprint))
+			continue;
+		result.m_checked.insert(fingerprint);
+
+		std::string types;
+		std::getline(in >> std::ws, types);
+		if (!types.empty())
+			result.m_types[fingerprint] = std::move(types);
+	}
+
+	return result;
+}
+
+std::vector<uint64_t> fingerprint_components(TypeChecker const& tc) {
+	auto const& comps = tc.declaration_order();
+	auto const& deps = tc.declaration_dependencies();
+
+	std::vector<uint64_t> result;
+	result.reserve(comps.size());
+
+	std::vector<uint64_t> parts;
+	for (int c = 0; c < int(comps.size()); ++c) {
+		parts.clear();
+
+		for (auto decl : comps[c]) {
+			assert(decl->m_cst);
+			string_view source = static_cast<CST::Declaration*>(decl->m_cst)->m_source;
+			parts.push_back(hash_bytes(hash_seed, source.data(), source.size()));
+		}
+
+		// the order we find things in depends on pointer values, so we
+		// sort to get the same fingerprint on every run
+		std::sort(parts.begin(), parts.end());
+
+		for (int d : deps[c]) {
+			assert(d < c);
+			parts.push_back(result[d]);
+		}
+		std::sort(parts.begin() + comps[c].size(), parts.end());
+
+		result.push_back(hash_bytes(hash_seed, parts.data(), parts.size() * sizeof(uint64_t)));
+	}
+
+	return result;
+}
+
+// whether inference may leave type variables in this component for other
+// components to pin down
+static bool may_stay_monomorphic(std::vector<AST::Declaration*> const& component) {
+	for (auto decl : component)
+		if (decl->m_meta_type == MetaType::Term && decl->m_value &&
+		    !is_value_expression(decl->m_value))
+			return true;
+	return false;
+}
+
+// whether inference gives types to the declarations of this component
+static bool has_inferred_types(std::vector<AST::Declaration*> const& component) {
+	for (auto decl : component)
+		if (decl->m_meta_type != MetaType::Term)
+			return false;
+	return true;
+}
+
+// For each component, whether its types only depend on its own source and
+// on that of the components it refers to. The types of a component that
+// may stay monomorphic can still be pinned down by the components that
+// use it, and so can those of anything that refers to one.
+static std::vector<bool> closed_components(TypeChecker const& tc) {
+	auto const& comps = tc.declaration_order();
+	auto const& deps = tc.declaration_dependencies();
+
+	std::vector<bool> result(comps.size());
+	for (int c = 0; c < int(comps.size()); ++c) {
+		result[c] = !may_stay_monomorphic(comps[c]);
+		for (int d : deps[c])
+			if (!result[d])
+				result[c] = false;
+	}
+	return result;
+}
+
+// Types are saved as a list of tokens, in prefix order:
+//  - `v<k>` is the k-th variable of the polytype
+//  - `b<id>:<n>` is a term of a builtin type function, with n arguments
+//  - `n<name>:<n>` is a term of the type function that is declared with
+//    that name. The ids of those depend on the rest of the program, so we
+//    don't save them.
+//
+// A component is saved as the number of its declarations, followed by the
+// name, the number of variables, and the type of each of them.
+
+static std::unordered_map<int, InternedString> type_function_names(TypeChecker const& tc) {
+	std::unordered_map<int, InternedString> result;
+	for (auto const& component : tc.declaration_order()) {
+		for (auto decl : component) {
+			if (decl->m_meta_type != MetaType::TypeFunction || !decl->m_value)
+				continue;
+			if (decl->m_value->type() == ExprTag::StructExpression)
+				result[int(static_cast<AST::StructExpression*>(decl->m_value)->m_value)] =
+				    decl->identifier_text();
+			else if (decl->m_value->type() == ExprTag::UnionExpression)
+				result[int(static_cast<AST::UnionExpression*>(decl->m_value)->m_value)] =
+				    decl->identifier_text();
+		}
+	}
+	return result;
+}
+
+// Fails on types we can't save: those with variables that aren't
+// generalized, or with type functions that have no name
+static bool write_type(
+    TypeSystemCore& core,
+    Type type,
+    std::vector<VarId> const& vars,
+    std::unordered_map<int, InternedString> const& names,
+    std::string& out) {
+	std::vector<Type> stack {core.apply_substitution(type)};
+	while (!stack.empty()) {
+		Type type = stack.back();
+		stack.pop_back();
+
+		out += ' ';
+		if (core.is_var(type)) {
+			auto var = std::find(vars.begin(), vars.end(), core.get_var_id(type));
+			if (var == vars.end())
+				return false;
+			out += 'v' + std::to_string(var - vars.begin());
+			continue;
+		}
+
+		TypeFunc function = core.function(type);
+		if (int(function) < BuiltinType::amount_) {
+			out += 'b' + std::to_string(int(function));
+		} else {
+			auto name = names.find(int(function));
+			if (name == names.end())
+				return false;
+			out += 'n' + name->second.str().to_string();
+		}
+
+		int const argument_count = core.argument_count(type);
+		out += ':' + std::to_string(argument_count);
+		for (int k = argument_count; k--;)
+			stack.push_back(core.argument(type, k));
+	}
+	return true;
+}
+
+static bool write_component(
+    TypeSystemCore& core,
+    std::vector<AST::Declaration*> const& component,
+    std::unordered_map<int, InternedString> const& names,
+    std::string& out) {
+	out += std::to_string(component.size());
+	for (auto decl : component) {
+		// only declarations that were inferred or restored in this run
+		// have a type
+		if (!decl->m_is_polymorphic)
+			return false;
+
+		auto const& vars = core.poly_vars(decl->m_decl_type);
+		out += ' ' + decl->identifier_text().str().to_string();
+		out += ' ' + std::to_string(vars.size());
+		if (!write_type(core, core.poly_base(decl->m_decl_type), vars, names, out))
+			return false;
+	}
+	return true;
+}
+
+static bool read_type(
+    TypeSystemCore& core,
+    std::istream& in,
+    std::vector<Type> const& vars,
+    std::unordered_map<InternedString, TypeFunc> const& functions,
+    Type& result) {
+	// the terms whose arguments we are still reading
+	struct Frame {
+		TypeFunc function;
+		int arguments_left;
+		int base;
+	};
+	std::vector<Frame> frames;
+	std::vector<Type> arguments;
+
+	std::string token;
+	while (in >> token) {
+		Type type;
+		if (token[0] == 'v') {
+			int k = std::atoi(token.c_str() + 1);
+			if (k < 0 || k >= int(vars.size()))
+				return false;
+			type = vars[k];
+		} else {
+			auto colon = token.rfind(':');
+			if (colon == std::string::npos || colon < 1)
+				return false;
+			int argument_count = std::atoi(token.c_str() + colon + 1);
+			if (argument_count < 0)
+				return false;
+
+			TypeFunc function;
+			if (token[0] == 'b') {
+				int id = std::atoi(token.c_str() + 1);
+				if (id < 0 || id >= BuiltinType::amount_)
+					return false;
+				function = TypeFunc(id);
+			} else if (token[0] == 'n') {
+				auto found = functions.find(InternedString {token.c_str() + 1, colon - 1});
+				if (found == functions.end())
+					return false;
+				function = found->second;
+			} else {
+				return false;
+			}
+
+			if (argument_count > 0) {
+				frames.push_back({function, argument_count, int(arguments.size())});
+				continue;
+			}
+			type = core.new_term(function, {});
+		}
+
+		// a finished type is an argument of the innermost term we are
+		// reading, and may be its last one
+		while (true) {
+			if (frames.empty()) {
+				result = type;
+				return true;
+			}
+
+			arguments.push_back(type);
+			if (--frames.back().arguments_left > 0)
+				break;
+
+			Frame frame = frames.back();
+			frames.pop_back();
+			type = core.new_term(
+			    frame.function, {arguments.begin() + frame.base, arguments.end()});
+			arguments.resize(frame.base);
+		}
+	}
+	return false;
+}
+
+ErrorReport save_check_cache(
+    char const* path,
+    TypeChecker& tc,
+    std::vector<uint64_t> const& fingerprints,
+    CheckCache const& previous) {
+	auto const& comps = tc.declaration_order();
+	assert(int(fingerprints.size()) == int(comps.size()));
+
+	auto names = type_function_names(tc);
+	auto closed = closed_components(tc);
+
+	std::ofstream file(path, std::ios::trunc);
+
+	file << cache_header << '\n' << std::hex;
+	std::string types;
+	for (int c = 0; c < int(comps.size()); ++c) {
+		file << fingerprints[c];
+
+		types.clear();
+		if (closed[c] && has_inferred_types(comps[c]) &&
+		    write_component(tc.core(), comps[c], names, types)) {
+			file << ' ' << types;
+		} else {
+			auto saved = previous.m_types.find(fingerprints[c]);
+			if (saved != previous.m_types.end())
+				file << ' ' << saved->second;
+		}
+
+		file << '\n';
+	}
+
+	if (!file)
+		return {"Failed to write the check cache to '" + std::string(path) + "'"};
+	return {};
+}
+
+std::vector<bool> components_to_check(
+    TypeChecker const& tc,
+    std::vector<uint64_t> const& fingerprints,
+    CheckCache const& cache) {
+	auto const& comps = tc.declaration_order();
+	auto const& deps = tc.declaration_dependencies();
+	int const n = comps.size();
+	assert(int(fingerprints.size()) == n);
+
+	auto closed = closed_components(tc);
+
+	std::vector<bool> needs_check(n);
+	std::vector<bool> monomorphic(n);
+	// whether we have the types of the component without inferring it
+	std::vector<bool> restorable(n);
+	for (int c = 0; c < n; ++c) {
+		needs_check[c] = !cache.m_checked.count(fingerprints[c]);
+		monomorphic[c] = may_stay_monomorphic(comps[c]);
+		restorable[c] = closed[c] &&
+		    (!has_inferred_types(comps[c]) || cache.m_types.count(fingerprints[c]));
+	}
+
+	// Two rules, applied until nothing changes:
+	//  - we need the type of everything a checked component refers to,
+	//    which we infer if the cache doesn't have it
+	//  - if we check a monomorphic component, everything that can
+	//    constrain its type variables has to be checked with it, or we
+	//    would miss conflicts between the old and the new uses
+	std::vector<bool> constrains_checked(n);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+
+		// dependencies come before their users, so one pass from the end
+		// reaches all of them
+		for (int c = n; c--;)
+			if (needs_check[c])
+				for (int d : deps[c])
+					if (!restorable[d])
+						needs_check[d] = true;
+
+		for (int c = 0; c < n; ++c) {
+			constrains_checked[c] = monomorphic[c] && needs_check[c];
+			for (int d : deps[c])
+				if (constrains_checked[d])
+					constrains_checked[c] = true;
+
+			if (constrains_checked[c] && !needs_check[c]) {
+				needs_check[c] = true;
+				changed = true;
+			}
+		}
+	}
+
+	return needs_check;
+}
+
+bool restore_cached_types(
+    TypeChecker& tc,
+    std::vector<uint64_t> const& fingerprints,
+    CheckCache const& cache,
+    std::vector<bool> const& needs_check) {
+	auto const& comps = tc.declaration_order();
+	auto const& deps = tc.declaration_dependencies();
+	int const n = comps.size();
+	assert(int(fingerprints.size()) == n && int(needs_check.size()) == n);
+
+	std::vector<bool> needed(n);
+	for (int c = 0; c < n; ++c)
+		if (needs_check[c])
+			for (int d : deps[c])
+				if (!needs_check[d] && has_inferred_types(comps[d]))
+					needed[d] = true;
+
+	std::unordered_map<InternedString, TypeFunc> functions;
+	for (auto const& name : type_function_names(tc))
+		functions[name.second] = TypeFunc(name.first);
+
+	// everything is read before we change any declaration, so that a
+	// cache we can't read leaves them as they were
+	std::vector<std::pair<AST::Declaration*, PolyId>> restored;
+	for (int c = 0; c < n; ++c) {
+		if (!needed[c])
+			continue;
+
+		auto types = cache.m_types.find(fingerprints[c]);
+		if (types == cache.m_types.end())
+			return false;
+
+		std::istringstream in(types->second);
+		int decl_count;
+		if (!(in >> decl_count) || decl_count != int(comps[c].size()))
+			return false;
+
+		for (int i = 0; i < decl_count; ++i) {
+			std::string name;
+			int var_count;
+			if (!(in >> name >> var_count) || var_count < 0)
+				return false;
+
+			auto decl = std::find_if(
+			    comps[c].begin(), comps[c].end(), [&](AST::Declaration* decl) {
+				    return decl->identifier_text().str() == string_view {name};
+			    });
+			if (decl == comps[c].end())
+				return false;
+
+			std::vector<Type> vars;
+			std::vector<VarId> var_ids;
+			for (int k = 0; k < var_count; ++k) {
+				vars.push_back(tc.core().ll_new_var());
+				var_ids.push_back(tc.core().get_var_id(vars.back()));
+			}
+
+			Type type;
+			if (!read_type(tc.core(), in, vars, functions, type))
+				return false;
+			restored.push_back({*decl, tc.core().forall(std::move(var_ids), type)});
+		}
+	}
+
+	for (auto const& entry : restored) {
+		entry.first->m_is_polymorphic = true;
+		entry.first->m_decl_type = entry.second;
+		entry.first->m_value_type = tc.core().poly_base(entry.second);
+	}
+
+	return true;
+}
+
+} // namespace TypeChecker
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../utils/error_report.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <cstdint>
+
+namespace TypeChecker {
+
+struct TypeChecker;
+
+/*
+ * Lets a run skip inference for the parts of the program that did not change
+ * since an earlier run that checked them.
+ *
+ * Every component of TypeChecker::declaration_order() gets a fingerprint,
+ * computed from the source text of its declarations and the fingerprints of
+ * the components it refers to. A component whose fingerprint is in the cache
+ * was checked before, along with everything it depends on.
+ *
+ * For components whose types can't be changed by the rest of the program,
+ * the cache also keeps their generalized types, so a component that is
+ * checked again can use the types of its dependencies without inferring
+ * them. The others are inferred again whenever a component that is checked
+ * needs their types.
+ */
+struct CheckCache {
+	std::unordered_set<uint64_t> m_checked;
+	// the generalized types of the declarations of some of the components,
+	// in the form they are saved in
+	std::unordered_map<uint64_t, std::string> m_types;
+};
+
+// A missing or unreadable cache is just an empty one
+CheckCache load_check_cache(char const* path);
+
+// Saves every component as checked. The types of the components that
+// were inferred or restored in this run are saved, and those of the rest
+// are carried over from the cache the run started with.
+ErrorReport save_check_cache(
+    char const* path,
+    TypeChecker& tc,
+    std::vector<uint64_t> const& fingerprints,
+    CheckCache const& previous);
+
+// one fingerprint per component of tc.declaration_order()
+std::vector<uint64_t> fingerprint_components(TypeChecker const& tc);
+
+// for each component of tc.declaration_order(), whether it has to be
+// inferred in this run. Meant for the second overload of typecheck_program,
+// after restore_cached_types.
+//
+// PRECONDITION: metacheck_program has already been called on the program
+std::vector<bool> components_to_check(
+    TypeChecker const& tc,
+    std::vector<uint64_t> const& fingerprints,
+    CheckCache const& cache);
+
+// Gives the declarations that are not checked, but that the checked ones
+// refer to, the types saved in the cache. Returns false, and leaves the
+// declarations alone, if the cache doesn't have them in a form we can read,
+// in which case everything has to be checked.
+//
+// PRECONDITION: reify_types has already been called on the program
+bool restore_cached_types(
+    TypeChecker& tc,
+    std::vector<uint64_t> const& fingerprints,
+    CheckCache const& cache,
+    std::vector<bool> const& needs_check);
+
+} // namespace TypeChecker
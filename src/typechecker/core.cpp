@@ -1,5 +1,6 @@
 #include "core.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
@@ -8,24 +9,67 @@
 TypeSystemCore::TypeSystemCore() {
 }
 
-Type TypeSystemCore::apply_substitution(Type type) {
-	if (ll_is_var(type)) {
+TypeSystemCore::TypeSystemCore(TypeSystemCore const& from, int shared_types) {
+	for (int i = 0; i < shared_types; ++i) {
+		NodeHeader const& header = from.ll_node_header[i];
+		assert(header.tag == Tag::Term);
+		TermData const& term = from.ll_term_data[header.data_idx];
+		assert(term.argument_count == 0);
+		ll_new_term(term.function_id, nullptr, 0);
+	}
+
+	// the structure of records and variants can refer to each other, so
+	// they are all made before any is filled in
+	for (TypeFunctionData const& function : from.m_type_functions)
+		m_type_functions.push_back({function.tag, function.argument_count, function.fields, {}});
+
+	Import import {&from, shared_types};
+	for (int i = 0; i < int(from.m_type_functions.size()); ++i)
+		for (auto const& kv : from.m_type_functions[i].structure)
+			m_type_functions[i].structure.insert(kv.first, import_type(import, kv.second));
+}
+
+Type TypeSystemCore::resolve(Type type) {
+	while (ll_is_var(type)) {
 		VarId vi = get_representative_var_id(type);
 		data(type).data_idx = static_cast<int>(vi);
 		Type sub = m_substitution[static_cast<int>(vi)];
-		if (sub != Type(-1)) return apply_substitution(sub);
+		if (sub == Type(-1))
+			return type;
+		type = sub;
+	}
+	return type;
+}
+
+Type TypeSystemCore::apply_substitution(Type type) {
+	type = resolve(type);
+	if (ll_is_var(type))
 		return type;
-	} else {
-		TermData& term_data = ll_term_data[data(type).data_idx];
-		for (Type& arg_type : term_data.argument_idx) {
-			arg_type = apply_substitution(arg_type);
+
+	// substitute the arguments of every term we reach, keeping the terms
+	// still to visit on an explicit stack so deep types can't blow ours
+	assert(m_walk_stack.empty());
+	m_walk_stack.push_back(type);
+	while (!m_walk_stack.empty()) {
+		Type term = m_walk_stack.back();
+		m_walk_stack.pop_back();
+
+		TermData const term_data = ll_term_data[data(term).data_idx];
+		if (term_data.is_ground)
+			continue;
+		for (int k = 0; k < term_data.argument_count; ++k) {
+			int idx = term_data.argument_offset + k;
+			Type arg = resolve(m_term_arguments[idx]);
+			m_term_arguments[idx] = arg;
+			if (ll_is_term(arg))
+				m_walk_stack.push_back(arg);
 		}
-		return type;
 	}
+	return type;
 }
 
 Type TypeSystemCore::new_term(TypeFunc tf, std::vector<Type> args) {
-	return ll_new_term(tf, std::move(args));
+	return ll_new_term(tf, args.data(), args.size());
 }
 
 PolyId TypeSystemCore::forall(std::vector<VarId> vars, Type ty) {
@@ -35,30 +79,108 @@ PolyId TypeSystemCore::forall(std::vector<VarId> vars, Type ty) {
 }
 
 Type TypeSystemCore::inst_impl(
-    Type mono, std::unordered_map<VarId, Type> const& mapping) {
+    Type mono, FlatMap<VarId, Type> const& mapping) {
+
+	// Terms are rebuilt after their arguments, so each one is on the build
+	// stack twice: once to push its arguments, and once more, marked, to
+	// build it from their results. The result of every argument is pushed
+	// to the argument stack, and those of nested terms are popped before
+	// the next argument starts, so a term finds its own arguments
+	// contiguous at the top.
+	assert(m_build_stack.empty());
+	m_build_stack.push_back({mono, false});
+	while (!m_build_stack.empty()) {
+		Type type = m_build_stack.back().first;
+		bool arguments_done = m_build_stack.back().second;
+		m_build_stack.pop_back();
+
+		if (ll_is_var(type)) {
+			Type const* replacement = mapping.find(get_var_id(type));
+			m_argument_stack.push_back(replacement ? *replacement : type);
+			continue;
+		}
 
-	if (ll_is_var(mono)) {
-		auto it = mapping.find(get_var_id(mono));
-		return it == mapping.end() ? mono : it->second;
-	} else {
-		NodeHeader header = data(mono);
-		TermId term = header.data_idx;
-		std::vector<Type> new_args;
-		for (Type arg : ll_term_data[term].argument_idx)
-			new_args.push_back(inst_impl(arg, mapping));
-		return new_term(ll_term_data[term].function_id, std::move(new_args));
+		TermData const term = ll_term_data[data(type).data_idx];
+		if (term.is_ground) {
+			m_argument_stack.push_back(type);
+		} else if (!arguments_done) {
+			m_build_stack.push_back({type, true});
+			for (int k = term.argument_count; k--;)
+				m_build_stack.push_back({argument(term, k), false});
+		} else {
+			int const base = m_argument_stack.size() - term.argument_count;
+			Type result = ll_new_term(
+			    term.function_id, m_argument_stack.data() + base, term.argument_count);
+			m_argument_stack.resize(base);
+			m_argument_stack.push_back(result);
+		}
 	}
+
+	Type result = m_argument_stack.back();
+	m_argument_stack.pop_back();
+	return result;
 }
 
 Type TypeSystemCore::inst_fresh(PolyId poly) {
 	PolyData const& data = poly_data[poly];
 
-	std::unordered_map<VarId, Type> old_to_new;
+	std::vector<std::pair<VarId, Type>> entries;
+	entries.reserve(data.vars.size());
 	for (int i {0}; i != data.vars.size(); ++i) {
-		old_to_new[data.vars[i]] = ll_new_var();
+		entries.push_back({data.vars[i], ll_new_var()});
 	}
 
-	return inst_impl(data.base, old_to_new);
+	return inst_impl(data.base, FlatMap<VarId, Type> {std::move(entries)});
+}
+
+void TypeSystemCore::enter_level() {
+	m_current_level += 1;
+}
+
+void TypeSystemCore::leave_level() {
+	assert(m_current_level > 0);
+	m_current_level -= 1;
+}
+
+bool TypeSystemCore::is_generalizable(VarId var) {
+	return m_var_level[static_cast<int>(var)] > m_current_level;
+}
+
+void TypeSystemCore::bind_to_env(Type mono) {
+	lower_levels(apply_substitution(mono), m_current_level);
+}
+
+void TypeSystemCore::lower_levels(Type mono, int level) {
+	lower_levels_checking_occurs(mono, level, VarId(-1));
+}
+
+bool TypeSystemCore::lower_levels_checking_occurs(Type mono, int level, VarId var) {
+	bool occurs = false;
+	assert(m_walk_stack.empty());
+	m_walk_stack.push_back(mono);
+	while (!m_walk_stack.empty()) {
+		Type type = m_walk_stack.back();
+		m_walk_stack.pop_back();
+
+		// the type may not be substituted, so we follow the variables
+		// that are bound
+		type = resolve(type);
+		if (ll_is_var(type)) {
+			VarId vi = get_representative_var_id(type);
+			if (vi == var)
+				occurs = true;
+			int& var_level = m_var_level[static_cast<int>(vi)];
+			if (var_level > level)
+				var_level = level;
+		} else {
+			TermData const term = ll_term_data[data(type).data_idx];
+			if (term.is_ground)
+				continue;
+			for (int k = 0; k < term.argument_count; ++k)
+				m_walk_stack.push_back(argument(term, k));
+		}
+	}
+	return occurs;
 }
 
 std::unordered_set<VarId> TypeSystemCore::free_vars(Type mono) {
@@ -68,18 +190,38 @@ std::unordered_set<VarId> TypeSystemCore::free_vars(Type mono) {
 }
 
 void TypeSystemCore::gather_free_vars(Type mono, std::unordered_set<VarId>& free_vars) {
-	if (ll_is_var(mono)) {
-		free_vars.insert(get_var_id(mono));
-	} else {
-		const NodeHeader& header = data(mono);
-		TermId term = header.data_idx;
-		for (Type arg : ll_term_data[term].argument_idx)
-			gather_free_vars(arg, free_vars);
+	assert(m_walk_stack.empty());
+	m_walk_stack.push_back(mono);
+	while (!m_walk_stack.empty()) {
+		Type type = m_walk_stack.back();
+		m_walk_stack.pop_back();
+
+		if (ll_is_var(type)) {
+			free_vars.insert(get_var_id(type));
+		} else {
+			TermData const term = ll_term_data[data(type).data_idx];
+			if (term.is_ground)
+				continue;
+			for (int k = 0; k < term.argument_count; ++k)
+				m_walk_stack.push_back(argument(term, k));
+		}
 	}
 }
 
 
 
+bool TypeSystemCore::is_closed(Type mono) {
+	return free_vars(apply_substitution(mono)).empty();
+}
+
+bool TypeSystemCore::is_closed(PolyId poly) {
+	PolyData const& data = poly_data[poly];
+	for (VarId var : free_vars(apply_substitution(data.base)))
+		if (std::find(data.vars.begin(), data.vars.end(), var) == data.vars.end())
+			return false;
+	return true;
+}
+
 TypeFunc TypeSystemCore::new_builtin_type_function(int arity) {
 	return create_type_function(TypeFunctionTag::Builtin, arity, {}, {});
 }
@@ -87,7 +229,7 @@ TypeFunc TypeSystemCore::new_builtin_type_function(int arity) {
 TypeFunc TypeSystemCore::new_type_function(
     TypeFunctionTag type,
     std::vector<InternedString> fields,
-    std::unordered_map<InternedString, Type> structure) {
+    Structure structure) {
 	return create_type_function(type, 0, std::move(fields), std::move(structure));
 }
 
@@ -95,13 +237,22 @@ TypeFunc TypeSystemCore::create_type_function(
     TypeFunctionTag tag,
     int arity,
     std::vector<InternedString> fields,
-    std::unordered_map<InternedString, Type> structure) {
+    Structure structure) {
 	auto result = TypeFunc(m_type_functions.size());
 	m_type_functions.push_back(
 	    {tag, arity, std::move(fields), std::move(structure)});
 	return result;
 }
 
+TypeSystemCore::Structure TypeSystemCore::make_structure(
+    std::vector<InternedString> const& fields, std::vector<Type> const& types) {
+	std::vector<std::pair<InternedString, Type>> entries;
+	entries.reserve(fields.size());
+	for (int i = 0; i < fields.size(); ++i)
+		entries.push_back({fields[i], types[i]});
+	return Structure {std::move(entries)};
+}
+
 std::vector<InternedString> const& TypeSystemCore::fields(TypeFunc tf) {
 	assert(is_record(tf));
 	return data(tf).fields;
@@ -109,9 +260,9 @@ std::vector<InternedString> const& TypeSystemCore::fields(TypeFunc tf) {
 
 Type TypeSystemCore::type_of_field(TypeFunc tf, InternedString name) {
 	assert(is_record(tf) || is_variant(tf));
-	auto it = data(tf).structure.find(name);
-	assert(it != data(tf).structure.end());
-	return it->second;
+	Type const* type = data(tf).structure.find(name);
+	assert(type);
+	return *type;
 }
 
 bool TypeSystemCore::is_record(TypeFunc tf) {
@@ -122,6 +273,21 @@ bool TypeSystemCore::is_variant(TypeFunc tf) {
 	return data(tf).tag == TypeFunctionTag::Variant;
 }
 
+TypeFunc TypeSystemCore::function(Type term) {
+	assert(ll_is_term(term));
+	return ll_term_data[data(term).data_idx].function_id;
+}
+
+int TypeSystemCore::argument_count(Type term) {
+	assert(ll_is_term(term));
+	return ll_term_data[data(term).data_idx].argument_count;
+}
+
+Type TypeSystemCore::argument(Type term, int k) {
+	assert(ll_is_term(term));
+	return argument(ll_term_data[data(term).data_idx], k);
+}
+
 TypeFunc TypeSystemCore::type_function_of(Type mono) {
 	mono = apply_substitution(mono);
 	assert(ll_is_term(mono) && "tried to find function of non term");
@@ -148,19 +314,6 @@ void TypeSystemCore::unify_type_function(TypeFunc i, TypeFunc j) {
 	Log::fatal() << "unified " << print_a_thing(i) << " with " << print_a_thing(j);
 }
 
-bool TypeSystemCore::occurs(VarId v, Type i) {
-
-	if (ll_is_var(i))
-		return get_var_id(i) == v;
-
-	int ti = data(i).data_idx;
-	for (Type c : ll_term_data[ti].argument_idx)
-		if (occurs(v, c))
-			return true;
-
-	return false;
-}
-
 void TypeSystemCore::combine_constraints_left_to_right(VarId vi, VarId vj) {
 	auto& i_constraints = m_constraints[static_cast<int>(vi)];
 	auto& j_constraints = m_constraints[static_cast<int>(vj)];
@@ -171,14 +324,17 @@ void TypeSystemCore::combine_constraints_left_to_right(VarId vi, VarId vj) {
 		j_constraints = i_constraints;
 	} else {
 		assert(i_constraints.shape == j_constraints.shape);
-		for (auto const& kv : i_constraints.structure) {
-			auto it = j_constraints.structure.find(kv.first);
-			if (it == j_constraints.structure.end()) {
-				j_constraints.structure.insert(kv);
-			} else {
-				ll_unify(kv.second, it->second);
-			}
-		}
+
+		// unifying can touch other constraints, so we finish the merge
+		// before we unify the fields that both sides have
+		std::vector<std::pair<Type, Type>> shared_fields;
+		j_constraints.structure.merge(
+		    i_constraints.structure, [&](Type j_type, Type i_type) {
+			    shared_fields.push_back({i_type, j_type});
+		    });
+
+		for (auto const& types : shared_fields)
+			ll_unify(types.first, types.second);
 	}
 }
 
@@ -187,45 +343,61 @@ bool TypeSystemCore::satisfies(Type t, Constraint const& c) {
 }
 
 void TypeSystemCore::ll_unify(Type i, Type j) {
-	i = apply_substitution(i);
-	j = apply_substitution(j);
+	// The pairs of types that are left to unify are kept on an explicit
+	// stack, so deep terms can't blow ours. Merging constraints unifies
+	// too, and those nested calls only pop the pairs they push.
+	int const base = m_unify_stack.size();
+	m_unify_stack.push_back({i, j});
+	while (int(m_unify_stack.size()) > base) {
+		Type i = resolve(m_unify_stack.back().first);
+		Type j = resolve(m_unify_stack.back().second);
+		m_unify_stack.pop_back();
+
+		if (i == j)
+			continue;
+
+		if (ll_is_var(j))
+			std::swap(i, j);
+
+		if (ll_is_var(i)) {
+
+			auto vi = get_var_id(i);
+
+			if (ll_is_term(j)) {
+				assert(satisfies(j, m_constraints[static_cast<int>(vi)]));
+				// a single walk over j does both the occurs check and the
+				// level adjustment
+				if (lower_levels_checking_occurs(j, m_var_level[static_cast<int>(vi)], vi))
+					Log::fatal() << "tried to build an infinite type";
+				establish_substitution(vi, j);
+			} else {
+				auto vj = get_var_id(j);
 
-	if (i == j) return;
+				if (vi == vj)
+					continue;
 
-	if (ll_is_var(j))
-		std::swap(i, j);
+				// the smaller class is joined into the larger one, so the
+				// per-var data has to end up on whichever became the root
+				auto root = static_cast<VarId>(
+				    m_type_var_uf.join(static_cast<int>(vi), static_cast<int>(vj)));
+				auto other = root == vi ? vj : vi;
 
-	if (ll_is_var(i)) {
+				int& level = m_var_level[static_cast<int>(root)];
+				level = std::min(level, m_var_level[static_cast<int>(other)]);
 
-		auto vi = get_var_id(i);
+				combine_constraints_left_to_right(other, root);
+			}
 
-		if (ll_is_term(j)) {
-			assert(!occurs(vi, j));
-			assert(satisfies(j, m_constraints[static_cast<int>(vi)]));
-			establish_substitution(vi, j);
 		} else {
-			auto vj = get_var_id(j);
-
-			if (vi == vj) return;
-
-			m_type_var_uf.join_left_to_right(static_cast<int>(vi), static_cast<int>(vj));
-			combine_constraints_left_to_right(vi, vj);
-		}
-
-	} else {
-		int vi = data(i).data_idx;
-		int vj = data(j).data_idx;
-
-		if (vi != vj) {
-			TermData& i_data = ll_term_data[vi];
-			TermData& j_data = ll_term_data[vj];
+			TermData const i_data = ll_term_data[data(i).data_idx];
+			TermData const j_data = ll_term_data[data(j).data_idx];
 
 			unify_type_function(i_data.function_id, j_data.function_id);
-		}
 
-		assert(ll_term_data[vi].argument_idx.size() == ll_term_data[vj].argument_idx.size());
-		for (int k = 0; k < ll_term_data[vi].argument_idx.size(); ++k)
-			ll_unify(ll_term_data[vi].argument_idx[k], ll_term_data[vj].argument_idx[k]);
+			assert(i_data.argument_count == j_data.argument_count);
+			for (int k = i_data.argument_count; k--;)
+				m_unify_stack.push_back({argument(i_data, k), argument(j_data, k)});
+		}
 	}
 }
 
@@ -234,16 +406,49 @@ Type TypeSystemCore::ll_new_var() {
 	m_type_var_uf.new_node();
 	m_substitution.push_back(Type(-1));
 	m_constraints.push_back({});
+	m_var_level.push_back(m_current_level);
 	int type_id = m_type_counter++;
 	ll_node_header.push_back({Tag::Var, var_id});
 	return Type(type_id);
 }
 
-Type TypeSystemCore::ll_new_term(TypeFunc f, std::vector<Type> args) {
+size_t TypeSystemCore::hash_term(TypeFunc f, Type const* args, int argument_count) {
+	size_t result = std::hash<int> {}(int(f));
+	for (int k = 0; k < argument_count; ++k)
+		result = result * 31 + std::hash<int> {}(int(args[k]));
+	return result;
+}
+
+Type TypeSystemCore::ll_new_term(TypeFunc f, Type const* args, int argument_count) {
+	bool is_ground = true;
+	for (int k = 0; k < argument_count; ++k) {
+		if (!ll_is_term(args[k]) || !ll_term_data[data(args[k]).data_idx].is_ground) {
+			is_ground = false;
+			break;
+		}
+	}
+
+	size_t hash = 0;
+	if (is_ground) {
+		hash = hash_term(f, args, argument_count);
+		auto range = m_ground_terms.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			TermData const& term = ll_term_data[data(it->second).data_idx];
+			if (term.function_id == f && term.argument_count == argument_count &&
+			    std::equal(args, args + argument_count, m_term_arguments.data() + term.argument_offset))
+				return it->second;
+		}
+	}
+
 	int type_id = m_type_counter++;
 	assert(ll_node_header.size() == type_id);
 	ll_node_header.push_back({Tag::Term, static_cast<int>(ll_term_data.size())});
-	ll_term_data.push_back({f, std::move(args)});
+	ll_term_data.push_back({f, int(m_term_arguments.size()), argument_count, is_ground});
+	m_term_arguments.insert(m_term_arguments.end(), args, args + argument_count);
+
+	if (is_ground)
+		m_ground_terms.insert({hash, Type(type_id)});
+
 	return Type(type_id);
 }
 
@@ -298,9 +503,122 @@ void TypeSystemCore::add_variant_constraint(VarId v) {
 
 void TypeSystemCore::add_field_constraint(VarId v, InternedString name, Type ty) {
 	int i = static_cast<int>(v);
-	if (m_constraints[i].structure.count(name)) {
-		ll_unify(m_constraints[i].structure[name], ty);
+	if (Type const* field_type = m_constraints[i].structure.find(name)) {
+		Type existing = *field_type;
+		ll_unify(existing, ty);
 	} else {
-		m_constraints[i].structure[name] = ty;
+		m_constraints[i].structure.insert(name, ty);
+	}
+}
+
+Type TypeSystemCore::resolve_readonly(Type type) const {
+	while (ll_node_header[int(type)].tag == Tag::Var) {
+		int var = m_type_var_uf.find_readonly(ll_node_header[int(type)].data_idx);
+		Type sub = m_substitution[var];
+		if (sub == Type(-1))
+			break;
+		type = sub;
+	}
+	return type;
+}
+
+Type TypeSystemCore::import_type(Import& import, Type type) {
+	Type result = import_structure(import, type);
+
+	// fields of constraints can have constraints of their own, which are
+	// added to the list as we go
+	TypeSystemCore const& from = *import.from;
+	while (!import.pending_constraints.empty()) {
+		int from_var = import.pending_constraints.back().first;
+		int var = static_cast<int>(get_var_id(import.pending_constraints.back().second));
+		import.pending_constraints.pop_back();
+
+		Constraint const& constraint = from.m_constraints[from_var];
+		m_constraints[var].shape = constraint.shape;
+		for (auto const& field : constraint.structure) {
+			Type field_type = import_structure(import, field.second);
+			m_constraints[var].structure.insert(field.first, field_type);
+		}
 	}
+
+	return result;
+}
+
+Type TypeSystemCore::import_structure(Import& import, Type type) {
+	TypeSystemCore const& from = *import.from;
+
+	// the same bottom-up rebuild as in inst_impl
+	assert(m_build_stack.empty());
+	m_build_stack.push_back({type, false});
+	while (!m_build_stack.empty()) {
+		Type type = from.resolve_readonly(m_build_stack.back().first);
+		bool arguments_done = m_build_stack.back().second;
+		m_build_stack.pop_back();
+
+		if (int(type) < import.shared_types) {
+			m_argument_stack.push_back(type);
+			continue;
+		}
+
+		NodeHeader const header = from.ll_node_header[int(type)];
+		if (header.tag == Tag::Var) {
+			int from_var = from.m_type_var_uf.find_readonly(header.data_idx);
+			auto it = import.vars.find(from_var);
+			if (it != import.vars.end()) {
+				m_argument_stack.push_back(it->second);
+				continue;
+			}
+
+			Type var = ll_new_var();
+			m_var_level[static_cast<int>(get_var_id(var))] = from.m_var_level[from_var];
+			if (from.m_constraints[from_var].shape != Constraint::Shape::Unknown)
+				import.pending_constraints.push_back({from_var, var});
+			import.vars[from_var] = var;
+			m_argument_stack.push_back(var);
+			continue;
+		}
+
+		auto it = import.terms.find(int(type));
+		if (it != import.terms.end()) {
+			m_argument_stack.push_back(it->second);
+			continue;
+		}
+
+		TermData const term = from.ll_term_data[header.data_idx];
+		if (!arguments_done) {
+			m_build_stack.push_back({type, true});
+			for (int k = term.argument_count; k--;)
+				m_build_stack.push_back({from.argument(term, k), false});
+		} else {
+			int const base = m_argument_stack.size() - term.argument_count;
+			Type result = ll_new_term(
+			    term.function_id, m_argument_stack.data() + base, term.argument_count);
+			m_argument_stack.resize(base);
+			m_argument_stack.push_back(result);
+			import.terms[int(type)] = result;
+		}
+	}
+
+	Type result = m_argument_stack.back();
+	m_argument_stack.pop_back();
+	return result;
+}
+
+PolyId TypeSystemCore::import_poly(Import& import, PolyId poly) {
+	TypeSystemCore const& from = *import.from;
+	PolyData const& data = from.poly_data[poly];
+
+	Type base = import_type(import, data.base);
+
+	std::vector<VarId> vars;
+	vars.reserve(data.vars.size());
+	for (VarId from_var : data.vars) {
+		// every quantified variable occurs in the base, so it was imported
+		// along with it
+		auto it = import.vars.find(from.m_type_var_uf.find_readonly(static_cast<int>(from_var)));
+		assert(it != import.vars.end());
+		vars.push_back(get_var_id(it->second));
+	}
+
+	return forall(std::move(vars), base);
 }
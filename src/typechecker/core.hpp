@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "../algorithms/union_find.hpp"
+#include "../utils/flat_map.hpp"
 #include "../utils/interned_string.hpp"
 #include "typechecker_types.hpp"
 
@@ -24,6 +25,12 @@ struct TypeSystemCore {
 
 	TypeSystemCore();
 
+	// Makes a core to infer in on another thread. It knows the same type
+	// functions as `from`, and starts with the same first `shared_types`
+	// types, which must be terms without arguments. Any other type of
+	// `from` has to be imported before it is used here.
+	TypeSystemCore(TypeSystemCore const& from, int shared_types);
+
 	// types
 
 	Type apply_substitution(Type);
@@ -36,6 +43,13 @@ struct TypeSystemCore {
 	Type ll_new_var();
 	Type new_term(TypeFunc type_function, std::vector<Type> args);
 
+	// the structure of a type, for code that has to take types apart.
+	// The type has to be substituted first.
+	bool is_var(Type type) { return ll_is_var(type); }
+	TypeFunc function(Type term);
+	int argument_count(Type term);
+	Type argument(Type term, int k);
+
 	Type fun(std::vector<Type> arg_tys, Type res_ty) {
 		arg_tys.push_back(res_ty);
 		return new_term(TypeChecker::BuiltinType::Function, {arg_tys});
@@ -55,6 +69,24 @@ struct TypeSystemCore {
 
 	Type inst_fresh(PolyId poly);
 	PolyId forall(std::vector<VarId>, Type);
+	Type poly_base(PolyId poly) { return poly_data[poly].base; }
+	std::vector<VarId> const& poly_vars(PolyId poly) { return poly_data[poly].vars; }
+
+	// levels
+	//
+	// Every type variable remembers the level at which it was created, and
+	// unification lowers levels so that a variable's level is always the
+	// outermost level it can be reached from. When we leave a level, the free
+	// variables that are still above the current level can't be mentioned by
+	// the environment, so they can be generalized.
+
+	void enter_level();
+	void leave_level();
+	bool is_generalizable(VarId);
+
+	// binds the free variables of the type to the current level, for
+	// declarations that we don't generalize
+	void bind_to_env(Type);
 
 	// typefuncs
 
@@ -65,33 +97,62 @@ struct TypeSystemCore {
 
 	TypeFunc new_builtin_type_function(int arguments);
 
+	// whether the type mentions no type variables, other than the ones the
+	// polytype quantifies over
+	bool is_closed(Type);
+	bool is_closed(PolyId);
+
+	// imports
+	//
+	// Copies types from another core into this one. The other core is only
+	// read, so several threads can import from the same core at once, as
+	// long as nobody changes it meanwhile. Types imported with the same
+	// Import keep the variables they have in common, and are not copied
+	// twice.
+
+	struct Import {
+		TypeSystemCore const* from;
+		// the types below this are the same in both cores, and keep their
+		// ids
+		int shared_types;
+		// by the id in `from` of each variable's representative, or of
+		// each term
+		std::unordered_map<int, Type> vars;
+		std::unordered_map<int, Type> terms;
+		// the variables whose constraints are still to be imported
+		std::vector<std::pair<int, Type>> pending_constraints;
+	};
+
+	Type import_type(Import&, Type);
+	PolyId import_poly(Import&, PolyId);
+
 	TypeFunc new_record(std::vector<InternedString> fields, std::vector<Type> const& types) {
-		std::unordered_map<InternedString, Type> structure;
-		for (int i = 0; i < fields.size(); ++i)
-			structure[fields[i]] = types[i];
+		auto structure = make_structure(fields, types);
 		return new_type_function(
 		    TypeFunctionTag::Record, std::move(fields), std::move(structure));
 	}
 
 	TypeFunc new_variant(std::vector<InternedString> const& fields, std::vector<Type> const& types) {
-		std::unordered_map<InternedString, Type> structure;
-		for (int i = 0; i < fields.size(); ++i)
-			structure[fields[i]] = types[i];
-		return new_type_function(TypeFunctionTag::Variant, {}, std::move(structure));
+		return new_type_function(TypeFunctionTag::Variant, {}, make_structure(fields, types));
 	}
 
 private:
 
 	enum class TypeFunctionTag { Builtin, Variant, Record };
+	// Fields of a record or variant, sorted by name
+	using Structure = FlatMap<InternedString, Type>;
+
+	static Structure make_structure(std::vector<InternedString> const& fields, std::vector<Type> const& types);
+
 	// Concrete type function. If it's a built-in, we use argument_count
 	// to tell how many arguments it takes. Else, for variant, and record,
-	// we store their structure as a hash from names to monotypes.
+	// we store their structure as a table from names to monotypes.
 	struct TypeFunctionData {
 		TypeFunctionTag tag;
 		int argument_count; // -1 means variadic
 
 		std::vector<InternedString> fields;
-		std::unordered_map<InternedString, Type> structure;
+		Structure structure;
 	};
 
 	// A polytype is a type where some amount of type variables can take
@@ -106,7 +167,7 @@ private:
 			Unknown, Variant, Record
 		};
 
-		std::unordered_map<InternedString, Type> structure;
+		Structure structure;
 		Shape shape;
 	};
 
@@ -117,9 +178,14 @@ private:
 		int data_idx;
 	};
 
+	// The arguments of every term live in one flat array, m_term_arguments.
+	// Terms without type variables (ground terms) never change, so we
+	// hash-cons them: structurally equal ground terms get the same Type.
 	struct TermData {
 		TypeFunc function_id; // external id
-		std::vector<Type> argument_idx;
+		int argument_offset;
+		int argument_count;
+		bool is_ground;
 	};
 
 	NodeHeader& data(Type);
@@ -128,27 +194,40 @@ private:
 	TypeFunc new_type_function(
 	    TypeFunctionTag type,
 	    std::vector<InternedString> fields,
-	    std::unordered_map<InternedString, Type> structure);
+	    Structure structure);
 	void gather_free_vars(Type, std::unordered_set<VarId>&);
 
-	Type inst_impl(Type mono, std::unordered_map<VarId, Type> const& mapping);
+	Type inst_impl(Type mono, FlatMap<VarId, Type> const& mapping);
+
+	Type argument(TermData const& term, int k) const {
+		return m_term_arguments[term.argument_offset + k];
+	}
 	void unify_type_function(TypeFunc, TypeFunc);
 
 	bool ll_is_var(Type i);
 	bool ll_is_term(Type i);
 
-	Type ll_new_term(TypeFunc f, std::vector<Type> args);
+	Type ll_new_term(TypeFunc f, Type const* args, int argument_count);
+	static size_t hash_term(TypeFunc f, Type const* args, int argument_count);
 
 	TypeFunc create_type_function(
 	    TypeFunctionTag tag,
 		int arity,
 	    std::vector<InternedString> fields,
-	    std::unordered_map<InternedString, Type> structure);
+	    Structure structure);
 
 	void establish_substitution(VarId var_id, Type type_id);
+	// follows substitutions without changing anything
+	Type resolve_readonly(Type) const;
+	Type import_structure(Import&, Type);
 
 	VarId get_representative_var_id(Type i);
-	bool occurs(VarId v, Type i);
+	// follows substitutions until reaching a term or an unbound variable
+	Type resolve(Type);
+	void lower_levels(Type, int level);
+	// lowers levels like lower_levels, and reports whether var occurs in
+	// the type, all in one walk
+	bool lower_levels_checking_occurs(Type, int level, VarId var);
 	void combine_constraints_left_to_right(VarId vi, VarId vj);
 	bool satisfies(Type t, Constraint const& c);
 
@@ -164,12 +243,24 @@ private:
 
 	// per-term data
 	std::vector<TermData> ll_term_data;
+	std::vector<Type> m_term_arguments;
+	std::unordered_multimap<size_t, Type> m_ground_terms;
+
+	// scratch space for building the arguments of new terms
+	std::vector<Type> m_argument_stack;
+	// scratch worklists for the iterative walks over types
+	std::vector<Type> m_walk_stack;
+	std::vector<std::pair<Type, bool>> m_build_stack;
+	std::vector<std::pair<Type, Type>> m_unify_stack;
 
 	// per-var data
 	std::vector<Type> m_substitution;
 	std::vector<Constraint> m_constraints;
+	std::vector<int> m_var_level;
 	UnionFind m_type_var_uf;
 
+	int m_current_level {0};
+
 	int m_var_counter {0};
 	int m_term_counter {0};
 	int m_type_counter {0};
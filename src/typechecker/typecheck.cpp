@@ -6,8 +6,12 @@
 #include "typechecker.hpp"
 #include "typechecker_types.hpp"
 
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
 #include <cassert>
-#include <unordered_set>
 
 namespace TypeChecker {
 
@@ -22,9 +26,7 @@ static Type get_monotype_id(AST::Expr* ast) {
 	}
 }
 
-// this function implements 'the value restriction', a technique
-// that enables type inference on mutable datatypes
-static bool is_value_expression(AST::Expr* ast) {
+bool is_value_expression(AST::Expr* ast) {
 	switch (ast->type()) {
 	case ExprTag::FunctionLiteral:
 	case ExprTag::Identifier:
@@ -34,9 +36,55 @@ static bool is_value_expression(AST::Expr* ast) {
 	}
 }
 
+// whether the component is made of terms only. The others are handled by
+// metacheck and reify_types, and there is nothing left to infer for them.
+static bool is_term_component(std::vector<AST::Declaration*> const& component) {
+	for (auto decl : component)
+		if (decl->m_meta_type != MetaType::Term)
+			return false;
+	return true;
+}
+
+// integer(), number(), string(), boolean() and unit() are the first types
+// of every core
+static constexpr int builtin_types = 5;
+
+// Infers components on another thread, in a core of its own. A worker lives
+// as long as typecheck_program, so whatever it imports from the shared core
+// is only imported once.
+struct Worker {
+	explicit Worker(TypeSystemCore const& shared)
+	    : core {shared, builtin_types}
+	    , import {&shared, builtin_types} {}
+
+	TypeSystemCore core;
+	TypeSystemCore::Import import;
+	// the polytypes of the declarations from earlier components that were
+	// imported so far. Monomorphic ones are imported as polytypes with no
+	// variables, which only come up if they are closed.
+	std::unordered_map<AST::Declaration*, PolyId> declarations;
+
+	void import_declaration(AST::Declaration* decl) {
+		if (declarations.count(decl))
+			return;
+
+		declarations[decl] = decl->m_is_polymorphic
+		    ? core.import_poly(import, decl->m_decl_type)
+		    : core.forall({}, core.import_type(import, decl->m_value_type));
+	}
+};
+
 struct TypecheckHelper {
-	TypecheckHelper(TypeChecker& tc)
-	    : tc {tc} {}
+	// Infers in the given core, which is either the one in `tc`, or the
+	// one of a worker
+	TypecheckHelper(TypeChecker& tc, TypeSystemCore& core, Worker* worker = nullptr)
+	    : tc {tc}
+	    , m_core {core}
+	    , m_worker {worker} {}
+
+	// When set, the address of every type we write to the AST is added to
+	// it, so that the types a worker wrote can be imported later
+	std::vector<Type*>* m_written {nullptr};
 
 	Type integer() { return tc.integer(); }
 	Type number() { return tc.number(); }
@@ -44,40 +92,38 @@ struct TypecheckHelper {
 	Type boolean() { return tc.boolean(); }
 	Type unit() { return tc.unit(); }
 
-	TypeSystemCore& core() { return tc.core(); }
-	std::vector<std::vector<AST::Declaration*>> const& declaration_order() const { return tc.declaration_order(); }
+	TypeSystemCore& core() { return m_core; }
+
+	Type new_var() { return core().ll_new_var(); }
 
-	Type new_var() { return tc.new_var(); }
+	// types that come from the shared core, like constructors and type
+	// hints, have to be imported before a worker can use them
+	Type shared(Type type) {
+		return m_worker ? core().import_type(m_worker->import, type) : type;
+	}
+
+	void declare(AST::Declaration* decl) {
+		symbol_table.declare(decl);
+		record_type(decl->m_value_type);
+	}
+
+	Type record_type(Type& slot) {
+		if (m_written)
+			m_written->push_back(&slot);
+		return slot;
+	}
 
-	void declare(AST::Declaration* decl) { symbol_table.declare(decl); }
 	void new_nested_scope() { symbol_table.new_nested_scope(); }
 	void end_scope() { symbol_table.end_scope(); }
 
 	void unify(Type i, Type j) { core().ll_unify(i, j); }
 
-	Type inst_fresh(PolyId i) { return tc.core().inst_fresh(i); }
+	Type inst_fresh(PolyId i) { return core().inst_fresh(i); }
 
 	Type new_term(TypeFunc type_function, std::vector<Type> arguments) {
 		return core().new_term(type_function, std::move(arguments));
 	}
 
-	bool is_bound_to_env(VarId var) {
-
-		for (auto& kv : symbol_table.bindings()) {
-			auto decl = kv.second;
-
-			// TODO: it's probably not ok to skip polymorphic declarations
-			// but that's how it worked before, so not changing it right now.
-			if (decl->m_is_polymorphic) continue;
-
-			decl->m_value_type = core().apply_substitution(decl->m_value_type);
-			auto bound_type = decl->m_value_type;
-			if (core().free_vars(bound_type).count(var) != 0)
-				return true;
-		}
-
-		return false;
-	}
 
 
 // Literals
@@ -115,6 +161,13 @@ Type infer(AST::Identifier* ast) {
 	AST::Declaration* declaration = ast->m_declaration;
 	assert(declaration);
 	assert(declaration->m_meta_type == MetaType::Term);
+
+	if (m_worker) {
+		auto it = m_worker->declarations.find(declaration);
+		if (it != m_worker->declarations.end())
+			return ast->m_value_type = inst_fresh(it->second);
+	}
+
 	return ast->m_value_type = declaration->m_is_polymorphic
 		? inst_fresh(declaration->m_decl_type)
 		: declaration->m_value_type;
@@ -201,7 +254,7 @@ Type infer(AST::AccessExpression* ast) {
 Type infer(AST::MatchExpression* ast) {
 	Type target_type;
 	if (ast->m_type_hint) {
-		target_type = get_monotype_id(ast->m_type_hint);
+		target_type = shared(get_monotype_id(ast->m_type_hint));
 		check(&ast->m_target, target_type);
 	} else {
 		target_type = infer(&ast->m_target);
@@ -214,6 +267,7 @@ Type infer(AST::MatchExpression* ast) {
 		auto& case_data = kv.second;
 
 		case_data.m_declaration.m_value_type = new_var();
+		record_type(case_data.m_declaration.m_value_type);
 		process_type_hint(&case_data.m_declaration);
 
 		Type case_result_type = infer(case_data.m_expression);
@@ -237,7 +291,8 @@ Type infer(AST::ConstructorExpression* ast) {
 
 	auto& constructor = ast->m_evaluated_constructor;
 
-	auto tf = core().type_function_of(constructor.m_type);
+	Type constructor_type = shared(constructor.m_type);
+	auto tf = core().type_function_of(constructor_type);
 
 	// match value arguments
 	if (core().is_record(tf)) {
@@ -251,11 +306,10 @@ Type infer(AST::ConstructorExpression* ast) {
 	} else if (core().is_variant(tf)) {
 		assert(ast->m_args.size() == 1);
 		InternedString id = constructor.m_id;
-		Type constructor_type = core().type_of_field(tf, id);
-		check(ast->m_args[0], constructor_type);
+		check(ast->m_args[0], core().type_of_field(tf, id));
 	}
 
-	return ast->m_value_type = constructor.m_type;
+	return ast->m_value_type = constructor_type;
 }
 
 void generalize(AST::Declaration* ast) {
@@ -270,7 +324,7 @@ void generalize(AST::Declaration* ast) {
 
 		std::vector<VarId> vars;
 		for (VarId var : core().free_vars(type)) {
-			if (!is_bound_to_env(var)) {
+			if (core().is_generalizable(var)) {
 				vars.push_back(var);
 			}
 		}
@@ -280,9 +334,7 @@ void generalize(AST::Declaration* ast) {
 	} else {
 		// if it's not a value expression, its free vars get bound
 		// to the environment instead of being generalized.
-		//
-		// The way variables get bound to the environment is implicitly, simply by the
-		// fact that the declaration is bound to the symbol table.
+		core().bind_to_env(ast->m_value_type);
 	}
 }
 
@@ -290,7 +342,7 @@ void process_type_hint(AST::Declaration* ast) {
 	if (!ast->m_type_hint)
 		return;
 
-	unify(ast->m_value_type, get_monotype_id(ast->m_type_hint));
+	unify(ast->m_value_type, shared(get_monotype_id(ast->m_type_hint)));
 }
 
 // typecheck the value and make the type of the decl equal
@@ -377,7 +429,8 @@ void typecheck_stmt(AST::Declaration* ast) {
 	Type infer(AST::Expr* ast) {
 #define DISPATCH(type)                                                         \
 	case ExprTag::type:                                                        \
-		return infer(static_cast<AST::type*>(ast));
+		infer(static_cast<AST::type*>(ast));                                   \
+		return record_type(ast->m_value_type);
 
 #define IGNORE(type)                                                           \
 	case ExprTag::type:                                                        \
@@ -412,65 +465,233 @@ void typecheck_stmt(AST::Declaration* ast) {
 #undef IGNORE
 	}
 
-	void typecheck_program(AST::Program* ast) {
+	// Infers the types of the declarations in a component, and generalizes
+	// them. This implements the [Rec] rule.
+	void typecheck_component(std::vector<AST::Declaration*> const& component) {
+		new_nested_scope();
+		core().enter_level();
+
+		// temporarily extend the environment with fresh type
+		// variables
+		for (auto decl : component) {
+			decl->m_value_type = new_var();
+			declare(decl);
+		}
 
-		// NOTE: we don't actually do anything with `ast`: what we really care about
-		// has already been precomputed and stored in `tc`. This is not the most
-		// friendliest API, so maybe we could look into changing it?
+		// infer types for each declaration
+		for (auto decl : component) {
+			process_contents(decl);
+		}
 
-		auto const& comps = declaration_order();
+		core().leave_level();
+		end_scope();
 
-		// This loop implements the [Rec] rule
-		for (auto const& component : comps) {
+		// generalize all the declarations, so that they can be
+		// identified as polymorphic in the next rec-block.
+		//
+		// Declarations that can't be generalized go first, so that
+		// their variables are bound to the environment before we
+		// generalize the rest of the component.
+		for (auto decl : component) {
+			if (!is_value_expression(decl->m_value))
+				generalize(decl);
+		}
+		for (auto decl : component) {
+			if (is_value_expression(decl->m_value))
+				generalize(decl);
+		}
 
-			bool terms_only = true;
-			for (auto decl : component) {
-				if (decl->m_meta_type != MetaType::Term) {
-					terms_only = false;
-				}
-			}
+		// add generalized declarations to the global scope
+		for (auto decl : component) {
+			declare(decl);
+		}
+	}
 
-			if (!terms_only) continue;
+private:
 
-			new_nested_scope();
+	Frontend::SymbolTable symbol_table;
+	TypeChecker& tc;
+	TypeSystemCore& m_core;
+	Worker* m_worker;
+};
 
-			// temporarily extend the environment with fresh type
-			// variables
-			for (auto decl : component) {
-				decl->m_value_type = new_var();
-				declare(decl);
-			}
+// A wave is only split between workers if each of them gets at least this
+// many components, since a small component takes less time to infer than a
+// thread takes to start
+static constexpr int min_components_per_worker = 8;
+
+// What a worker needs to infer one component, and what it leaves behind
+struct WorkItem {
+	int component;
+	// the top level declarations from earlier components that it refers to
+	std::vector<AST::Declaration*> references;
+	// where the worker wrote the types it inferred
+	std::vector<Type*> written;
+};
 
-			// infer types for each declaration
-			for (auto decl : component) {
-				process_contents(decl);
-			}
+// Infers the components of one wave, which don't depend on each other, on
+// `worker_count` threads. Then the types they found are imported into the
+// shared core.
+static void typecheck_wave(
+    TypeChecker& tc,
+    std::vector<WorkItem>& items,
+    std::vector<std::unique_ptr<Worker>>& workers,
+    int worker_count) {
+	auto const& comps = tc.declaration_order();
+
+	// nobody writes to the shared core while the workers run, so they can
+	// all import from it at once
+	auto work = [&](int w) {
+		if (!workers[w])
+			workers[w] = std::make_unique<Worker>(tc.core());
+		Worker& worker = *workers[w];
+
+		TypecheckHelper helper {tc, worker.core, &worker};
+		for (int i = w; i < int(items.size()); i += worker_count) {
+			for (auto decl : items[i].references)
+				worker.import_declaration(decl);
+			helper.m_written = &items[i].written;
+			helper.typecheck_component(comps[items[i].component]);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int w = 1; w < worker_count; ++w)
+		threads.emplace_back(work, w);
+	work(0);
+	for (auto& thread : threads)
+		thread.join();
+
+	// the imports go in the order of the components, so the ids they get
+	// don't depend on how the threads were scheduled
+	for (int i = 0; i < int(items.size()); ++i) {
+		auto& item = items[i];
+
+		// a slot can be recorded more than once, but must only be
+		// imported once
+		std::sort(item.written.begin(), item.written.end());
+		item.written.erase(
+		    std::unique(item.written.begin(), item.written.end()), item.written.end());
+
+		TypeSystemCore::Import import {&workers[i % worker_count]->core, builtin_types};
+		for (Type* slot : item.written)
+			if (*slot != Type(-1))
+				*slot = tc.core().import_type(import, *slot);
+		for (auto decl : comps[item.component])
+			if (decl->m_is_polymorphic)
+				decl->m_decl_type = tc.core().import_poly(import, decl->m_decl_type);
+	}
+}
 
-			end_scope();
+static void typecheck_components(
+    TypeChecker& tc, std::vector<bool> const* needs_check, int thread_count) {
+	auto const& comps = tc.declaration_order();
+	auto const& deps = tc.declaration_dependencies();
+	int const n = comps.size();
 
-			// generalize all the declarations, so that they can be
-			// identified as polymorphic in the next rec-block
-			for (auto decl : component) {
-				generalize(decl);
-			}
+	TypecheckHelper serial {tc, tc.core()};
+
+	auto should_check = [&](int c) {
+		return (!needs_check || (*needs_check)[c]) && is_term_component(comps[c]);
+	};
 
-			// add generalized declarations to the global scope
-			for (auto decl : component) {
-				declare(decl);
+	if (thread_count <= 1) {
+		for (int c = 0; c < n; ++c)
+			if (should_check(c))
+				serial.typecheck_component(comps[c]);
+		return;
+	}
+
+	// Components are grouped in waves: each one goes in the wave after the
+	// last of the components it depends on, so the components of a wave
+	// are independent, and only need the waves before them to be done.
+	std::unordered_map<AST::Declaration*, int> component_of;
+	std::vector<int> wave_of(n, -1);
+	std::vector<std::vector<int>> waves;
+	for (int c = 0; c < n; ++c) {
+		for (auto decl : comps[c])
+			component_of[decl] = c;
+
+		if (!should_check(c))
+			continue;
+
+		int wave = 0;
+		for (int d : deps[c])
+			if (wave_of[d] != -1)
+				wave = std::max(wave, wave_of[d] + 1);
+
+		wave_of[c] = wave;
+		if (wave == int(waves.size()))
+			waves.emplace_back();
+		waves[wave].push_back(c);
+	}
+
+	for (auto& bucket : tc.m_builtin_declarations.m_buckets)
+		for (auto& decl : bucket)
+			component_of[&decl] = -1;
+
+	std::vector<std::unique_ptr<Worker>> workers(thread_count);
+	for (auto const& wave : waves) {
+
+		// A worker can't change the types the shared core already has, so
+		// a component that refers to a type that still has free variables,
+		// like the type of `a := array {}`, is inferred in the shared core,
+		// where it may bind them.
+		std::vector<WorkItem> items;
+		std::vector<int> serial_components;
+		for (int c : wave) {
+			WorkItem item {c, {}, {}};
+			bool closed = true;
+			for (auto decl : comps[c]) {
+				for (auto other : decl->m_references) {
+					auto it = component_of.find(other);
+					if (it == component_of.end() || it->second == c)
+						continue;
+					if (other->m_meta_type != MetaType::Term)
+						continue;
+
+					item.references.push_back(other);
+					closed = closed && (other->m_is_polymorphic
+					    ? tc.core().is_closed(other->m_decl_type)
+					    : tc.core().is_closed(other->m_value_type));
+				}
 			}
 
+			if (closed)
+				items.push_back(std::move(item));
+			else
+				serial_components.push_back(c);
 		}
-	}
 
-private:
+		int worker_count = std::min(thread_count, int(items.size()) / min_components_per_worker);
+		if (worker_count < 2) {
+			for (auto const& item : items)
+				serial_components.push_back(item.component);
+			items.clear();
+		} else {
+			typecheck_wave(tc, items, workers, worker_count);
+		}
 
-	Frontend::SymbolTable symbol_table;
-	TypeChecker& tc;
-};
+		std::sort(serial_components.begin(), serial_components.end());
+		for (int c : serial_components)
+			serial.typecheck_component(comps[c]);
+	}
+}
+
+void typecheck_program(AST::Program* ast, TypeChecker& tc, int thread_count) {
+	// NOTE: we don't actually do anything with `ast`: what we really care about
+	// has already been precomputed and stored in `tc`. This is not the most
+	// friendliest API, so maybe we could look into changing it?
+	typecheck_components(tc, nullptr, thread_count);
+}
 
-void typecheck_program(AST::Program* ast, TypeChecker& tc) {
-	TypecheckHelper helper {tc};
-	helper.typecheck_program(ast);
+void typecheck_program(
+    AST::Program* ast,
+    TypeChecker& tc,
+    std::vector<bool> const& needs_check,
+    int thread_count) {
+	assert(needs_check.size() == tc.declaration_order().size());
+	typecheck_components(tc, &needs_check, thread_count);
 }
 
 } // namespace TypeChecker
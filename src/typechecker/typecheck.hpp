@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 namespace AST {
 struct Expr;
 struct Program;
@@ -15,9 +17,34 @@ struct TypeChecker;
  * Implements a variant of the Hindley-Milner type
  * inference algorithm.
  *
+ * With more than one thread, components of
+ * TypeChecker::declaration_order() that don't depend on each
+ * other are inferred at the same time, each worker in a core
+ * of its own, and the types they find are imported into the
+ * shared TypeSystemCore. Components that refer to types with
+ * free variables are inferred in the shared core, one at a
+ * time.
+ *
  * PRECONDITION: match_identifiers has already been called
  * the given ast.
  */
 // void typecheck(AST::Expr* ast, TypeChecker&);
-void typecheck_program(AST::Program* ast, TypeChecker&);
+void typecheck_program(AST::Program* ast, TypeChecker&, int thread_count = 1);
+
+/*
+ * Same as above, but only infers the components of
+ * TypeChecker::declaration_order() that are marked in `needs_check`.
+ * No component that is checked may depend on one that is skipped,
+ * unless the skipped one has its types already, as
+ * restore_cached_types gives them.
+ */
+void typecheck_program(
+    AST::Program* ast,
+    TypeChecker&,
+    std::vector<bool> const& needs_check,
+    int thread_count = 1);
+
+// this function implements 'the value restriction', a technique
+// that enables type inference on mutable datatypes
+bool is_value_expression(AST::Expr* ast);
 } // namespace TypeChecker
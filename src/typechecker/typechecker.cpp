@@ -35,6 +35,7 @@ TypeChecker::TypeChecker(AST::Allocator& allocator)
 	auto array_a = core().array(a);
 
 	auto array_int = core().array(integer());
+	auto array_string = core().array(string());
 
 	auto forall_a = [&](Type t) {
 		return this->core().forall({aid}, t);
@@ -76,6 +77,7 @@ TypeChecker::TypeChecker(AST::Allocator& allocator)
 	declare_builtin_value("read_number",  mono(fun({}, number())));
 	declare_builtin_value("read_string",  mono(fun({}, string())));
 	declare_builtin_value("read_line",    mono(fun({}, string())));
+	declare_builtin_value("read_fields",  mono(fun({string()}, array_string)));
 
 	declare_builtin_typefunc("int",     BuiltinType::Int);
 	declare_builtin_typefunc("float",   BuiltinType::Float);
@@ -136,6 +138,10 @@ std::vector<std::vector<AST::Declaration*>> const& TypeChecker::declaration_orde
 	return m_declaration_components;
 }
 
+std::vector<std::vector<int>> const& TypeChecker::declaration_dependencies() const {
+	return m_declaration_dependencies;
+}
+
 void TypeChecker::compute_declaration_order(AST::Program* ast) {
 
 	std::unordered_map<AST::Declaration*, int> decl_to_index;
@@ -176,6 +182,8 @@ void TypeChecker::compute_declaration_order(AST::Program* ast) {
 
 		m_declaration_components.push_back(std::move(decl_comp));
 	}
+
+	m_declaration_dependencies = solver.edges_of_components();
 }
 
 } // namespace TypeChecker
@@ -36,11 +36,16 @@ struct TypeChecker {
 	TypeSystemCore& core() { return m_core; }
 
 	std::vector<std::vector<AST::Declaration*>> const& declaration_order() const;
+	// for each component in declaration_order(), the indices of the
+	// components it refers to. Components that don't depend on each other,
+	// directly or not, can be checked in any order.
+	std::vector<std::vector<int>> const& declaration_dependencies() const;
 	void compute_declaration_order(AST::Program* ast);
 
 private:
 	TypeSystemCore m_core;
 	std::vector<std::vector<AST::Declaration*>> m_declaration_components;
+	std::vector<std::vector<int>> m_declaration_dependencies;
 };
 
 } // namespace TypeChecker
@@ -0,0 +1,32 @@
+#include "bump_allocator.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+BumpAllocator::BumpAllocator(int target_bytes_per_block)
+    : m_bytes_per_block {target_bytes_per_block} {}
+
+uint8_t* BumpAllocator::allocate_slow(size_t bytes, size_t alignment) {
+	assert((alignment & (alignment - 1)) == 0);
+
+	// new[] only guarantees fundamental alignment, so we reserve some slack
+	// to align the first allocation in the block by hand
+	size_t const block_size =
+	    std::max<size_t>(m_bytes_per_block, bytes + alignment);
+
+	m_blocks.emplace_back(new uint8_t[block_size]);
+	m_bytes_allocated += block_size;
+
+	uint8_t* block = m_blocks.back().get();
+	uintptr_t aligned =
+	    (reinterpret_cast<uintptr_t>(block) + alignment - 1) & ~(alignment - 1);
+
+	// if this was an oversized request, keep bumping through the old block
+	if (block_size == size_t(m_bytes_per_block) || !m_cursor) {
+		m_cursor = reinterpret_cast<uint8_t*>(aligned + bytes);
+		m_end = block + block_size;
+	}
+
+	return reinterpret_cast<uint8_t*>(aligned);
+}
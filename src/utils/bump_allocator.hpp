@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Hands out memory by bumping a pointer through large blocks. Individual
+// allocations are never freed: everything is released when the allocator
+// is destroyed. Requests that don't fit in a regular block get a block of
+// their own.
+struct BumpAllocator {
+	BumpAllocator(int target_bytes_per_block);
+
+	BumpAllocator(BumpAllocator const&) = delete;
+	BumpAllocator& operator=(BumpAllocator const&) = delete;
+
+	uint8_t* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+		uintptr_t cursor = reinterpret_cast<uintptr_t>(m_cursor);
+		uintptr_t aligned = (cursor + alignment - 1) & ~(alignment - 1);
+		if (m_cursor && aligned + bytes <= reinterpret_cast<uintptr_t>(m_end)) {
+			m_cursor = reinterpret_cast<uint8_t*>(aligned + bytes);
+			return reinterpret_cast<uint8_t*>(aligned);
+		}
+		return allocate_slow(bytes, alignment);
+	}
+
+	size_t bytes_allocated() const {
+		return m_bytes_allocated;
+	}
+
+  private:
+	uint8_t* allocate_slow(size_t bytes, size_t alignment);
+
+	int m_bytes_per_block;
+	uint8_t* m_cursor {nullptr};
+	uint8_t* m_end {nullptr};
+	size_t m_bytes_allocated {0};
+	std::vector<std::unique_ptr<uint8_t[]>> m_blocks;
+};
@@ -0,0 +1,150 @@
+#include "char_scan.hpp"
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+// We intentionally read whole aligned blocks, which may extend past the end of
+// the buffer. This is safe in practice, but the sanitizer can't know that.
+#if defined(__clang__) || defined(__GNUC__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#define NO_SANITIZE_ADDRESS
+#endif
+
+namespace {
+
+#if defined(__AVX2__)
+
+struct Simd {
+	using Reg = __m256i;
+	static constexpr int width = 32;
+	static constexpr uint32_t all = 0xffffffff;
+
+	NO_SANITIZE_ADDRESS static Reg load(char const* p) {
+		return _mm256_load_si256(reinterpret_cast<Reg const*>(p));
+	}
+
+	static Reg splat(char c) { return _mm256_set1_epi8(c); }
+	static Reg eq(Reg a, Reg b) { return _mm256_cmpeq_epi8(a, b); }
+	static Reg gt(Reg a, Reg b) { return _mm256_cmpgt_epi8(a, b); }
+	static Reg bit_or(Reg a, Reg b) { return _mm256_or_si256(a, b); }
+	static Reg bit_and(Reg a, Reg b) { return _mm256_and_si256(a, b); }
+	static uint32_t mask(Reg a) { return uint32_t(_mm256_movemask_epi8(a)); }
+};
+
+#else
+
+struct Simd {
+	using Reg = __m128i;
+	static constexpr int width = 16;
+	static constexpr uint32_t all = 0xffff;
+
+	NO_SANITIZE_ADDRESS static Reg load(char const* p) {
+		return _mm_load_si128(reinterpret_cast<Reg const*>(p));
+	}
+
+	static Reg splat(char c) { return _mm_set1_epi8(c); }
+	static Reg eq(Reg a, Reg b) { return _mm_cmpeq_epi8(a, b); }
+	static Reg gt(Reg a, Reg b) { return _mm_cmpgt_epi8(a, b); }
+	static Reg bit_or(Reg a, Reg b) { return _mm_or_si128(a, b); }
+	static Reg bit_and(Reg a, Reg b) { return _mm_and_si128(a, b); }
+	static uint32_t mask(Reg a) { return uint32_t(_mm_movemask_epi8(a)); }
+};
+
+#endif
+
+// bytes in [lo, hi]. Comparisons are signed, so this only works for ASCII
+// ranges (bytes >= 128 are negative and never match).
+static Simd::Reg in_range(Simd::Reg v, char lo, char hi) {
+	return Simd::bit_and(
+	    Simd::gt(v, Simd::splat(lo - 1)), Simd::gt(Simd::splat(hi + 1), v));
+}
+
+// Returns a pointer to the first byte for which `stop` sets a mask bit.
+// `stop` must flag the NUL byte, otherwise we could run off the buffer.
+// Bits above Simd::width are ignored, so `stop` may return negated masks.
+template <typename StopMask>
+NO_SANITIZE_ADDRESS static char const* scan_until(char const* p, StopMask stop) {
+	auto const address = reinterpret_cast<uintptr_t>(p);
+	auto block = reinterpret_cast<char const*>(address & ~uintptr_t(Simd::width - 1));
+
+	// ignore the bytes of the first block that come before `p`
+	uint32_t mask = (stop(Simd::load(block)) & Simd::all) >> (p - block);
+	if (mask)
+		return p + __builtin_ctz(mask);
+
+	while (1) {
+		block += Simd::width;
+		mask = stop(Simd::load(block)) & Simd::all;
+		if (mask)
+			return block + __builtin_ctz(mask);
+	}
+}
+
+} // namespace
+
+char const* skip_whitespace(char const* p) {
+	return scan_until(p, [](Simd::Reg v) {
+		auto ws = Simd::bit_or(
+		    Simd::eq(v, Simd::splat(' ')),
+		    Simd::bit_or(
+		        Simd::eq(v, Simd::splat('\t')),
+		        Simd::eq(v, Simd::splat('\n'))));
+		return ~Simd::mask(ws);
+	});
+}
+
+char const* skip_identifier_chars(char const* p) {
+	return scan_until(p, [](Simd::Reg v) {
+		// setting the 0x20 bit maps upper case letters to lower case, and
+		// doesn't map anything else into [a-z]
+		auto lower = Simd::bit_or(v, Simd::splat(0x20));
+		auto ident = Simd::bit_or(
+		    Simd::bit_or(in_range(lower, 'a', 'z'), in_range(v, '0', '9')),
+		    Simd::eq(v, Simd::splat('_')));
+		return ~Simd::mask(ident);
+	});
+}
+
+char const* find_char_or_nul(char const* p, char c) {
+	return scan_until(p, [c](Simd::Reg v) {
+		return Simd::mask(Simd::bit_or(
+		    Simd::eq(v, Simd::splat(c)), Simd::eq(v, Simd::splat('\0'))));
+	});
+}
+
+#undef NO_SANITIZE_ADDRESS
+
+#else
+
+static bool is_identifier_char(char c) {
+	return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+	       ('0' <= c && c <= '9') || c == '_';
+}
+
+char const* skip_whitespace(char const* p) {
+	while (*p == ' ' || *p == '\t' || *p == '\n')
+		p += 1;
+	return p;
+}
+
+char const* skip_identifier_chars(char const* p) {
+	while (is_identifier_char(*p))
+		p += 1;
+	return p;
+}
+
+char const* find_char_or_nul(char const* p, char c) {
+	while (*p != c && *p != '\0')
+		p += 1;
+	return p;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+// Fast scanning over NUL-terminated buffers.
+//
+// Each function returns a pointer to the first byte that does not belong to
+// the run being scanned. Scans always stop at the NUL terminator, so callers
+// don't need to pass a length.
+//
+// When available, we classify 16 (SSE2) or 32 (AVX2) bytes at a time. Vector
+// loads are aligned, so they never cross into a page that doesn't hold any
+// bytes of the buffer, even if they read a bit past the terminator.
+
+// skips ' ', '\t' and '\n'
+char const* skip_whitespace(char const* p);
+
+// skips [a-zA-Z0-9_]
+char const* skip_identifier_chars(char const* p);
+
+// finds the first occurrence of `c`, or the NUL terminator
+char const* find_char_or_nul(char const* p, char c);
@@ -0,0 +1,104 @@
+#include "file_contents.hpp"
+
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileContents::FileContents(FileContents&& o)
+    : m_data {std::exchange(o.m_data, "")}
+    , m_size {std::exchange(o.m_size, 0)}
+    , m_mapped {std::exchange(o.m_mapped, false)}
+    , m_owned {std::exchange(o.m_owned, false)} {}
+
+FileContents& FileContents::operator=(FileContents&& o) {
+	if (this != &o) {
+		release();
+		m_data = std::exchange(o.m_data, "");
+		m_size = std::exchange(o.m_size, 0);
+		m_mapped = std::exchange(o.m_mapped, false);
+		m_owned = std::exchange(o.m_owned, false);
+	}
+	return *this;
+}
+
+FileContents::~FileContents() {
+	release();
+}
+
+void FileContents::release() {
+	if (m_mapped)
+		munmap(const_cast<char*>(m_data), m_size);
+	else if (m_owned)
+		delete[] m_data;
+
+	m_data = "";
+	m_size = 0;
+	m_mapped = false;
+	m_owned = false;
+}
+
+static bool read_all(int fd, char* buffer, size_t size) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t got = read(fd, buffer + done, size - done);
+		if (got < 0)
+			return false;
+		if (got == 0)
+			break;
+		done += got;
+	}
+	return done == size;
+}
+
+// below this, copying the file costs less than setting up a mapping, and
+// can't be broken by the file changing under us
+static size_t const min_mapped_size = 1 << 16;
+
+Writer<FileContents> read_file(char const* path) {
+	ErrorReport failure {"Failed to open '" + std::string(path) + "'"};
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return failure;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+		close(fd);
+		return failure;
+	}
+
+	FileContents result;
+	size_t const size = info.st_size;
+	size_t const page_size = sysconf(_SC_PAGESIZE);
+
+	// The kernel zero-fills the tail of the last page of a mapping, which
+	// gives us the NUL terminator for free, as long as there is a tail.
+	if (size >= min_mapped_size && size % page_size != 0) {
+		void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) {
+			result.m_data = static_cast<char const*>(mapping);
+			result.m_size = size;
+			result.m_mapped = true;
+			close(fd);
+			return {{}, std::move(result)};
+		}
+	}
+
+	char* buffer = new char[size + 1];
+	if (!read_all(fd, buffer, size)) {
+		delete[] buffer;
+		close(fd);
+		return failure;
+	}
+	buffer[size] = '\0';
+	close(fd);
+
+	result.m_data = buffer;
+	result.m_size = size;
+	result.m_owned = true;
+	return {{}, std::move(result)};
+}
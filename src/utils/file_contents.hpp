@@ -0,0 +1,48 @@
+#pragma once
+
+#include "string_view.hpp"
+#include "writer.hpp"
+
+#include <cstddef>
+
+// Read-only contents of a file, always followed by a NUL byte, so they can be
+// handed to the lexer directly: it scans until the NUL instead of checking
+// against the end of the source.
+//
+// Small files are read into a heap buffer. Bigger ones are mapped into memory
+// when there is room for the terminator in the mapping, which is not the case
+// when the size is a multiple of the page size; those are read as well.
+//
+// A mapped file that is truncated while we still hold the mapping makes the
+// next access past its new end raise SIGBUS. Source files are only expected
+// to change between runs, so we accept that for files big enough for the
+// copy to matter.
+struct FileContents {
+	FileContents() = default;
+	FileContents(FileContents&&);
+	FileContents& operator=(FileContents&&);
+	~FileContents();
+
+	FileContents(FileContents const&) = delete;
+	FileContents& operator=(FileContents const&) = delete;
+
+	string_view view() const {
+		return {m_data, m_size};
+	}
+
+	bool is_mapped() const {
+		return m_mapped;
+	}
+
+  private:
+	friend Writer<FileContents> read_file(char const* path);
+
+	void release();
+
+	char const* m_data {""};
+	size_t m_size {0};
+	bool m_mapped {false};
+	bool m_owned {false};
+};
+
+Writer<FileContents> read_file(char const* path);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/**
+ * Map stored as a vector of key-value pairs, sorted by key.
+ *
+ * Meant for maps with a handful of entries, where hashing costs more than it
+ * saves. Lookups are binary searches, and two maps can be merged in a single
+ * linear pass.
+ */
+template <typename K, typename V>
+struct FlatMap {
+	using Entry = std::pair<K, V>;
+
+	FlatMap() = default;
+
+	// keys must be unique
+	explicit FlatMap(std::vector<Entry> entries)
+	    : m_entries {std::move(entries)} {
+		std::sort(m_entries.begin(), m_entries.end(), compare_entries);
+	}
+
+	V* find(K const& key) {
+		auto it = lower_bound(key);
+		return it != m_entries.end() && it->first == key ? &it->second : nullptr;
+	}
+
+	V const* find(K const& key) const {
+		return const_cast<FlatMap*>(this)->find(key);
+	}
+
+	// returns false, and leaves the map untouched, if the key was present
+	bool insert(K key, V value) {
+		auto it = lower_bound(key);
+		if (it != m_entries.end() && it->first == key)
+			return false;
+		m_entries.insert(it, {std::move(key), std::move(value)});
+		return true;
+	}
+
+	// Adds the entries of `other` that are missing from this map. For keys
+	// in both, calls `on_both(our_value, their_value)` instead.
+	template <typename F>
+	void merge(FlatMap const& other, F on_both) {
+		std::vector<Entry> result;
+		result.reserve(m_entries.size() + other.m_entries.size());
+
+		auto ours = m_entries.begin();
+		auto theirs = other.m_entries.begin();
+		while (ours != m_entries.end() && theirs != other.m_entries.end()) {
+			if (ours->first < theirs->first) {
+				result.push_back(std::move(*ours++));
+			} else if (theirs->first < ours->first) {
+				result.push_back(*theirs++);
+			} else {
+				on_both(ours->second, theirs->second);
+				result.push_back(std::move(*ours++));
+				++theirs;
+			}
+		}
+		result.insert(result.end(), std::make_move_iterator(ours), std::make_move_iterator(m_entries.end()));
+		result.insert(result.end(), theirs, other.m_entries.end());
+
+		m_entries = std::move(result);
+	}
+
+	int size() const {
+		return m_entries.size();
+	}
+
+	bool empty() const {
+		return m_entries.empty();
+	}
+
+	typename std::vector<Entry>::const_iterator begin() const {
+		return m_entries.begin();
+	}
+
+	typename std::vector<Entry>::const_iterator end() const {
+		return m_entries.end();
+	}
+
+  private:
+	static bool compare_entries(Entry const& a, Entry const& b) {
+		return a.first < b.first;
+	}
+
+	typename std::vector<Entry>::iterator lower_bound(K const& key) {
+		return std::lower_bound(
+		    m_entries.begin(), m_entries.end(), key,
+		    [](Entry const& entry, K const& key) { return entry.first < key; });
+	}
+
+	std::vector<Entry> m_entries;
+};
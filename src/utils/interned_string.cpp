@@ -2,6 +2,9 @@
 
 #include "string_set.hpp"
 
+#include <mutex>
+#include <ostream>
+
 #include <cassert>
 
 StringSet& InternedString::database() {
@@ -9,32 +12,50 @@ StringSet& InternedString::database() {
 	return values;
 }
 
+// Interpreters on different threads intern strings at the same time, and
+// all of them have to get the same entries, so the database is shared, and
+// inserting into it takes this lock, whichever constructor does it. Entries
+// never move once inserted, so reading them doesn't.
+static std::mutex database_mutex;
+
+template <typename... Args>
+static StringSet::Entry const* intern(Args const&... args) {
+	std::lock_guard<std::mutex> lock {database_mutex};
+	return InternedString::database().insert(args...).first;
+}
+
 InternedString::InternedString(InternedString const& other)
     : m_data {other.m_data} {}
 
 InternedString::InternedString(char const* other, size_t length) {
-	auto insertion_result = database().insert(other, length);
-	m_data = &(*insertion_result.first);
+	m_data = intern(other, length);
 }
 
 InternedString::InternedString(char const* other) {
-	auto insertion_result = database().insert(other);
-	m_data = &(*insertion_result.first);
+	m_data = intern(other);
+}
+
+InternedString::InternedString(string_view other) {
+	m_data = intern(other);
 }
 
 InternedString::InternedString(std::string const& other) {
-	auto insertion_result = database().insert(other);
-	m_data = &(*insertion_result.first);
+	m_data = intern(other);
 }
 
-InternedString::InternedString(std::string&& other) {
-	auto insertion_result = database().insert(std::move(other));
-	m_data = &(*insertion_result.first);
+string_view InternedString::str() const {
+	assert(m_data);
+	return m_data->view();
+}
+
+char const* InternedString::c_str() const {
+	assert(m_data);
+	return m_data->data();
 }
 
-std::string const& InternedString::str() const {
+size_t InternedString::size() const {
 	assert(m_data);
-	return *m_data;
+	return m_data->length;
 }
 
 std::ostream& operator<<(std::ostream& o, InternedString const& is) {
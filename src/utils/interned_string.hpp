@@ -3,17 +3,18 @@
 #include <iosfwd>
 #include <string>
 
-struct StringSet;
+#include "string_set.hpp"
+#include "string_view.hpp"
 
 struct InternedString {
-	std::string const* m_data {nullptr};
+	StringSet::Entry const* m_data {nullptr};
 
 	InternedString() = default;
 	InternedString(InternedString const& other);
 	InternedString(char const* other);
 	InternedString(char const* other, size_t length);
+	explicit InternedString(string_view other);
 	explicit InternedString(std::string const& other);
-	explicit InternedString(std::string&& other);
 
 	bool is_null() const {
 		return !m_data;
@@ -27,7 +28,12 @@ struct InternedString {
 		return m_data < other.m_data;
 	}
 
-	std::string const& str() const;
+	string_view str() const;
+
+	// interned strings are always NUL-terminated
+	char const* c_str() const;
+
+	size_t size() const;
 
 	static StringSet& database();
 };
@@ -35,7 +41,7 @@ struct InternedString {
 // Specialize std::hash to implement hashing for this type
 template<> struct std::hash<InternedString> {
 	std::size_t operator()(InternedString const& str) const noexcept {
-		auto hash_bits = std::hash<std::string const*>{}(str.m_data);
+		auto hash_bits = std::hash<StringSet::Entry const*>{}(str.m_data);
 		return (hash_bits >> 4) | (hash_bits << 60);
 	};
 };
@@ -1,5 +1,7 @@
 #include "string_set.hpp"
 
+#include <new>
+
 #include <cassert>
 #include <cstring>
 
@@ -23,7 +25,8 @@ static uint64_t compute_effective_hash(unsigned char const* data, size_t length)
 
 // ==== ==== ==== ====
 
-StringSet::StringSet() {
+StringSet::StringSet()
+    : m_storage {16 * 1024} {
 	constexpr int initial_size = 8;
 	m_slot.resize(initial_size);
 	memset(m_slot.data(), 0, sizeof(m_slot[0]) * initial_size);
@@ -31,24 +34,7 @@ StringSet::StringSet() {
 	memset(m_value.data(), 0, sizeof(m_value[0]) * initial_size);
 }
 
-std::pair<std::string const*, bool> StringSet::insert(std::string&& s) {
-	if (m_size * 2 >= m_slot.size())
-		rehash(m_slot.size() * 2);
-
-	uint64_t hash_bits = compute_effective_hash(
-	    reinterpret_cast<unsigned char const*>(s.data()), s.size());
-	auto pos = scan(s.data(), s.size(), hash_bits);
-
-	if (pos.found)
-		return {m_value[pos.stop_index], false};
-
-	m_size += 1;
-	put(pos.free_index, std::move(s), hash_bits);
-
-	return {m_value[pos.free_index], true};
-}
-
-std::pair<std::string const*, bool> StringSet::insert(char const* data, size_t length) {
+std::pair<StringSet::Entry const*, bool> StringSet::insert(char const* data, size_t length) {
 	if (m_size * 2 >= m_slot.size())
 		rehash(m_slot.size() * 2);
 
@@ -59,16 +45,18 @@ std::pair<std::string const*, bool> StringSet::insert(char const* data, size_t l
 		return {m_value[pos.stop_index], false};
 
 	m_size += 1;
-	put(pos.free_index, std::string {data, length}, hash_bits);
+	return {put(pos.free_index, data, length, hash_bits), true};
+}
 
-	return {m_value[pos.free_index], true};
+std::pair<StringSet::Entry const*, bool> StringSet::insert(string_view s) {
+	return insert(s.data(), s.size());
 }
 
-std::pair<std::string const*, bool> StringSet::insert(std::string const& s) {
+std::pair<StringSet::Entry const*, bool> StringSet::insert(std::string const& s) {
 	return insert(s.data(), s.size());
 }
 
-std::pair<std::string const*, bool> StringSet::insert(char const* data) {
+std::pair<StringSet::Entry const*, bool> StringSet::insert(char const* data) {
 	return insert(data, strlen(data));
 }
 
@@ -84,6 +72,10 @@ bool StringSet::includes(char const* data) const {
 	return includes(data, strlen(data));
 }
 
+bool StringSet::includes(string_view str) const {
+	return includes(str.data(), str.size());
+}
+
 bool StringSet::includes(std::string const& str) const {
 	return includes(str.data(), str.size());
 }
@@ -99,7 +91,7 @@ void StringSet::rehash(size_t const new_size) {
 	m_slot.resize(new_size);
 	memset(m_slot.data(), 0, sizeof(m_slot[0]) * new_size);
 
-	std::vector<std::string*> old_value = std::move(m_value);
+	std::vector<Entry const*> old_value = std::move(m_value);
 	m_value.clear();
 	m_value.resize(new_size);
 	memset(m_value.data(), 0, sizeof(m_value[0]) * new_size);
@@ -113,7 +105,7 @@ void StringSet::rehash(size_t const new_size) {
 			continue;
 
 		auto value = old_value[i];
-		auto pos = scan(value->data(), value->size(), slot.hash_bits);
+		auto pos = scan(value->data(), value->length, slot.hash_bits);
 		assert(!pos.found);
 		m_value[pos.free_index] = value;
 		m_slot[pos.free_index].status = HashField::Occupied;
@@ -138,7 +130,7 @@ StringSet::ScanData StringSet::scan(
 	while (true) {
 		if (m_slot[position].status == HashField::Occupied) {
 			if (m_slot[position].hash_bits == hash_bits &&
-			    length == m_value[position]->size() &&
+			    length == m_value[position]->length &&
 			    memcmp(data, m_value[position]->data(), length) == 0)
 				return {free_position, position, true};
 		} else {
@@ -153,12 +145,20 @@ StringSet::ScanData StringSet::scan(
 	}
 }
 
-void StringSet::put(int position, std::string&& str, uint64_t hash_bits) {
+StringSet::Entry const* StringSet::put(
+    int position, char const* data, size_t length, uint64_t hash_bits) {
 	assert(m_slot[position].status != HashField::Occupied);
 	assert((hash_bits >> 62) == 0);
 
-	m_storage.push_back(std::move(str));
-	m_value[position] = &m_storage.back();
+	// lay out the header, then the bytes, then a NUL terminator
+	auto storage = m_storage.allocate(sizeof(Entry) + length + 1, alignof(Entry));
+	auto entry = new (storage) Entry {hash_bits, length};
+	memcpy(storage + sizeof(Entry), data, length);
+	storage[sizeof(Entry) + length] = '\0';
+
+	m_value[position] = entry;
 	m_slot[position].status = HashField::Occupied;
 	m_slot[position].hash_bits = hash_bits;
+
+	return entry;
 }
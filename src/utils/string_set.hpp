@@ -1,14 +1,34 @@
+#pragma once
+
 #include <string>
 #include <utility>
 #include <vector>
 
-#include "chunked_array.hpp"
+#include "bump_allocator.hpp"
+#include "string_view.hpp"
 
 #include <cstdint>
 
 // a flat linear hashing table
 // if rehashing occurs, references are not invalidated
+//
+// The bytes of every string are stored contiguously in a bump arena, right
+// after a small header that holds their hash and length. Strings are also
+// NUL-terminated, so they can be handed to C APIs directly.
 struct StringSet {
+	struct Entry {
+		uint64_t hash_bits;
+		size_t length;
+
+		char const* data() const {
+			return reinterpret_cast<char const*>(this + 1);
+		}
+
+		string_view view() const {
+			return {data(), length};
+		}
+	};
+
 	struct ScanData {
 		int free_index;
 		int stop_index;
@@ -25,28 +45,25 @@ struct StringSet {
 		uint64_t hash_bits : 62;
 	};
 
-	ChunkedArray<std::string> m_storage;
+	BumpAllocator m_storage;
 	std::vector<HashField> m_slot;
-	std::vector<std::string*> m_value;
+	std::vector<Entry const*> m_value;
 	size_t m_size {0};
 
 	StringSet();
 
-	std::pair<std::string const*, bool> insert(std::string const&);
-	std::pair<std::string const*, bool> insert(std::string&&);
-	// void insert(InternedString const&); // TODO
-	// void insert(string_view const&); // TODO
-	std::pair<std::string const*, bool> insert(char const*, size_t);
-	std::pair<std::string const*, bool> insert(char const*);
+	std::pair<Entry const*, bool> insert(std::string const&);
+	std::pair<Entry const*, bool> insert(string_view);
+	std::pair<Entry const*, bool> insert(char const*, size_t);
+	std::pair<Entry const*, bool> insert(char const*);
 
 	bool includes(std::string const&) const;
-	// bool includes(InternedString const&) const; // TODO
-	// bool includes(string_view const&) const; // TODO
+	bool includes(string_view) const;
 	bool includes(char const*, size_t) const;
 	bool includes(char const*) const;
 
   private:
 	ScanData scan(char const*, size_t, uint64_t) const;
-	void put(int, std::string&&, uint64_t);
+	Entry const* put(int, char const*, size_t, uint64_t);
 	void rehash(size_t);
 };
@@ -17,8 +17,23 @@ string_view::string_view(char const* data, size_t size)
     : m_data {data}
     , m_size {size} {}
 
+bool operator==(string_view lhs, string_view rhs) {
+	return lhs.size() == rhs.size() &&
+	       memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+bool operator!=(string_view lhs, string_view rhs) {
+	return !(lhs == rhs);
+}
+
+std::size_t std::hash<string_view>::operator()(string_view str) const noexcept {
+	// djb2 (k=33) hash function
+	std::size_t result = 5381;
+	for (char c : str)
+		result = result * 33 + static_cast<unsigned char>(c);
+	return result;
+}
+
 std::ostream& operator<<(std::ostream& o, string_view const& sv) {
-	for (char c : sv)
-		o << c;
-	return o;
+	return o.write(sv.data(), sv.size());
 }
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <iosfwd>
+#include <string>
+
+#include <cstddef>
 
 struct string_view {
 	char const* m_data {nullptr};
@@ -11,9 +14,18 @@ struct string_view {
 	string_view(const std::string&);
 	string_view(char const*, size_t size);
 
-	int size() {
+	int size() const {
 		return m_size;
 	}
+	bool empty() const {
+		return m_size == 0;
+	}
+	char const* data() const {
+		return m_data;
+	}
+	char operator[](int i) const {
+		return m_data[i];
+	}
 	char const* cbegin() const {
 		return m_data;
 	}
@@ -26,6 +38,18 @@ struct string_view {
 	char const* end() const {
 		return cend();
 	}
+
+	std::string to_string() const {
+		return std::string(m_data, m_size);
+	}
+};
+
+bool operator==(string_view, string_view);
+bool operator!=(string_view, string_view);
+
+// Specialize std::hash so that string views can be used as hash map keys
+template<> struct std::hash<string_view> {
+	std::size_t operator()(string_view str) const noexcept;
 };
 
 std::ostream& operator<<(std::ostream&, string_view const&);